@@ -1,5 +1,7 @@
 #include "BLEDeviceScanner.h"
 
+volatile bool BLEDeviceScanner::scanning = false;
+
 void BLEDeviceScanner::setup(int scanDuration, int maxRSSI)
 {
     this->scanDuration = scanDuration;
@@ -14,9 +16,46 @@ void BLEDeviceScanner::setup(int scanDuration, int maxRSSI)
 
 bool BLEDeviceScanner::isBLEDeviceNearby(std::vector<String> bleDeviceNames)
 {
-    bool found = false;
+    if (scanning)
+    {
+        // A background scan is already running, use its results instead
+        while (scanning)
+        {
+            delay(10);
+        }
+        return this->wasBLEDeviceNearby(bleDeviceNames);
+    }
+
     BLEScanResults foundDevices = this->pBLEScan->start(this->scanDuration, false);
+    bool found = this->matches(foundDevices, bleDeviceNames);
+    pBLEScan->clearResults();
+    return found;
+}
+
+bool BLEDeviceScanner::startScan()
+{
+    if (scanning)
+    {
+        return false;
+    }
+    this->pBLEScan->clearResults();
+    scanning = this->pBLEScan->start(this->scanDuration, BLEDeviceScanner::onScanComplete, false);
+    return scanning;
+}
 
+bool BLEDeviceScanner::isScanComplete()
+{
+    return !scanning;
+}
+
+bool BLEDeviceScanner::wasBLEDeviceNearby(std::vector<String> bleDeviceNames)
+{
+    BLEScanResults foundDevices = this->pBLEScan->getResults();
+    return this->matches(foundDevices, bleDeviceNames);
+}
+
+bool BLEDeviceScanner::matches(BLEScanResults &foundDevices, std::vector<String> &bleDeviceNames)
+{
     for (int i = 0; i < foundDevices.getCount(); i++)
     {
         auto device = foundDevices.getDevice(i);
@@ -28,11 +67,14 @@ bool BLEDeviceScanner::isBLEDeviceNearby(std::vector<String> bleDeviceNames)
         {
             if (device.getName() == bleDeviceName.c_str())
             {
-                found = true;
-                break;
+                return true;
             }
         }
     }
-    pBLEScan->clearResults();
-    return found;
-}
\ No newline at end of file
+    return false;
+}
+
+void BLEDeviceScanner::onScanComplete(BLEScanResults results)
+{
+    scanning = false;
+}
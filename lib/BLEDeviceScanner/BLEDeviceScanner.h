@@ -10,11 +10,18 @@ class BLEDeviceScanner
 public:
     void setup(int scanDuration, int maxRSSI);
     bool isBLEDeviceNearby(std::vector<String> bleDeviceNames);
+    bool startScan();
+    bool isScanComplete();
+    bool wasBLEDeviceNearby(std::vector<String> bleDeviceNames);
 
 private:
+    bool matches(BLEScanResults &foundDevices, std::vector<String> &bleDeviceNames);
+    static void onScanComplete(BLEScanResults results);
+
     BLEScan *pBLEScan;
     int scanDuration;
     int maxRSSI;
+    static volatile bool scanning;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,185 @@
+#include "CircuitBreaker.h"
+#include <algorithm>
+
+String breaker_state_to_string(breaker_state state)
+{
+    switch (state)
+    {
+    case BREAKER_OPEN:
+        return "open";
+    case BREAKER_HALF_OPEN:
+        return "half-open";
+    case BREAKER_CLOSED:
+    default:
+        return "closed";
+    }
+}
+
+bool http_status_is_failure(int status)
+{
+    return status <= 0 || status >= 500 || status == 429;
+}
+
+CircuitBreaker::CircuitBreaker()
+{
+    this->current_state = BREAKER_CLOSED;
+    this->held = false;
+    this->consecutive_failures = 0;
+    this->failed_at = 0;
+    this->opened_at = 0;
+    this->open_duration = BREAKER_OPEN_DURATION;
+    this->probe_in_flight = false;
+    this->latency_count = 0;
+    this->latency_next = 0;
+    memset(&this->counters, 0, sizeof(this->counters));
+}
+
+bool CircuitBreaker::allow()
+{
+    if (this->held)
+    {
+        return false;
+    }
+    switch (this->current_state)
+    {
+    case BREAKER_CLOSED:
+        if (!this->retry_due())
+        {
+            this->counters.short_circuits++;
+            return false;
+        }
+        return true;
+    case BREAKER_OPEN:
+        if (millis() - this->opened_at < this->open_duration)
+        {
+            this->counters.short_circuits++;
+            return false;
+        }
+        // Let a single probe through to see if the sink is back
+        this->current_state = BREAKER_HALF_OPEN;
+        this->probe_in_flight = true;
+        return true;
+    case BREAKER_HALF_OPEN:
+    default:
+        if (this->probe_in_flight)
+        {
+            this->counters.short_circuits++;
+            return false;
+        }
+        this->probe_in_flight = true;
+        return true;
+    }
+}
+
+bool CircuitBreaker::ready()
+{
+    if (this->held)
+    {
+        return false;
+    }
+    switch (this->current_state)
+    {
+    case BREAKER_CLOSED:
+        return this->retry_due();
+    case BREAKER_OPEN:
+        return millis() - this->opened_at >= this->open_duration;
+    case BREAKER_HALF_OPEN:
+    default:
+        return !this->probe_in_flight;
+    }
+}
+
+void CircuitBreaker::record_success(unsigned long latency_ms)
+{
+    this->counters.successes++;
+    this->consecutive_failures = 0;
+    this->current_state = BREAKER_CLOSED;
+    this->open_duration = BREAKER_OPEN_DURATION;
+    this->probe_in_flight = false;
+
+    this->latencies[this->latency_next] = latency_ms;
+    this->latency_next = (this->latency_next + 1) % BREAKER_LATENCY_WINDOW;
+    this->latency_count = min(this->latency_count + 1, (size_t)BREAKER_LATENCY_WINDOW);
+}
+
+void CircuitBreaker::record_failure()
+{
+    this->counters.failures++;
+    this->consecutive_failures++;
+    this->failed_at = millis();
+    this->probe_in_flight = false;
+
+    if (this->current_state == BREAKER_HALF_OPEN)
+    {
+        this->open_duration = min(this->open_duration * 2, BREAKER_MAX_OPEN_DURATION);
+        this->open();
+    }
+    else if (this->current_state == BREAKER_CLOSED && this->consecutive_failures >= BREAKER_FAILURE_THRESHOLD)
+    {
+        this->open();
+    }
+}
+
+void CircuitBreaker::record_neutral()
+{
+    this->probe_in_flight = false;
+}
+
+void CircuitBreaker::record_http_status(int status, unsigned long latency_ms)
+{
+    if (status >= 200 && status < 300)
+    {
+        this->record_success(latency_ms);
+    }
+    else if (http_status_is_failure(status))
+    {
+        this->record_failure();
+    }
+    else
+    {
+        this->record_neutral();
+    }
+}
+
+void CircuitBreaker::hold(bool held)
+{
+    this->held = held;
+}
+
+void CircuitBreaker::open()
+{
+    this->current_state = BREAKER_OPEN;
+    this->opened_at = millis();
+    this->counters.opens++;
+}
+
+bool CircuitBreaker::retry_due()
+{
+    return this->consecutive_failures == 0 ||
+           millis() - this->failed_at >= BREAKER_RETRY_DELAY << (this->consecutive_failures - 1);
+}
+
+unsigned long CircuitBreaker::timeout()
+{
+    if (this->latency_count < BREAKER_MIN_SAMPLES)
+    {
+        return BREAKER_MAX_TIMEOUT;
+    }
+
+    unsigned long sorted[BREAKER_LATENCY_WINDOW];
+    memcpy(sorted, this->latencies, this->latency_count * sizeof(unsigned long));
+    std::sort(sorted, sorted + this->latency_count);
+    unsigned long p99 = sorted[(this->latency_count * 99 - 1) / 100];
+
+    return constrain(p99 * BREAKER_TIMEOUT_MULTIPLIER, BREAKER_MIN_TIMEOUT, BREAKER_MAX_TIMEOUT);
+}
+
+breaker_state CircuitBreaker::state()
+{
+    return this->current_state;
+}
+
+const breaker_stats &CircuitBreaker::stats()
+{
+    return this->counters;
+}
@@ -0,0 +1,83 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <Arduino.h>
+
+// Consecutive failures before the breaker opens
+#define BREAKER_FAILURE_THRESHOLD 3
+// Until then, the closed breaker waits this long after a failure before
+// letting the next request through, doubling with every consecutive failure
+const unsigned long BREAKER_RETRY_DELAY = 2 * 1000;
+// How long an open breaker fails fast before letting a probe through;
+// doubles on every failed probe up to BREAKER_MAX_OPEN_DURATION
+const unsigned long BREAKER_OPEN_DURATION = 30 * 1000;
+const unsigned long BREAKER_MAX_OPEN_DURATION = 10 * 60 * 1000;
+// Request timeouts follow the p99 of recent successful latencies
+#define BREAKER_LATENCY_WINDOW 32
+#define BREAKER_MIN_SAMPLES 5
+#define BREAKER_TIMEOUT_MULTIPLIER 3
+const unsigned long BREAKER_MIN_TIMEOUT = 1000;
+const unsigned long BREAKER_MAX_TIMEOUT = 10 * 1000;
+
+typedef enum
+{
+    BREAKER_CLOSED = 0,
+    BREAKER_OPEN = 1,
+    BREAKER_HALF_OPEN = 2,
+} breaker_state;
+
+typedef struct
+{
+    unsigned long successes;
+    unsigned long failures;
+    unsigned long short_circuits;
+    unsigned long opens;
+} breaker_stats;
+
+// Guards one sink. Callers ask allow() before touching the network and report
+// the outcome; while open, allow() fails fast instead of waiting on a dead host.
+class CircuitBreaker
+{
+public:
+    CircuitBreaker();
+    bool allow();
+    // Whether allow() would let a request through, without counting a skip
+    bool ready();
+    void record_success(unsigned long latency_ms);
+    void record_failure();
+    // An answer that says nothing about the sink's health, such as a
+    // rejected request; only frees the half-open probe
+    void record_neutral();
+    // 2xx is a success; 5xx, 429, no answer (0) and an unusable answer
+    // (negative) are failures; anything else is neutral
+    void record_http_status(int status, unsigned long latency_ms);
+    // While held (the network is down) nothing is let through, without
+    // counting skips or touching the state, so requests wait for the link
+    // instead of opening the breaker
+    void hold(bool held);
+    unsigned long timeout();
+    breaker_state state();
+    const breaker_stats &stats();
+
+private:
+    void open();
+    bool retry_due();
+
+    breaker_state current_state;
+    bool held;
+    unsigned int consecutive_failures;
+    unsigned long failed_at;
+    unsigned long opened_at;
+    unsigned long open_duration;
+    bool probe_in_flight;
+    unsigned long latencies[BREAKER_LATENCY_WINDOW];
+    size_t latency_count;
+    size_t latency_next;
+    breaker_stats counters;
+};
+
+String breaker_state_to_string(breaker_state state);
+// What record_http_status() counts as a failure; worth retrying later
+bool http_status_is_failure(int status);
+
+#endif
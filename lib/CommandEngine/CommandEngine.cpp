@@ -0,0 +1,122 @@
+#include "CommandEngine.h"
+
+void CommandSession::next(int step)
+{
+    this->sleep(0, step);
+}
+
+void CommandSession::sleep(unsigned long duration_ms, int step)
+{
+    this->step = step;
+    this->wake_at = millis() + duration_ms;
+    this->awaiting_input = false;
+    this->scheduled = true;
+}
+
+void CommandSession::await_input(unsigned long timeout_ms, int step)
+{
+    this->sleep(timeout_ms, step);
+    this->awaiting_input = true;
+}
+
+void CommandSession::finish()
+{
+    this->scheduled = false;
+    this->awaiting_input = false;
+    this->active = false;
+}
+
+CommandEngine::CommandEngine()
+{
+    for (auto &session : this->sessions)
+    {
+        session.active = false;
+    }
+}
+
+void CommandEngine::on(const String &command, command_handler handler)
+{
+    this->handlers[command] = handler;
+}
+
+command_dispatch_status CommandEngine::dispatch(const String &chat_id, const String &from_name, const String &text)
+{
+    // A reply to a command waiting on this chat is delivered to it first
+    for (auto &session : this->sessions)
+    {
+        if (session.active && session.awaiting_input && session.chat_id == chat_id)
+        {
+            session.input = text;
+            this->run(session);
+            // Anything other than a command was only meant as the reply
+            if (!text.startsWith("/"))
+            {
+                return COMMAND_INPUT;
+            }
+            break;
+        }
+    }
+
+    int separator = text.indexOf(' ');
+    String command = separator < 0 ? text : text.substring(0, separator);
+    auto handler = this->handlers.find(command);
+    if (handler == this->handlers.end())
+    {
+        return COMMAND_UNKNOWN;
+    }
+
+    for (auto &session : this->sessions)
+    {
+        if (session.active)
+        {
+            continue;
+        }
+        session.active = true;
+        session.chat_id = chat_id;
+        session.from_name = from_name;
+        session.command = command;
+        session.args = separator < 0 ? "" : text.substring(separator + 1);
+        session.args.trim();
+        session.input = "";
+        session.step = 0;
+        this->run(session);
+        return COMMAND_STARTED;
+    }
+    return COMMAND_BUSY;
+}
+
+void CommandEngine::tick()
+{
+    for (auto &session : this->sessions)
+    {
+        if (session.active && (long)(millis() - session.wake_at) >= 0)
+        {
+            if (session.awaiting_input)
+            {
+                session.input = "";
+            }
+            this->run(session);
+        }
+    }
+}
+
+size_t CommandEngine::active_sessions()
+{
+    size_t count = 0;
+    for (auto &session : this->sessions)
+    {
+        count += session.active ? 1 : 0;
+    }
+    return count;
+}
+
+void CommandEngine::run(CommandSession &session)
+{
+    session.scheduled = false;
+    session.awaiting_input = false;
+    this->handlers[session.command](session);
+    if (!session.scheduled)
+    {
+        session.finish();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef COMMAND_ENGINE_H
+#define COMMAND_ENGINE_H
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+
+#define COMMAND_ENGINE_MAX_SESSIONS 4
+
+typedef enum
+{
+    COMMAND_STARTED = 1,
+    COMMAND_INPUT = 2,
+    COMMAND_UNKNOWN = -1,
+    COMMAND_BUSY = -2,
+} command_dispatch_status;
+
+// State of one running command. Handlers are called once per step and must
+// never block; they pick what happens next with next(), sleep(),
+// await_input() or finish(). A handler that picks nothing is finished.
+class CommandSession
+{
+public:
+    void next(int step);
+    void sleep(unsigned long duration_ms, int step);
+    void await_input(unsigned long timeout_ms, int step);
+    void finish();
+
+    String chat_id;
+    String from_name;
+    String command;
+    String args;
+    // Reply delivered to await_input(); empty if it timed out
+    String input;
+    int step;
+
+private:
+    friend class CommandEngine;
+
+    bool active;
+    bool scheduled;
+    bool awaiting_input;
+    unsigned long wake_at;
+};
+
+typedef std::function<void(CommandSession &session)> command_handler;
+
+// Runs chat commands as resumable state machines from the main loop, so a
+// long running command never holds up door sensing or other commands.
+class CommandEngine
+{
+public:
+    CommandEngine();
+    void on(const String &command, command_handler handler);
+    command_dispatch_status dispatch(const String &chat_id, const String &from_name, const String &text);
+    void tick();
+    size_t active_sessions();
+
+private:
+    void run(CommandSession &session);
+
+    std::map<String, command_handler> handlers;
+    CommandSession sessions[COMMAND_ENGINE_MAX_SESSIONS];
+};
+#endif
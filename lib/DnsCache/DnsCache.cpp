@@ -0,0 +1,469 @@
+#include "DnsCache.h"
+
+#define DNS_PACKET_SIZE 512
+#define DNS_HEADER_SIZE 12
+#define DNS_FLAG_RESPONSE 0x8000
+#define DNS_FLAG_RECURSION_DESIRED 0x0100
+#define DNS_RCODE_MASK 0x000F
+#define DNS_TYPE_A 1
+#define DNS_CLASS_IN 1
+
+static bool deadline_passed(unsigned long deadline)
+{
+    return (long)(millis() - deadline) >= 0;
+}
+
+static uint16_t read_u16(const uint8_t *data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static uint32_t read_u32(const uint8_t *data)
+{
+    return ((uint32_t)read_u16(data) << 16) | read_u16(data + 2);
+}
+
+// Advances past a (possibly compressed) name; returns false if it runs off the packet
+static bool skip_name(const uint8_t *packet, size_t length, size_t &offset)
+{
+    while (offset < length)
+    {
+        uint8_t label = packet[offset];
+        if (label == 0)
+        {
+            offset++;
+            return true;
+        }
+        if ((label & 0xC0) == 0xC0)
+        {
+            offset += 2;
+            return offset <= length;
+        }
+        offset += label + 1;
+    }
+    return false;
+}
+
+DnsCache::DnsCache()
+{
+    this->entries_len = 0;
+    this->mutex = xSemaphoreCreateMutex();
+    memset(&this->cache_stats, 0, sizeof(this->cache_stats));
+}
+
+void DnsCache::begin(uint32_t stack_size, UBaseType_t priority, BaseType_t core)
+{
+    xTaskCreatePinnedToCore(DnsCache::task, "dns", stack_size, this, priority, NULL, core);
+}
+
+bool DnsCache::add(const char *host)
+{
+    if (strlen(host) >= DNS_MAX_HOST_LENGTH)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    dns_entry *entry = this->find(host);
+    if (entry == NULL)
+    {
+        // Picked up by the task straight away
+        entry = this->allocate(host);
+    }
+    xSemaphoreGive(this->mutex);
+    return entry != NULL;
+}
+
+bool DnsCache::pin(const char *host, const IPAddress &address)
+{
+    if (strlen(host) >= DNS_MAX_HOST_LENGTH)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    dns_entry *entry = this->find(host);
+    if (entry == NULL)
+    {
+        entry = this->allocate(host);
+    }
+    if (entry == NULL)
+    {
+        xSemaphoreGive(this->mutex);
+        return false;
+    }
+    entry->address = address;
+    entry->resolved = true;
+    entry->pinned = true;
+    xSemaphoreGive(this->mutex);
+    return true;
+}
+
+bool DnsCache::resolve(const char *host, IPAddress &address)
+{
+    if (strlen(host) >= DNS_MAX_HOST_LENGTH)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    dns_entry *entry = this->find(host);
+    if (entry != NULL && entry->resolved)
+    {
+        address = entry->address;
+        if (deadline_passed(entry->expires_at) && !entry->pinned)
+        {
+            // Past its TTL but DNS has not answered since; better than nothing
+            this->cache_stats.stale_hits++;
+        }
+        else
+        {
+            this->cache_stats.hits++;
+        }
+        xSemaphoreGive(this->mutex);
+        return true;
+    }
+    this->cache_stats.misses++;
+    xSemaphoreGive(this->mutex);
+
+    // Never seen this host: resolve it on the caller's path, once
+    unsigned long ttl;
+    bool resolved = this->lookup(host, address, ttl);
+    this->store(host, resolved, address, ttl);
+    return resolved;
+}
+
+void DnsCache::mark_stale(const char *host)
+{
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    dns_entry *entry = this->find(host);
+    if (entry != NULL && !entry->pinned)
+    {
+        entry->refresh_at = millis();
+    }
+    xSemaphoreGive(this->mutex);
+}
+
+size_t DnsCache::size()
+{
+    return this->entries_len;
+}
+
+dns_cache_stats DnsCache::stats()
+{
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    dns_cache_stats copy = this->cache_stats;
+    xSemaphoreGive(this->mutex);
+    return copy;
+}
+
+void DnsCache::task(void *parameter)
+{
+    DnsCache *cache = (DnsCache *)parameter;
+    for (;;)
+    {
+        if (WiFi.status() == WL_CONNECTED)
+        {
+            cache->refresh_due();
+        }
+        delay(DNS_TASK_INTERVAL);
+    }
+}
+
+void DnsCache::refresh_due()
+{
+    for (size_t i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        char host[DNS_MAX_HOST_LENGTH];
+
+        xSemaphoreTake(this->mutex, portMAX_DELAY);
+        bool due = i < this->entries_len && !this->entries[i].pinned && deadline_passed(this->entries[i].refresh_at);
+        if (due)
+        {
+            strcpy(host, this->entries[i].host);
+        }
+        xSemaphoreGive(this->mutex);
+
+        if (due)
+        {
+            IPAddress address;
+            unsigned long ttl;
+            bool resolved = this->lookup(host, address, ttl);
+            this->store(host, resolved, address, ttl);
+#ifdef DNS_CACHE_DEBUG
+            Serial.printf("DnsCache: refreshed %s -> %s (%lus)\n", host, resolved ? address.toString().c_str() : "failed", ttl / 1000);
+#endif
+        }
+    }
+}
+
+bool DnsCache::lookup(const char *host, IPAddress &address, unsigned long &ttl)
+{
+    unsigned long started = millis();
+    bool resolved = this->query(host, address, ttl);
+    if (!resolved && WiFi.hostByName(host, address))
+    {
+        resolved = true;
+        ttl = DNS_FALLBACK_TTL;
+    }
+    unsigned long duration = millis() - started;
+
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    this->cache_stats.lookups++;
+    this->cache_stats.total_lookup_ms += duration;
+    this->cache_stats.max_lookup_ms = max(this->cache_stats.max_lookup_ms, duration);
+    if (!resolved)
+    {
+        this->cache_stats.failures++;
+    }
+    xSemaphoreGive(this->mutex);
+    return resolved;
+}
+
+// Asks the network's DNS server for an A record directly, since the system
+// resolver does not report the record's TTL
+bool DnsCache::query(const char *host, IPAddress &address, unsigned long &ttl)
+{
+    IPAddress server = WiFi.dnsIP();
+    if ((uint32_t)server == 0)
+    {
+        return false;
+    }
+
+    uint8_t packet[DNS_PACKET_SIZE];
+    uint16_t id = esp_random();
+    memset(packet, 0, DNS_HEADER_SIZE);
+    packet[0] = id >> 8;
+    packet[1] = id;
+    packet[2] = DNS_FLAG_RECURSION_DESIRED >> 8;
+    packet[5] = 1; // one question
+
+    size_t length = DNS_HEADER_SIZE;
+    const char *label = host;
+    while (*label != '\0')
+    {
+        const char *dot = strchr(label, '.');
+        size_t label_length = dot != NULL ? dot - label : strlen(label);
+        if (label_length == 0 || label_length > 63 || length + label_length + 6 > sizeof(packet))
+        {
+            return false;
+        }
+        packet[length++] = label_length;
+        memcpy(packet + length, label, label_length);
+        length += label_length;
+        label += label_length + (dot != NULL ? 1 : 0);
+    }
+    packet[length++] = 0;
+    packet[length++] = 0;
+    packet[length++] = DNS_TYPE_A;
+    packet[length++] = 0;
+    packet[length++] = DNS_CLASS_IN;
+
+    WiFiUDP udp;
+    if (!udp.beginPacket(server, DNS_PORT))
+    {
+        return false;
+    }
+    udp.write(packet, length);
+    if (!udp.endPacket())
+    {
+        return false;
+    }
+
+    unsigned long started = millis();
+    while (millis() - started < DNS_QUERY_TIMEOUT)
+    {
+        int size = udp.parsePacket();
+        if (size <= 0)
+        {
+            delay(10);
+            continue;
+        }
+        int received = udp.read(packet, sizeof(packet));
+        if (received < DNS_HEADER_SIZE || read_u16(packet) != id)
+        {
+            continue;
+        }
+        length = received;
+
+        uint16_t flags = read_u16(packet + 2);
+        if (!(flags & DNS_FLAG_RESPONSE) || (flags & DNS_RCODE_MASK) != 0)
+        {
+            return false;
+        }
+        uint16_t questions = read_u16(packet + 4);
+        uint16_t answers = read_u16(packet + 6);
+
+        size_t offset = DNS_HEADER_SIZE;
+        for (uint16_t i = 0; i < questions; i++)
+        {
+            if (!skip_name(packet, length, offset))
+            {
+                return false;
+            }
+            offset += 4;
+        }
+
+        // Follow any CNAMEs to the first A record; the chain's shortest TTL wins
+        uint32_t min_ttl = UINT32_MAX;
+        for (uint16_t i = 0; i < answers; i++)
+        {
+            if (!skip_name(packet, length, offset) || offset + 10 > length)
+            {
+                return false;
+            }
+            uint16_t type = read_u16(packet + offset);
+            uint16_t record_class = read_u16(packet + offset + 2);
+            uint32_t record_ttl = read_u32(packet + offset + 4);
+            uint16_t data_length = read_u16(packet + offset + 8);
+            offset += 10;
+            if (offset + data_length > length)
+            {
+                return false;
+            }
+
+            min_ttl = min(min_ttl, record_ttl);
+            if (type == DNS_TYPE_A && record_class == DNS_CLASS_IN && data_length == 4)
+            {
+                address = IPAddress(packet[offset], packet[offset + 1], packet[offset + 2], packet[offset + 3]);
+                ttl = min(min_ttl, (uint32_t)(DNS_MAX_TTL / 1000)) * 1000UL;
+                ttl = max(ttl, DNS_MIN_TTL);
+                return true;
+            }
+            offset += data_length;
+        }
+        return false;
+    }
+    return false;
+}
+
+void DnsCache::store(const char *host, bool resolved, const IPAddress &address, unsigned long ttl)
+{
+    xSemaphoreTake(this->mutex, portMAX_DELAY);
+    dns_entry *entry = this->find(host);
+    if (entry == NULL)
+    {
+        entry = this->allocate(host);
+    }
+    if (entry == NULL)
+    {
+        // Every slot is pinned
+        xSemaphoreGive(this->mutex);
+        return;
+    }
+
+    unsigned long now = millis();
+    if (resolved)
+    {
+        entry->address = address;
+        entry->resolved = true;
+        entry->expires_at = now + ttl;
+        entry->refresh_at = now + ttl - ttl / DNS_PREFETCH_DIVISOR;
+    }
+    else
+    {
+        // Keep serving the last known address until DNS answers again
+        entry->refresh_at = now + DNS_RETRY_INTERVAL;
+    }
+    xSemaphoreGive(this->mutex);
+}
+
+// Called with the mutex held
+DnsCache::dns_entry *DnsCache::allocate(const char *host)
+{
+    dns_entry *entry;
+    if (this->entries_len < DNS_CACHE_SIZE)
+    {
+        entry = &this->entries[this->entries_len++];
+    }
+    else
+    {
+        // Evict whichever entry expires first, pinned ones never
+        entry = NULL;
+        for (size_t i = 0; i < DNS_CACHE_SIZE; i++)
+        {
+            if (this->entries[i].pinned)
+            {
+                continue;
+            }
+            if (entry == NULL || (long)(this->entries[i].expires_at - entry->expires_at) < 0)
+            {
+                entry = &this->entries[i];
+            }
+        }
+        if (entry == NULL)
+        {
+            return NULL;
+        }
+    }
+    strcpy(entry->host, host);
+    entry->resolved = false;
+    entry->pinned = false;
+    entry->expires_at = millis();
+    entry->refresh_at = millis();
+    return entry;
+}
+
+DnsCache::dns_entry *DnsCache::find(const char *host)
+{
+    for (size_t i = 0; i < this->entries_len; i++)
+    {
+        if (strcmp(this->entries[i].host, host) == 0)
+        {
+            return &this->entries[i];
+        }
+    }
+    return NULL;
+}
+
+DnsCachedClient::DnsCachedClient(DnsCache *cache)
+{
+    this->cache = cache;
+}
+
+void DnsCachedClient::set_dns_cache(DnsCache *cache)
+{
+    this->cache = cache;
+}
+
+int DnsCachedClient::connect(const char *host, uint16_t port)
+{
+    IPAddress address;
+    if (this->cache == NULL || !this->cache->resolve(host, address))
+    {
+        return WiFiClient::connect(host, port);
+    }
+
+    int connected = WiFiClient::connect(address, port);
+    if (!connected)
+    {
+        this->cache->mark_stale(host);
+    }
+    return connected;
+}
+
+DnsCachedSecureClient::DnsCachedSecureClient(DnsCache *cache)
+{
+    this->cache = cache;
+}
+
+void DnsCachedSecureClient::set_dns_cache(DnsCache *cache)
+{
+    this->cache = cache;
+}
+
+int DnsCachedSecureClient::connect(const char *host, uint16_t port)
+{
+    IPAddress address;
+    if (this->cache == NULL || !this->cache->resolve(host, address))
+    {
+        return WiFiClientSecure::connect(host, port);
+    }
+
+    int connected = WiFiClientSecure::connect(address, port, host, this->_CA_cert, this->_cert, this->_private_key);
+    if (!connected)
+    {
+        this->cache->mark_stale(host);
+    }
+    return connected;
+}
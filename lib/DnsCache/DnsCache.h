@@ -0,0 +1,107 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <WiFiClientSecure.h>
+
+// #define DNS_CACHE_DEBUG 1
+
+#define DNS_CACHE_SIZE 8
+#define DNS_MAX_HOST_LENGTH 64
+#define DNS_PORT 53
+const unsigned long DNS_QUERY_TIMEOUT = 2 * 1000;
+// Record TTLs are clamped so a zero TTL does not mean a query per connection
+// and a long one does not hide a moved sink for days
+const unsigned long DNS_MIN_TTL = 60 * 1000;
+const unsigned long DNS_MAX_TTL = 60 * 60 * 1000;
+// Used when the address came from the system resolver, which hides the TTL
+const unsigned long DNS_FALLBACK_TTL = 5 * 60 * 1000;
+// Entries are refreshed once this fraction of their TTL is left
+#define DNS_PREFETCH_DIVISOR 5
+const unsigned long DNS_RETRY_INTERVAL = 30 * 1000;
+#define DNS_TASK_INTERVAL 1000
+
+typedef struct
+{
+    unsigned long hits;
+    unsigned long stale_hits;
+    unsigned long misses;
+    unsigned long lookups;
+    unsigned long failures;
+    unsigned long total_lookup_ms;
+    unsigned long max_lookup_ms;
+} dns_cache_stats;
+
+// Remembers sink addresses for their DNS TTL and refreshes them on a
+// background task before they expire, so connecting never waits on DNS once a
+// host is known. When a refresh fails the last known address is kept.
+class DnsCache
+{
+public:
+    DnsCache();
+    void begin(uint32_t stack_size, UBaseType_t priority, BaseType_t core);
+    // Registers a host to be resolved ahead of its first connection
+    bool add(const char *host);
+    // Answers for host with a fixed address and never looks it up, e.g. to
+    // point a sink at a local stand-in server
+    bool pin(const char *host, const IPAddress &address);
+    bool resolve(const char *host, IPAddress &address);
+    // Asks for a refresh, e.g. after the cached address refused a connection
+    void mark_stale(const char *host);
+    size_t size();
+    dns_cache_stats stats();
+
+private:
+    typedef struct
+    {
+        char host[DNS_MAX_HOST_LENGTH];
+        IPAddress address;
+        bool resolved;
+        bool pinned;
+        unsigned long expires_at;
+        unsigned long refresh_at;
+    } dns_entry;
+
+    static void task(void *parameter);
+    void refresh_due();
+    bool lookup(const char *host, IPAddress &address, unsigned long &ttl);
+    bool query(const char *host, IPAddress &address, unsigned long &ttl);
+    void store(const char *host, bool resolved, const IPAddress &address, unsigned long ttl);
+    dns_entry *find(const char *host);
+    dns_entry *allocate(const char *host);
+
+    dns_entry entries[DNS_CACHE_SIZE];
+    size_t entries_len;
+    SemaphoreHandle_t mutex;
+    dns_cache_stats cache_stats;
+};
+
+// Drop-in WiFiClient that resolves host names through a DnsCache
+class DnsCachedClient : public WiFiClient
+{
+public:
+    DnsCachedClient(DnsCache *cache = NULL);
+    void set_dns_cache(DnsCache *cache);
+    using WiFiClient::connect;
+    int connect(const char *host, uint16_t port) override;
+
+private:
+    DnsCache *cache;
+};
+
+// Drop-in WiFiClientSecure that resolves host names through a DnsCache; the
+// host name is still used for SNI and certificate verification
+class DnsCachedSecureClient : public WiFiClientSecure
+{
+public:
+    DnsCachedSecureClient(DnsCache *cache = NULL);
+    void set_dns_cache(DnsCache *cache);
+    using WiFiClientSecure::connect;
+    int connect(const char *host, uint16_t port) override;
+
+private:
+    DnsCache *cache;
+};
+#endif
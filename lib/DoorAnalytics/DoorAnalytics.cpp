@@ -0,0 +1,300 @@
+#include "DoorAnalytics.h"
+
+const unsigned long ANALYTICS_HOUR_MS = 60UL * 60UL * 1000UL;
+#define ANALYTICS_NO_HOUR 0xFFFFFFFF
+
+DoorAnalytics::DoorAnalytics(uint8_t overnight_start_hour, uint8_t overnight_end_hour, unsigned long checkpoint_interval)
+{
+    this->overnight_start_hour = overnight_start_hour;
+    this->overnight_end_hour = overnight_end_hour;
+    this->checkpoint_interval = checkpoint_interval;
+    this->preferences = NULL;
+    this->key = NULL;
+    this->dirty = false;
+    this->last_checkpoint = 0;
+    this->open = false;
+    this->opened_millis = 0;
+    this->opened_timestamp = 0;
+
+    memset(&this->current, 0, sizeof(this->current));
+    this->current.version = ANALYTICS_STATE_VERSION;
+    quantile_init(this->current.p50, 0.50);
+    quantile_init(this->current.p95, 0.95);
+    quantile_init(this->current.p99, 0.99);
+
+    memset(this->recent_opens, 0, sizeof(this->recent_opens));
+    for (int i = 0; i < ANALYTICS_HOURS; i++)
+    {
+        this->recent_hour[i] = ANALYTICS_NO_HOUR;
+    }
+}
+
+void DoorAnalytics::begin(Preferences &preferences, const char *key)
+{
+    this->preferences = &preferences;
+    this->key = key;
+    this->last_checkpoint = millis();
+
+    door_analytics_state saved;
+    if (preferences.getBytesLength(key) == sizeof(saved) &&
+        preferences.getBytes(key, &saved, sizeof(saved)) == sizeof(saved) &&
+        saved.version == ANALYTICS_STATE_VERSION)
+    {
+        this->current = saved;
+    }
+#ifdef DOOR_ANALYTICS_DEBUG
+    Serial.printf("DoorAnalytics: resumed with %u opens\n", this->current.opens);
+#endif
+}
+
+void DoorAnalytics::opened(uint32_t timestamp)
+{
+    this->open = true;
+    this->opened_millis = millis();
+    this->opened_timestamp = timestamp;
+
+    this->current.opens++;
+    if (timestamp > 0)
+    {
+        time_t t = timestamp;
+        struct tm local;
+        localtime_r(&t, &local);
+        this->current.opens_by_hour[local.tm_hour]++;
+    }
+
+    uint32_t hour = this->opened_millis / ANALYTICS_HOUR_MS;
+    int bucket = hour % ANALYTICS_HOURS;
+    if (this->recent_hour[bucket] != hour)
+    {
+        this->recent_hour[bucket] = hour;
+        this->recent_opens[bucket] = 0;
+    }
+    this->recent_opens[bucket]++;
+
+    this->dirty = true;
+}
+
+void DoorAnalytics::closed(uint32_t timestamp)
+{
+    if (!this->open)
+    {
+        // Opened before the last restart; the duration is unknown
+        return;
+    }
+    this->open = false;
+
+    uint32_t duration_ms = millis() - this->opened_millis;
+    float duration_s = duration_ms / 1000.0f;
+    this->current.total_open_ms += duration_ms;
+    this->current.max_open_ms = max(this->current.max_open_ms, duration_ms);
+    quantile_add(this->current.p50, duration_s);
+    quantile_add(this->current.p95, duration_s);
+    quantile_add(this->current.p99, duration_s);
+
+    uint32_t opened_at = this->opened_timestamp;
+    if (opened_at == 0 && timestamp > 0)
+    {
+        // The clock was set while the door was open
+        opened_at = timestamp - duration_ms / 1000;
+    }
+    if (opened_at > 0 && this->overnight(opened_at, duration_ms / 1000))
+    {
+        this->current.overnight_opens++;
+    }
+
+    this->dirty = true;
+}
+
+bool DoorAnalytics::overnight(uint32_t opened_at, uint32_t duration_s)
+{
+    if (duration_s >= 24 * 60 * 60)
+    {
+        return true;
+    }
+
+    time_t t = opened_at;
+    struct tm local;
+    localtime_r(&t, &local);
+    uint8_t start = this->overnight_start_hour;
+    uint8_t end = this->overnight_end_hour;
+    bool night = start > end ? (local.tm_hour >= start || local.tm_hour < end)
+                             : (local.tm_hour >= start && local.tm_hour < end);
+    if (night)
+    {
+        return true;
+    }
+
+    // Still open when the next night began?
+    int32_t seconds_into_day = local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    int32_t until_night = start * 3600 - seconds_into_day;
+    if (until_night <= 0)
+    {
+        until_night += 24 * 60 * 60;
+    }
+    return duration_s >= (uint32_t)until_night;
+}
+
+void DoorAnalytics::tick()
+{
+    if (this->dirty && millis() - this->last_checkpoint >= this->checkpoint_interval)
+    {
+        this->checkpoint();
+    }
+}
+
+bool DoorAnalytics::checkpoint()
+{
+    this->last_checkpoint = millis();
+    if (this->preferences == NULL || !this->dirty)
+    {
+        return false;
+    }
+    if (this->preferences->putBytes(this->key, &this->current, sizeof(this->current)) != sizeof(this->current))
+    {
+#ifdef DOOR_ANALYTICS_DEBUG
+        Serial.println(F("DoorAnalytics: checkpoint failed"));
+#endif
+        return false;
+    }
+    this->dirty = false;
+    return true;
+}
+
+const door_analytics_state &DoorAnalytics::state()
+{
+    return this->current;
+}
+
+float DoorAnalytics::open_duration_quantile(float probability)
+{
+    if (probability >= 0.99f)
+    {
+        return quantile_value(this->current.p99);
+    }
+    if (probability >= 0.95f)
+    {
+        return quantile_value(this->current.p95);
+    }
+    return quantile_value(this->current.p50);
+}
+
+float DoorAnalytics::opens_per_hour()
+{
+    uint32_t hour = millis() / ANALYTICS_HOUR_MS;
+    uint32_t opens = 0;
+    for (int i = 0; i < ANALYTICS_HOURS; i++)
+    {
+        if (this->recent_hour[i] != ANALYTICS_NO_HOUR && hour - this->recent_hour[i] < ANALYTICS_HOURS)
+        {
+            opens += this->recent_opens[i];
+        }
+    }
+    return (float)opens / min(hour + 1, (uint32_t)ANALYTICS_HOURS);
+}
+
+bool DoorAnalytics::is_open()
+{
+    return this->open;
+}
+
+void DoorAnalytics::quantile_init(p2_quantile &quantile, float probability)
+{
+    memset(&quantile, 0, sizeof(quantile));
+    quantile.probability = probability;
+}
+
+void DoorAnalytics::quantile_add(p2_quantile &quantile, float value)
+{
+    float *q = quantile.heights;
+    int32_t *n = quantile.positions;
+    float p = quantile.probability;
+
+    // The first observations are kept sorted until every marker has a height
+    if (quantile.count < ANALYTICS_MARKERS)
+    {
+        int i = quantile.count++;
+        while (i > 0 && q[i - 1] > value)
+        {
+            q[i] = q[i - 1];
+            i--;
+        }
+        q[i] = value;
+
+        if (quantile.count == ANALYTICS_MARKERS)
+        {
+            for (int m = 0; m < ANALYTICS_MARKERS; m++)
+            {
+                n[m] = m;
+            }
+        }
+        return;
+    }
+    quantile.count++;
+
+    // Find the cell the value falls in, stretching the extremes if needed
+    int k;
+    if (value < q[0])
+    {
+        q[0] = value;
+        k = 0;
+    }
+    else if (value >= q[4])
+    {
+        q[4] = value;
+        k = 3;
+    }
+    else
+    {
+        k = 0;
+        while (value >= q[k + 1])
+        {
+            k++;
+        }
+    }
+
+    for (int m = k + 1; m < ANALYTICS_MARKERS; m++)
+    {
+        n[m]++;
+    }
+
+    // Desired marker positions grow linearly with the count, so they are
+    // derived rather than accumulated (a float sum drifts after ~10^6 events)
+    const double increments[ANALYTICS_MARKERS] = {0, p / 2.0, p, (1 + p) / 2.0, 1};
+
+    // Move the middle markers towards their desired positions
+    for (int m = 1; m < ANALYTICS_MARKERS - 1; m++)
+    {
+        float d = (quantile.count - 1) * increments[m] - n[m];
+        if ((d >= 1 && n[m + 1] - n[m] > 1) || (d <= -1 && n[m - 1] - n[m] < -1))
+        {
+            int s = d > 0 ? 1 : -1;
+            float parabolic = q[m] + (float)s / (n[m + 1] - n[m - 1]) *
+                                         ((n[m] - n[m - 1] + s) * (q[m + 1] - q[m]) / (n[m + 1] - n[m]) +
+                                          (n[m + 1] - n[m] - s) * (q[m] - q[m - 1]) / (n[m] - n[m - 1]));
+            if (q[m - 1] < parabolic && parabolic < q[m + 1])
+            {
+                q[m] = parabolic;
+            }
+            else
+            {
+                q[m] = q[m] + s * (q[m + s] - q[m]) / (n[m + s] - n[m]);
+            }
+            n[m] += s;
+        }
+    }
+}
+
+float DoorAnalytics::quantile_value(const p2_quantile &quantile)
+{
+    if (quantile.count == 0)
+    {
+        return 0;
+    }
+    if (quantile.count < ANALYTICS_MARKERS)
+    {
+        // Nearest rank over the sorted observations
+        int rank = (int)ceilf(quantile.probability * quantile.count) - 1;
+        return quantile.heights[max(rank, 0)];
+    }
+    return quantile.heights[2];
+}
@@ -0,0 +1,80 @@
+#ifndef DOOR_ANALYTICS_H
+#define DOOR_ANALYTICS_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+
+// #define DOOR_ANALYTICS_DEBUG 1
+
+// Bumped whenever door_analytics_state changes layout; older checkpoints are discarded
+#define ANALYTICS_STATE_VERSION 1
+#define ANALYTICS_HOURS 24
+#define ANALYTICS_MARKERS 5
+
+// Fixed-size P-square (Jain & Chlamtac) estimate of a single quantile
+typedef struct
+{
+    float probability;
+    uint32_t count;
+    float heights[ANALYTICS_MARKERS];
+    int32_t positions[ANALYTICS_MARKERS];
+} p2_quantile;
+
+// Everything needed to resume after a restart, written to NVS as one blob
+typedef struct
+{
+    uint32_t version;
+    uint32_t opens;
+    uint32_t overnight_opens;
+    uint32_t max_open_ms;
+    uint64_t total_open_ms;
+    uint32_t opens_by_hour[ANALYTICS_HOURS];
+    p2_quantile p50;
+    p2_quantile p95;
+    p2_quantile p99;
+} door_analytics_state;
+
+// Door usage statistics updated in constant time and memory per transition.
+// Open durations are measured with millis() so they do not depend on NTP; the
+// hour-of-day figures only use events with a wall-clock timestamp.
+class DoorAnalytics
+{
+public:
+    DoorAnalytics(uint8_t overnight_start_hour, uint8_t overnight_end_hour, unsigned long checkpoint_interval);
+    void begin(Preferences &preferences, const char *key);
+    // timestamp is 0 when the wall clock is not known
+    void opened(uint32_t timestamp);
+    void closed(uint32_t timestamp);
+    // Writes a checkpoint when there are unsaved changes and the interval has passed
+    void tick();
+    bool checkpoint();
+    const door_analytics_state &state();
+    float open_duration_quantile(float probability);
+    float opens_per_hour();
+    bool is_open();
+
+private:
+    bool overnight(uint32_t opened_at, uint32_t duration_s);
+    static void quantile_init(p2_quantile &quantile, float probability);
+    static void quantile_add(p2_quantile &quantile, float value);
+    static float quantile_value(const p2_quantile &quantile);
+
+    uint8_t overnight_start_hour;
+    uint8_t overnight_end_hour;
+    unsigned long checkpoint_interval;
+    Preferences *preferences;
+    const char *key;
+    door_analytics_state current;
+    bool dirty;
+    unsigned long last_checkpoint;
+
+    bool open;
+    unsigned long opened_millis;
+    uint32_t opened_timestamp;
+
+    // Opens in each of the last ANALYTICS_HOURS hours of uptime
+    uint16_t recent_opens[ANALYTICS_HOURS];
+    uint32_t recent_hour[ANALYTICS_HOURS];
+};
+#endif
@@ -0,0 +1,46 @@
+#include "DoorMonitor.h"
+
+DoorMonitor::DoorMonitor(uint8_t pin, unsigned long check_interval)
+{
+    this->pin = pin;
+    this->check_interval = check_interval;
+    this->current_state = LOW;
+    this->last_read = 0;
+}
+
+void DoorMonitor::begin()
+{
+    this->current_state = digitalRead(this->pin);
+}
+
+bool DoorMonitor::due()
+{
+    return millis() - this->last_read > this->check_interval;
+}
+
+door_transition DoorMonitor::read()
+{
+    int last_state = this->current_state;
+    this->current_state = digitalRead(this->pin);
+    this->last_read = millis();
+
+    if (last_state == LOW && this->current_state == HIGH)
+    {
+        return DOOR_TRANSITION_OPENED;
+    }
+    if (last_state == HIGH && this->current_state == LOW)
+    {
+        return DOOR_TRANSITION_CLOSED;
+    }
+    return DOOR_TRANSITION_NONE;
+}
+
+int DoorMonitor::state()
+{
+    return this->current_state;
+}
+
+unsigned long DoorMonitor::last_check()
+{
+    return this->last_read;
+}
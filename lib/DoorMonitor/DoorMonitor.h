@@ -0,0 +1,37 @@
+#ifndef DOOR_MONITOR_H
+#define DOOR_MONITOR_H
+
+#include <Arduino.h>
+
+typedef enum
+{
+    DOOR_TRANSITION_NONE = 0,
+    DOOR_TRANSITION_OPENED = 1,
+    DOOR_TRANSITION_CLOSED = 2,
+} door_transition;
+
+// Polls the reed switch, HIGH while the door is open, and reports the
+// transitions between reads. Simulated events never go through here, so a
+// /test running alongside cannot hide or fake a real one.
+class DoorMonitor
+{
+public:
+    DoorMonitor(uint8_t pin, unsigned long check_interval);
+    // Takes the current level as the starting state
+    void begin();
+    // Whether the check interval has passed since the last read
+    bool due();
+    // Reads the door and reports how it changed since the last read
+    door_transition read();
+    // Level seen by the last read
+    int state();
+    // millis() of the last read; 0 before the first
+    unsigned long last_check();
+
+private:
+    uint8_t pin;
+    unsigned long check_interval;
+    int current_state;
+    unsigned long last_read;
+};
+#endif
@@ -0,0 +1,72 @@
+#include "DoorSimulation.h"
+
+DoorSimulation::DoorSimulation(simulated_event_handler event, std::function<void()> rearm, simulation_reply_handler reply)
+{
+    this->event = event;
+    this->rearm = rearm;
+    this->reply = reply;
+    this->owner = NULL;
+}
+
+bool DoorSimulation::claim(CommandSession &session)
+{
+    if (this->owner != NULL && this->owner != &session)
+    {
+        this->reply(session.chat_id, DOOR_SIMULATION_BUSY_MSG);
+        return false;
+    }
+    this->owner = &session;
+    return true;
+}
+
+void DoorSimulation::release(CommandSession &session)
+{
+    if (this->owner == &session)
+    {
+        this->owner = NULL;
+    }
+}
+
+bool DoorSimulation::running()
+{
+    return this->owner != NULL;
+}
+
+void DoorSimulation::opened()
+{
+    this->event(true);
+}
+
+void DoorSimulation::closed()
+{
+    this->event(false);
+}
+
+void DoorSimulation::test_command(CommandSession &session)
+{
+    switch (session.step)
+    {
+    case 0:
+        if (!this->claim(session))
+        {
+            break;
+        }
+        this->reply(session.chat_id, "Starting test in " + (String)(DOOR_SIMULATION_START_DELAY / 1000) + " seconds...");
+        session.sleep(DOOR_SIMULATION_START_DELAY, 1);
+        break;
+    case 1:
+        this->opened();
+        this->reply(session.chat_id, "Awaiting " + (String)(DOOR_SIMULATION_OPEN_DURATION / 1000) + " seconds before triggering a close event...");
+        session.sleep(DOOR_SIMULATION_OPEN_DURATION, 2);
+        break;
+    case 2:
+        this->closed();
+        this->reply(session.chat_id, "Test complete! Re-arming the device in " + (String)(DOOR_SIMULATION_REARM_DELAY / 1000) + " seconds...");
+        session.sleep(DOOR_SIMULATION_REARM_DELAY, 3);
+        break;
+    case 3:
+        this->rearm();
+        this->release(session);
+        break;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef DOOR_SIMULATION_H
+#define DOOR_SIMULATION_H
+
+#include <Arduino.h>
+#include <functional>
+#include "../CommandEngine/CommandEngine.h"
+
+// /test waits this long before the open, keeps the door "open" for
+// DOOR_SIMULATION_OPEN_DURATION and re-arms DOOR_SIMULATION_REARM_DELAY after the close
+const unsigned long DOOR_SIMULATION_START_DELAY = 3 * 1000;
+const unsigned long DOOR_SIMULATION_OPEN_DURATION = 30 * 1000;
+const unsigned long DOOR_SIMULATION_REARM_DELAY = 3 * 1000;
+
+#define DOOR_SIMULATION_BUSY_MSG "Another test is running - Try again once it is done."
+
+typedef std::function<void(bool opened)> simulated_event_handler;
+typedef std::function<void(const String &chat_id, const String &text)> simulation_reply_handler;
+
+// Simulated door events for /test and /burst. Simulations share one alert
+// state, so only one runs at a time: a second one would resolve the first
+// one's incident and re-arm the LEDs underneath it. Another session asking
+// meanwhile is told to wait.
+class DoorSimulation
+{
+public:
+    DoorSimulation(simulated_event_handler event, std::function<void()> rearm, simulation_reply_handler reply);
+    // Claims the simulation for session; false, after telling its chat, while
+    // another session holds it
+    bool claim(CommandSession &session);
+    void release(CommandSession &session);
+    bool running();
+    void opened();
+    void closed();
+    // /test: an open, a close DOOR_SIMULATION_OPEN_DURATION later, then re-arming
+    void test_command(CommandSession &session);
+
+private:
+    simulated_event_handler event;
+    std::function<void()> rearm;
+    simulation_reply_handler reply;
+    const CommandSession *owner;
+};
+#endif
@@ -0,0 +1,292 @@
+#include "EventHistory.h"
+
+#define HISTORY_READ_BATCH 32
+
+EventHistory::EventHistory(const char *partition_label)
+{
+    this->partition_label = partition_label;
+    this->partition = NULL;
+    this->sectors = 0;
+    this->records_per_sector = HISTORY_SECTOR_SIZE / sizeof(history_record);
+    this->head_sector = 0;
+    this->head_slot = 0;
+    this->next_sequence = 0;
+    this->last_timestamp = 0;
+    memset(&this->event_stats, 0, sizeof(this->event_stats));
+}
+
+bool EventHistory::begin()
+{
+    this->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, this->partition_label);
+    if (this->partition == NULL)
+    {
+#ifdef EVENT_HISTORY_DEBUG
+        Serial.printf("EventHistory: partition '%s' not found\n", this->partition_label);
+#endif
+        return false;
+    }
+
+    this->sectors = this->partition->size / HISTORY_SECTOR_SIZE;
+    this->index.assign(this->sectors, {HISTORY_EMPTY_SEQUENCE, 0});
+
+    // Rebuild the sparse index from the first valid record of every sector
+    bool found = false;
+    for (uint32_t sector = 0; sector < this->sectors; sector++)
+    {
+        history_record record;
+        if (this->first_record(sector, record))
+        {
+            this->index[sector] = {record.sequence, record.timestamp};
+            if (!found || record.sequence > this->index[this->head_sector].sequence)
+            {
+                this->head_sector = sector;
+                found = true;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        this->head_sector = 0;
+        this->head_slot = 0;
+        return true;
+    }
+
+    // Resume after the last record in the head sector. Only a fully erased
+    // slot can be written, so a torn record left by a power cut is skipped.
+    this->head_slot = this->records_per_sector;
+    for (uint32_t slot = 0; slot < this->records_per_sector; slot++)
+    {
+        history_record record;
+        if (!this->read_record(this->head_sector, slot, record))
+        {
+            return false;
+        }
+        if (this->valid(record))
+        {
+            this->next_sequence = record.sequence + 1;
+            this->last_timestamp = record.timestamp;
+            continue;
+        }
+
+        const uint8_t *bytes = (const uint8_t *)&record;
+        bool erased = true;
+        for (size_t i = 0; i < sizeof(record); i++)
+        {
+            erased = erased && bytes[i] == 0xFF;
+        }
+        if (erased)
+        {
+            this->head_slot = slot;
+            break;
+        }
+    }
+
+#ifdef EVENT_HISTORY_DEBUG
+    Serial.printf("EventHistory: %u records, head at sector %u slot %u\n", this->size(), this->head_sector, this->head_slot);
+#endif
+    return true;
+}
+
+bool EventHistory::append(history_event_type type, uint32_t timestamp, uint8_t flags)
+{
+    if (this->partition == NULL)
+    {
+        return false;
+    }
+
+    unsigned long started = micros();
+
+    if (this->head_slot >= this->records_per_sector)
+    {
+        this->head_sector = (this->head_sector + 1) % this->sectors;
+        this->head_slot = 0;
+    }
+
+    if (this->head_slot == 0)
+    {
+        // Starting a sector drops the oldest one once the log has wrapped
+        if (esp_partition_erase_range(this->partition, this->head_sector * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE) != ESP_OK)
+        {
+            return false;
+        }
+        this->index[this->head_sector] = {HISTORY_EMPTY_SEQUENCE, 0};
+        this->event_stats.sector_erases++;
+    }
+
+    // Keep the log ordered even if the clock steps backwards (or is not
+    // synced yet), so the index stays searchable
+    history_record record;
+    record.timestamp = max(timestamp, this->last_timestamp);
+    record.sequence = this->next_sequence;
+    record.type = type;
+    record.flags = flags;
+    record.reserved = 0xFFFF;
+    record.crc = crc32_le(0, (const uint8_t *)&record, offsetof(history_record, crc));
+
+    size_t offset = this->head_sector * HISTORY_SECTOR_SIZE + this->head_slot * sizeof(history_record);
+    if (esp_partition_write(this->partition, offset, &record, sizeof(record)) != ESP_OK)
+    {
+        // The slot may be partially written; never reuse it
+        this->head_slot++;
+        return false;
+    }
+
+    // Normally slot 0, but a failed write there leaves the next record first
+    if (this->index[this->head_sector].sequence == HISTORY_EMPTY_SEQUENCE)
+    {
+        this->index[this->head_sector] = {record.sequence, record.timestamp};
+    }
+    this->head_slot++;
+    this->next_sequence++;
+    this->last_timestamp = record.timestamp;
+
+    unsigned long duration = micros() - started;
+    this->event_stats.appends++;
+    this->event_stats.total_append_us += duration;
+    this->event_stats.max_append_us = max(this->event_stats.max_append_us, duration);
+    return true;
+}
+
+size_t EventHistory::query(uint32_t from, uint32_t to, std::function<bool(const history_record &)> callback)
+{
+    if (this->partition == NULL || this->index[this->newest_sector()].sequence == HISTORY_EMPTY_SEQUENCE)
+    {
+        return 0;
+    }
+
+    uint32_t oldest = this->oldest_sector();
+    uint32_t count = (this->newest_sector() + this->sectors - oldest) % this->sectors + 1;
+
+    // Binary search the sparse index for the last sector starting before
+    // `from`; records equal to `from` can still sit at the end of that sector
+    // when the next one starts exactly at `from`
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (this->index[(oldest + middle) % this->sectors].timestamp < from)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    size_t scanned = 0;
+    history_record batch[HISTORY_READ_BATCH];
+    for (uint32_t i = low; i < count; i++)
+    {
+        uint32_t sector = (oldest + i) % this->sectors;
+        uint32_t slots = (sector == this->head_sector) ? this->head_slot : this->records_per_sector;
+
+        for (uint32_t slot = 0; slot < slots; slot += HISTORY_READ_BATCH)
+        {
+            uint32_t length = min((uint32_t)HISTORY_READ_BATCH, slots - slot);
+            size_t offset = sector * HISTORY_SECTOR_SIZE + slot * sizeof(history_record);
+            if (esp_partition_read(this->partition, offset, batch, length * sizeof(history_record)) != ESP_OK)
+            {
+                return scanned;
+            }
+
+            for (uint32_t j = 0; j < length; j++)
+            {
+                if (!this->valid(batch[j]))
+                {
+                    continue;
+                }
+                scanned++;
+                if (batch[j].timestamp < from)
+                {
+                    continue;
+                }
+                if (batch[j].timestamp > to || !callback(batch[j]))
+                {
+                    return scanned;
+                }
+            }
+        }
+    }
+    return scanned;
+}
+
+uint32_t EventHistory::size()
+{
+    if (this->partition == NULL || this->index[this->newest_sector()].sequence == HISTORY_EMPTY_SEQUENCE)
+    {
+        return 0;
+    }
+    uint32_t oldest = this->oldest_sector();
+    return this->next_sequence - this->index[oldest].sequence;
+}
+
+uint32_t EventHistory::capacity()
+{
+    return this->sectors * this->records_per_sector;
+}
+
+const history_stats &EventHistory::stats()
+{
+    return this->event_stats;
+}
+
+bool EventHistory::read_record(uint32_t sector, uint32_t slot, history_record &record)
+{
+    size_t offset = sector * HISTORY_SECTOR_SIZE + slot * sizeof(history_record);
+    return esp_partition_read(this->partition, offset, &record, sizeof(record)) == ESP_OK;
+}
+
+// Slot 0 unless writing it failed or was torn by a power cut
+bool EventHistory::first_record(uint32_t sector, history_record &record)
+{
+    if (this->read_record(sector, 0, record) && this->valid(record))
+    {
+        return true;
+    }
+
+    history_record batch[HISTORY_READ_BATCH];
+    for (uint32_t slot = 0; slot < this->records_per_sector; slot += HISTORY_READ_BATCH)
+    {
+        uint32_t length = min((uint32_t)HISTORY_READ_BATCH, this->records_per_sector - slot);
+        size_t offset = sector * HISTORY_SECTOR_SIZE + slot * sizeof(history_record);
+        if (esp_partition_read(this->partition, offset, batch, length * sizeof(history_record)) != ESP_OK)
+        {
+            return false;
+        }
+        for (uint32_t j = 0; j < length; j++)
+        {
+            if (this->valid(batch[j]))
+            {
+                record = batch[j];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool EventHistory::valid(const history_record &record)
+{
+    return record.sequence != HISTORY_EMPTY_SEQUENCE &&
+           record.crc == crc32_le(0, (const uint8_t *)&record, offsetof(history_record, crc));
+}
+
+// The head sector, unless nothing has been written to it successfully yet
+uint32_t EventHistory::newest_sector()
+{
+    if (this->index[this->head_sector].sequence != HISTORY_EMPTY_SEQUENCE)
+    {
+        return this->head_sector;
+    }
+    return (this->head_sector + this->sectors - 1) % this->sectors;
+}
+
+uint32_t EventHistory::oldest_sector()
+{
+    // Sectors fill in order, so until the log wraps the oldest is sector 0
+    uint32_t next = (this->head_sector + 1) % this->sectors;
+    return this->index[next].sequence != HISTORY_EMPTY_SEQUENCE ? next : 0;
+}
@@ -0,0 +1,80 @@
+#ifndef EVENT_HISTORY_H
+#define EVENT_HISTORY_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include <esp_partition.h>
+#include "esp32/rom/crc.h"
+
+// #define EVENT_HISTORY_DEBUG 1
+
+#define HISTORY_SECTOR_SIZE 4096
+#define HISTORY_EMPTY_SEQUENCE 0xFFFFFFFF
+
+#define HISTORY_FLAG_TIME_SYNCED 0x01
+
+typedef enum
+{
+    HISTORY_DOOR_OPENED = 1,
+    HISTORY_DOOR_CLOSED = 2,
+} history_event_type;
+
+// Fixed-size record; HISTORY_SECTOR_SIZE / sizeof(history_record) per sector
+typedef struct __attribute__((packed))
+{
+    uint32_t timestamp;
+    uint32_t sequence;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t crc;
+} history_record;
+
+typedef struct
+{
+    unsigned long appends;
+    unsigned long sector_erases;
+    unsigned long total_append_us;
+    unsigned long max_append_us;
+} history_stats;
+
+// Circular log of door events on a raw data partition. Records are appended
+// in time order; the first record of every sector is kept in RAM as a sparse
+// index so range queries only read the sectors that overlap the range.
+class EventHistory
+{
+public:
+    EventHistory(const char *partition_label);
+    bool begin();
+    bool append(history_event_type type, uint32_t timestamp, uint8_t flags);
+    size_t query(uint32_t from, uint32_t to, std::function<bool(const history_record &)> callback);
+    uint32_t size();
+    uint32_t capacity();
+    const history_stats &stats();
+
+private:
+    typedef struct
+    {
+        uint32_t sequence;
+        uint32_t timestamp;
+    } sector_index;
+
+    bool read_record(uint32_t sector, uint32_t slot, history_record &record);
+    bool first_record(uint32_t sector, history_record &record);
+    bool valid(const history_record &record);
+    uint32_t newest_sector();
+    uint32_t oldest_sector();
+
+    const char *partition_label;
+    const esp_partition_t *partition;
+    std::vector<sector_index> index;
+    uint32_t sectors;
+    uint32_t records_per_sector;
+    uint32_t head_sector;
+    uint32_t head_slot;
+    uint32_t next_sequence;
+    uint32_t last_timestamp;
+    history_stats event_stats;
+};
+#endif
@@ -0,0 +1,453 @@
+#include "Fleet.h"
+
+#define FLEET_MAX_BODY_SIZE (sizeof(fleet_digest) > sizeof(fleet_claim) ? sizeof(fleet_digest) : sizeof(fleet_claim))
+#define FLEET_MAX_PACKET_SIZE (sizeof(fleet_header) + FLEET_MAX_BODY_SIZE + FLEET_TAG_SIZE)
+
+Fleet::Fleet(const char *group, const char *secret, const char *name, const char *zone, const char *address, uint16_t port,
+             unsigned long heartbeat_interval, unsigned long election_window, unsigned long claim_ttl)
+{
+    this->group = crc32_le(0, (const uint8_t *)group, strlen(group));
+    this->secret = secret;
+    this->address_text = address;
+    this->port = port;
+    this->base_heartbeat_interval = heartbeat_interval;
+    this->election_window = election_window;
+    this->claim_ttl = claim_ttl;
+
+    this->started = false;
+    this->id = 0;
+    this->boot = 0;
+    this->sequence = 0;
+    this->digest_changed = true;
+    this->last_heartbeat = 0;
+    this->next_heartbeat_delay = 0;
+    this->nodes_len = 0;
+    this->claims_next = 0;
+    memset(this->claims, 0, sizeof(this->claims));
+    memset(this->peers, 0, sizeof(this->peers));
+    memset(&this->counters, 0, sizeof(this->counters));
+
+    memset(&this->digest, 0, sizeof(this->digest));
+    strncpy(this->digest.name, name, FLEET_NAME_SIZE - 1);
+    strncpy(this->digest.zone, zone, FLEET_ZONE_SIZE - 1);
+}
+
+bool Fleet::begin()
+{
+    // Derived from the factory MAC so it is stable across restarts
+    uint64_t mac = ESP.getEfuseMac();
+    this->id = max(crc32_le(0, (const uint8_t *)&mac, 6), (uint32_t)1);
+    if (this->boot == 0)
+    {
+        this->boot = esp_random();
+    }
+
+    if (!this->address.fromString(this->address_text) || !this->udp.beginMulticast(this->address, this->port))
+    {
+#ifdef FLEET_DEBUG
+        Serial.println(F("Fleet: unable to join multicast group"));
+#endif
+        return false;
+    }
+    this->started = true;
+#ifdef FLEET_DEBUG
+    Serial.printf("Fleet: node %08x joined %s:%u\n", this->id, this->address_text, this->port);
+#endif
+    return true;
+}
+
+bool Fleet::rejoin()
+{
+    this->udp.stop();
+    this->started = false;
+    return this->begin();
+}
+
+void Fleet::set_state(bool door_open, uint32_t open_events)
+{
+    if (this->digest.door_open != door_open || this->digest.open_events != open_events)
+    {
+        this->digest.door_open = door_open;
+        this->digest.open_events = open_events;
+        this->digest_changed = true;
+    }
+}
+
+void Fleet::tick()
+{
+    if (!this->started)
+    {
+        return;
+    }
+
+    this->receive();
+    this->expire_nodes();
+
+    unsigned long since_heartbeat = millis() - this->last_heartbeat;
+    if ((this->digest_changed && since_heartbeat >= FLEET_MIN_HEARTBEAT_SPACING) ||
+        since_heartbeat >= this->next_heartbeat_delay)
+    {
+        this->send_heartbeat();
+    }
+}
+
+bool Fleet::elect(fleet_alert_type alert)
+{
+    if (!this->started)
+    {
+        return true;
+    }
+
+    this->receive();
+    unsigned long started = millis();
+
+    // A node that saw the event first is already notifying
+    for (size_t i = 0; i < FLEET_CLAIM_HISTORY; i++)
+    {
+        const claim_record &claim = this->claims[i];
+        if (claim.node_id != 0 && claim.alert == alert && started - claim.received < this->claim_ttl)
+        {
+            this->counters.elections_lost++;
+            return false;
+        }
+    }
+
+    // Claimed even when alone, so a node joining the zone late backs off
+    this->send_claim(alert);
+    if (!this->zone_has_peers())
+    {
+        this->counters.elections_won++;
+        return true;
+    }
+
+    int repeats = 1;
+    while (millis() - started < this->election_window)
+    {
+        if (repeats < FLEET_CLAIM_REPEATS && millis() - started >= this->election_window * repeats / FLEET_CLAIM_REPEATS)
+        {
+            this->send_claim(alert);
+            repeats++;
+        }
+        delay(10);
+        this->receive();
+    }
+
+    // Concurrent claims: the lowest node id notifies
+    for (size_t i = 0; i < FLEET_CLAIM_HISTORY; i++)
+    {
+        const claim_record &claim = this->claims[i];
+        if (claim.node_id != 0 && claim.alert == alert && claim.received - started < this->election_window &&
+            claim.node_id < this->id)
+        {
+            this->counters.elections_lost++;
+            return false;
+        }
+    }
+    this->counters.elections_won++;
+    return true;
+}
+
+void Fleet::receive()
+{
+    uint8_t buffer[FLEET_MAX_PACKET_SIZE];
+
+    int size;
+    while ((size = this->udp.parsePacket()) > 0)
+    {
+        this->counters.bytes_received += size;
+        if ((size_t)size > sizeof(buffer) || (size_t)size < sizeof(fleet_header) + FLEET_TAG_SIZE)
+        {
+            this->udp.flush();
+            this->counters.rejected++;
+            continue;
+        }
+        this->udp.read(buffer, size);
+
+        fleet_header header;
+        memcpy(&header, buffer, sizeof(header));
+        if (memcmp(header.magic, FLEET_MAGIC, sizeof(header.magic)) != 0 || header.version != FLEET_VERSION ||
+            header.group != this->group)
+        {
+            this->counters.rejected++;
+            continue;
+        }
+        if (header.node_id == this->id)
+        {
+            // Our own datagram looped back
+            continue;
+        }
+        if (!this->authentic(buffer, size))
+        {
+            this->counters.rejected++;
+            continue;
+        }
+        if (!this->fresh(header))
+        {
+            this->counters.replayed++;
+            continue;
+        }
+        this->counters.received++;
+
+        size_t body_length = size - sizeof(header) - FLEET_TAG_SIZE;
+        if (header.type == FLEET_HEARTBEAT && body_length == sizeof(fleet_digest))
+        {
+            fleet_digest digest;
+            memcpy(&digest, buffer + sizeof(header), sizeof(digest));
+            this->handle_heartbeat(header, digest);
+        }
+        else if (header.type == FLEET_CLAIM && body_length == sizeof(fleet_claim))
+        {
+            fleet_claim claim;
+            memcpy(&claim, buffer + sizeof(header), sizeof(claim));
+            this->handle_claim(header, claim);
+        }
+        else
+        {
+            this->counters.rejected++;
+        }
+    }
+}
+
+void Fleet::sign(const uint8_t *data, size_t length, uint8_t *tag)
+{
+    uint8_t hmac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)this->secret, strlen(this->secret),
+                    data, length, hmac);
+    memcpy(tag, hmac, FLEET_TAG_SIZE);
+}
+
+// Checks the tag at the end of a datagram without leaking where it differs
+bool Fleet::authentic(const uint8_t *data, size_t length)
+{
+    uint8_t expected[FLEET_TAG_SIZE];
+    this->sign(data, length - FLEET_TAG_SIZE, expected);
+
+    uint8_t difference = 0;
+    for (size_t i = 0; i < FLEET_TAG_SIZE; i++)
+    {
+        difference |= expected[i] ^ data[length - FLEET_TAG_SIZE + i];
+    }
+    return difference == 0;
+}
+
+// Rejects a datagram that is stale or was already accepted, and remembers it
+// as the newest from its node otherwise
+bool Fleet::fresh(const fleet_header &header)
+{
+    uint32_t now = time(nullptr);
+    if (now >= FLEET_MIN_TIMESTAMP && header.timestamp >= FLEET_MIN_TIMESTAMP &&
+        (header.timestamp > now ? header.timestamp - now : now - header.timestamp) > FLEET_MAX_CLOCK_SKEW)
+    {
+        return false;
+    }
+
+    // Known node, or else a free slot or the one heard from longest ago
+    unsigned long received = millis();
+    peer_record *peer = NULL;
+    peer_record *oldest = &this->peers[0];
+    for (size_t i = 0; i < FLEET_MAX_NODES; i++)
+    {
+        if (this->peers[i].node_id == header.node_id)
+        {
+            peer = &this->peers[i];
+            break;
+        }
+        if (oldest->node_id != 0 &&
+            (this->peers[i].node_id == 0 || received - this->peers[i].received > received - oldest->received))
+        {
+            oldest = &this->peers[i];
+        }
+    }
+
+    if (peer != NULL)
+    {
+        if (header.boot == peer->boot)
+        {
+            // Wrap-safe, like millis() comparisons
+            if ((int32_t)(header.sequence - peer->sequence) <= 0)
+            {
+                return false;
+            }
+        }
+        else if (header.timestamp < peer->timestamp)
+        {
+            // A restart is newer than anything from the previous boot; only
+            // decidable once the sender's clock is synced
+            return false;
+        }
+    }
+    else
+    {
+        peer = oldest;
+    }
+
+    peer->node_id = header.node_id;
+    peer->boot = header.boot;
+    peer->sequence = header.sequence;
+    peer->timestamp = header.timestamp;
+    peer->received = received;
+    return true;
+}
+
+void Fleet::handle_heartbeat(const fleet_header &header, const fleet_digest &digest)
+{
+    fleet_node *node = NULL;
+    for (size_t i = 0; i < this->nodes_len; i++)
+    {
+        if (this->nodes[i].node_id == header.node_id)
+        {
+            node = &this->nodes[i];
+            break;
+        }
+    }
+    if (node == NULL)
+    {
+        if (this->nodes_len == FLEET_MAX_NODES)
+        {
+            this->counters.rejected++;
+            return;
+        }
+        node = &this->nodes[this->nodes_len++];
+        node->node_id = header.node_id;
+#ifdef FLEET_DEBUG
+        Serial.printf("Fleet: node %08x joined\n", header.node_id);
+#endif
+    }
+
+    node->address = this->udp.remoteIP();
+    node->last_seen = millis();
+    node->digest = digest;
+    node->digest.name[FLEET_NAME_SIZE - 1] = '\0';
+    node->digest.zone[FLEET_ZONE_SIZE - 1] = '\0';
+    if (node->digest.heartbeat_interval_s == 0)
+    {
+        node->digest.heartbeat_interval_s = 1;
+    }
+}
+
+void Fleet::handle_claim(const fleet_header &header, const fleet_claim &claim)
+{
+    if (strncmp(claim.zone, this->digest.zone, FLEET_ZONE_SIZE) != 0)
+    {
+        return;
+    }
+
+    claim_record &record = this->claims[this->claims_next];
+    record.node_id = header.node_id;
+    record.alert = claim.alert;
+    record.received = millis();
+    this->claims_next = (this->claims_next + 1) % FLEET_CLAIM_HISTORY;
+}
+
+bool Fleet::send(fleet_packet_type type, const void *body, size_t length)
+{
+    uint32_t now = time(nullptr);
+    fleet_header header;
+    memcpy(header.magic, FLEET_MAGIC, sizeof(header.magic));
+    header.version = FLEET_VERSION;
+    header.type = type;
+    header.reserved = 0;
+    header.group = this->group;
+    header.node_id = this->id;
+    header.boot = this->boot;
+    header.sequence = this->sequence++;
+    header.timestamp = now >= FLEET_MIN_TIMESTAMP ? now : 0;
+
+    uint8_t packet[FLEET_MAX_PACKET_SIZE];
+    size_t size = sizeof(header) + length;
+    memcpy(packet, &header, sizeof(header));
+    memcpy(packet + sizeof(header), body, length);
+    this->sign(packet, size, packet + size);
+    size += FLEET_TAG_SIZE;
+
+    if (!this->udp.beginPacket(this->address, this->port))
+    {
+        return false;
+    }
+    this->udp.write(packet, size);
+    if (!this->udp.endPacket())
+    {
+        return false;
+    }
+    this->counters.sent++;
+    this->counters.bytes_sent += size;
+    return true;
+}
+
+void Fleet::send_heartbeat()
+{
+    unsigned long interval = this->heartbeat_interval();
+    this->digest.uptime_s = millis() / 1000;
+    this->digest.heartbeat_interval_s = interval / 1000;
+    this->send(FLEET_HEARTBEAT, &this->digest, sizeof(this->digest));
+
+    this->digest_changed = false;
+    this->last_heartbeat = millis();
+    // Jitter keeps nodes that started together from staying in lock step
+    this->next_heartbeat_delay = interval - esp_random() % (interval / 10 + 1);
+}
+
+void Fleet::send_claim(fleet_alert_type alert)
+{
+    fleet_claim claim;
+    memset(&claim, 0, sizeof(claim));
+    strncpy(claim.zone, this->digest.zone, FLEET_ZONE_SIZE);
+    claim.alert = alert;
+    this->send(FLEET_CLAIM, &claim, sizeof(claim));
+}
+
+void Fleet::expire_nodes()
+{
+    for (size_t i = 0; i < this->nodes_len;)
+    {
+        const fleet_node &node = this->nodes[i];
+        if (millis() - node.last_seen > FLEET_NODE_TIMEOUT_FACTOR * node.digest.heartbeat_interval_s * 1000UL)
+        {
+#ifdef FLEET_DEBUG
+            Serial.printf("Fleet: node %08x left\n", node.node_id);
+#endif
+            this->nodes[i] = this->nodes[--this->nodes_len];
+            continue;
+        }
+        i++;
+    }
+}
+
+bool Fleet::zone_has_peers()
+{
+    for (size_t i = 0; i < this->nodes_len; i++)
+    {
+        if (strncmp(this->nodes[i].digest.zone, this->digest.zone, FLEET_ZONE_SIZE) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t Fleet::node_count()
+{
+    return this->nodes_len;
+}
+
+const fleet_node &Fleet::node(size_t index)
+{
+    return this->nodes[index];
+}
+
+uint32_t Fleet::node_id()
+{
+    return this->id;
+}
+
+unsigned long Fleet::heartbeat_interval()
+{
+    // Spread the fleet's heartbeats so their total rate stays bounded
+    unsigned long fleet_size = this->nodes_len + 1;
+    return max(this->base_heartbeat_interval, fleet_size * 1000 / FLEET_MAX_PACKETS_PER_SECOND);
+}
+
+const fleet_stats &Fleet::stats()
+{
+    return this->counters;
+}
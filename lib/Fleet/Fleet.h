@@ -0,0 +1,191 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "esp32/rom/crc.h"
+#include "mbedtls/md.h"
+
+// #define FLEET_DEBUG 1
+
+// Datagram layout (all integers little-endian), see tools/fleet_sim.py:
+//
+//   fleet_header | fleet_digest | tag   (FLEET_HEARTBEAT)
+//   fleet_header | fleet_claim | tag    (FLEET_CLAIM)
+//
+// tag is the HMAC-SHA256 of everything before it under the group secret,
+// truncated to FLEET_TAG_SIZE bytes. A datagram is only accepted when it is
+// newer than the last one from the same node (boot, then sequence) and, once
+// both clocks are synced, its timestamp is within FLEET_MAX_CLOCK_SKEW.
+//
+// Every node multicasts a heartbeat carrying a digest of its state, so any
+// node can report on the whole fleet. Before alerting, a node claims the
+// alert for its zone; of the nodes claiming within the election window the
+// lowest node id notifies, and a claim already seen from another node means
+// the alert is being handled.
+#define FLEET_MAGIC "GDFL"
+#define FLEET_VERSION 2
+#define FLEET_TAG_SIZE 16
+// Seconds a signed timestamp may be off before the datagram counts as stale
+#define FLEET_MAX_CLOCK_SKEW 30
+// Timestamps before 2021 mean the sender's clock is not synced yet
+#define FLEET_MIN_TIMESTAMP 1609459200
+
+#define FLEET_MAX_NODES 32
+#define FLEET_NAME_SIZE 24
+#define FLEET_ZONE_SIZE 16
+#define FLEET_CLAIM_HISTORY 16
+// Heartbeats of the whole fleet are spread out to stay under this rate, so
+// bandwidth stays bounded however many nodes join
+#define FLEET_MAX_PACKETS_PER_SECOND 4
+// A node is dropped after missing this many of its heartbeats
+#define FLEET_NODE_TIMEOUT_FACTOR 3
+// Earliest follow-up heartbeat after a state change
+#define FLEET_MIN_HEARTBEAT_SPACING 1000
+// Claims are sent twice, in case one is lost
+#define FLEET_CLAIM_REPEATS 2
+
+typedef enum
+{
+    FLEET_HEARTBEAT = 1,
+    FLEET_CLAIM = 2,
+} fleet_packet_type;
+
+typedef enum
+{
+    FLEET_ALERT_OPENED = 1,
+    FLEET_ALERT_CLOSED = 2,
+} fleet_alert_type;
+
+typedef struct __attribute__((packed))
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t type;
+    uint16_t reserved;
+    uint32_t group;
+    uint32_t node_id;
+    // Picked at random on every boot, since sequence starts over
+    uint32_t boot;
+    uint32_t sequence;
+    // Unix time of sending, 0 while the sender's clock is not synced
+    uint32_t timestamp;
+} fleet_header;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t uptime_s;
+    uint32_t open_events;
+    uint16_t heartbeat_interval_s;
+    uint8_t door_open;
+    uint8_t reserved;
+    char name[FLEET_NAME_SIZE];
+    char zone[FLEET_ZONE_SIZE];
+} fleet_digest;
+
+typedef struct __attribute__((packed))
+{
+    char zone[FLEET_ZONE_SIZE];
+    uint8_t alert;
+    uint8_t reserved[3];
+} fleet_claim;
+
+typedef struct
+{
+    uint32_t node_id;
+    IPAddress address;
+    unsigned long last_seen;
+    fleet_digest digest;
+} fleet_node;
+
+typedef struct
+{
+    unsigned long sent;
+    unsigned long received;
+    unsigned long bytes_sent;
+    unsigned long bytes_received;
+    unsigned long rejected;
+    // Signed correctly but stale or already seen
+    unsigned long replayed;
+    unsigned long elections_won;
+    unsigned long elections_lost;
+} fleet_stats;
+
+class Fleet
+{
+public:
+    Fleet(const char *group, const char *secret, const char *name, const char *zone, const char *address, uint16_t port,
+          unsigned long heartbeat_interval, unsigned long election_window, unsigned long claim_ttl);
+    bool begin();
+    // Joins the group again after WiFi reconnected; membership does not survive it
+    bool rejoin();
+    // Updates the digest sent in heartbeats; a change is announced promptly
+    void set_state(bool door_open, uint32_t open_events);
+    void tick();
+    // Blocks for at most the election window. Returns true when this node
+    // should send the notifications for the alert.
+    bool elect(fleet_alert_type alert);
+    size_t node_count();
+    const fleet_node &node(size_t index);
+    uint32_t node_id();
+    unsigned long heartbeat_interval();
+    const fleet_stats &stats();
+
+private:
+    typedef struct
+    {
+        uint32_t node_id;
+        uint8_t alert;
+        unsigned long received;
+    } claim_record;
+
+    // Newest datagram accepted from a node, heartbeat or claim
+    typedef struct
+    {
+        uint32_t node_id;
+        uint32_t boot;
+        uint32_t sequence;
+        uint32_t timestamp;
+        unsigned long received;
+    } peer_record;
+
+    void receive();
+    void sign(const uint8_t *data, size_t length, uint8_t *tag);
+    bool authentic(const uint8_t *data, size_t length);
+    bool fresh(const fleet_header &header);
+    void handle_heartbeat(const fleet_header &header, const fleet_digest &digest);
+    void handle_claim(const fleet_header &header, const fleet_claim &claim);
+    bool send(fleet_packet_type type, const void *body, size_t length);
+    void send_heartbeat();
+    void send_claim(fleet_alert_type alert);
+    void expire_nodes();
+    bool zone_has_peers();
+
+    uint32_t group;
+    const char *secret;
+    const char *address_text;
+    IPAddress address;
+    uint16_t port;
+    unsigned long base_heartbeat_interval;
+    unsigned long election_window;
+    unsigned long claim_ttl;
+
+    WiFiUDP udp;
+    bool started;
+    uint32_t id;
+    uint32_t boot;
+    uint32_t sequence;
+    fleet_digest digest;
+    bool digest_changed;
+    unsigned long last_heartbeat;
+    unsigned long next_heartbeat_delay;
+
+    fleet_node nodes[FLEET_MAX_NODES];
+    size_t nodes_len;
+    claim_record claims[FLEET_CLAIM_HISTORY];
+    size_t claims_next;
+    peer_record peers[FLEET_MAX_NODES];
+    fleet_stats counters;
+};
+#endif
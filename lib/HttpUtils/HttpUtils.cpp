@@ -2,7 +2,37 @@
 
 // #define DEBUG 1
 
-bool readHTTPAnswer(Client *client, String &body, String &headers)
+static http_connect_stats connect_stats;
+
+bool connectHTTPClient(Client *client, const char *host, uint16_t port)
+{
+    uint32_t free_heap = ESP.getFreeHeap();
+    unsigned long started = millis();
+    bool connected = client->connect(host, port);
+    unsigned long duration = millis() - started;
+
+    if (!connected)
+    {
+        connect_stats.failures++;
+        return false;
+    }
+
+    connect_stats.connections++;
+    connect_stats.total_connect_ms += duration;
+    connect_stats.max_connect_ms = max(connect_stats.max_connect_ms, duration);
+    connect_stats.last_heap_used = (int32_t)free_heap - (int32_t)ESP.getFreeHeap();
+#ifdef DEBUG
+    Serial.printf("Connected to %s:%u in %lums using %d bytes of heap\n", host, port, duration, connect_stats.last_heap_used);
+#endif
+    return true;
+}
+
+const http_connect_stats &getHTTPConnectStats()
+{
+    return connect_stats;
+}
+
+bool readHTTPAnswer(Client *client, String &body, String &headers, unsigned long timeout_ms)
 {
     int ch_count = 0;
     unsigned long now = millis();
@@ -10,7 +40,7 @@ bool readHTTPAnswer(Client *client, String &body, String &headers)
     bool currentLineIsBlank = true;
     bool responseReceived = false;
     int longPoll = 0;
-    unsigned int waitForResponse = 10 * 1000;
+    unsigned long waitForResponse = timeout_ms;
     int maxMessageLength = 15000;
 
     while (millis() - now < longPoll * 1000 + waitForResponse)
@@ -60,4 +90,259 @@ bool readHTTPAnswer(Client *client, String &body, String &headers)
         }
     }
     return responseReceived;
-}
\ No newline at end of file
+}
+
+int readHTTPHeaders(Client *client, long &content_length)
+{
+    content_length = HTTP_LENGTH_UNTIL_CLOSE;
+
+    String status_line = client->readStringUntil('\n');
+    if (!status_line.startsWith("HTTP/"))
+    {
+        return 0;
+    }
+    int status = status_line.substring(status_line.indexOf(' ') + 1).toInt();
+
+    while (true)
+    {
+        String line = client->readStringUntil('\n');
+        if (line.length() == 0)
+        {
+            // Timed out; a real blank line still carries its '\r'
+            return 0;
+        }
+        line.trim();
+        if (line.length() == 0)
+        {
+            return status;
+        }
+
+        int separator = line.indexOf(':');
+        if (separator < 0)
+        {
+            continue;
+        }
+        String name = line.substring(0, separator);
+        String value = line.substring(separator + 1);
+        name.toLowerCase();
+        value.trim();
+
+        if (name == "content-length" && content_length != HTTP_LENGTH_CHUNKED)
+        {
+            content_length = value.toInt();
+        }
+        else if (name == "transfer-encoding" && value.equalsIgnoreCase("chunked"))
+        {
+            // Takes precedence over any Content-Length
+            content_length = HTTP_LENGTH_CHUNKED;
+        }
+    }
+}
+
+static int readHTTPBody(Client *client, JsonDocument &doc, const JsonDocument &filter, size_t max_length)
+{
+    long content_length;
+    int status = readHTTPHeaders(client, content_length);
+    if (status == 0)
+    {
+        return 0;
+    }
+    if (content_length >= 0 && (size_t)content_length > max_length)
+    {
+#ifdef DEBUG
+        Serial.printf("Refusing %ld byte response\n", content_length);
+#endif
+        return HTTP_JSON_TOO_LARGE;
+    }
+
+    HTTPBodyStream body(client, content_length, max_length);
+    DeserializationError error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+    if (error)
+    {
+#ifdef DEBUG
+        Serial.printf("Unable to parse response: %s\n", error.c_str());
+#endif
+        client->stop();
+        return error == DeserializationError::NoMemory || body.truncated() ? HTTP_JSON_TOO_LARGE : HTTP_JSON_MALFORMED;
+    }
+    if (!body.drain())
+    {
+        // The rest of the body is lost, so the connection cannot be reused
+        client->stop();
+        if (body.truncated())
+        {
+            return HTTP_JSON_TOO_LARGE;
+        }
+    }
+
+    return status;
+}
+
+int readHTTPJson(Client *client, JsonDocument &doc, const JsonDocument &filter, size_t max_length, unsigned long timeout_ms)
+{
+    unsigned long started = millis();
+    while (!client->available())
+    {
+        if (!client->connected() || millis() - started >= timeout_ms)
+        {
+            return 0;
+        }
+        delay(1);
+    }
+
+    // Headers and body are read through Stream, which waits this long for
+    // every missing byte
+    unsigned long previous_timeout = client->getTimeout();
+    client->setTimeout(timeout_ms);
+    int status = readHTTPBody(client, doc, filter, max_length);
+    client->setTimeout(previous_timeout);
+    return status;
+}
+
+HTTPBodyStream::HTTPBodyStream(Client *client, long content_length, size_t max_length)
+{
+    this->client = client;
+    this->chunked = content_length == HTTP_LENGTH_CHUNKED;
+    this->until_close = content_length == HTTP_LENGTH_UNTIL_CLOSE;
+    this->ended = false;
+    this->over_budget = false;
+    // A close-delimited body is only known to be over budget once more of it
+    // arrives, so its length is open-ended
+    this->length = content_length >= 0 ? content_length : (this->until_close ? SIZE_MAX : 0);
+    this->budget = max_length;
+    this->chunks = 0;
+    this->setTimeout(client->getTimeout());
+}
+
+int HTTPBodyStream::available()
+{
+    if (this->ended)
+    {
+        return 0;
+    }
+    return min((size_t)max(this->client->available(), 0), min(this->length, this->budget));
+}
+
+int HTTPBodyStream::read()
+{
+    if (!this->fill())
+    {
+        return -1;
+    }
+    int c = this->client->read();
+    if (c >= 0)
+    {
+        this->length--;
+        this->budget--;
+    }
+    else if (this->until_close && !this->client->connected())
+    {
+        this->end();
+    }
+    return c;
+}
+
+int HTTPBodyStream::peek()
+{
+    if (!this->fill())
+    {
+        return -1;
+    }
+    int c = this->client->peek();
+    if (c < 0 && this->until_close && !this->client->connected())
+    {
+        this->end();
+    }
+    return c;
+}
+
+size_t HTTPBodyStream::write(uint8_t c)
+{
+    return 0;
+}
+
+bool HTTPBodyStream::truncated()
+{
+    return this->over_budget;
+}
+
+bool HTTPBodyStream::drain()
+{
+    while (this->fill())
+    {
+        if (this->timedRead() < 0 && !this->ended)
+        {
+            return false;
+        }
+    }
+    return !this->over_budget;
+}
+
+// Makes sure the next body byte can be read; false once the body has ended
+bool HTTPBodyStream::fill()
+{
+    if (this->ended)
+    {
+        return false;
+    }
+    if (this->length == 0 && this->chunked && !this->next_chunk())
+    {
+        this->end();
+        return false;
+    }
+    if (this->length > 0 && this->budget == 0)
+    {
+        this->over_budget = true;
+    }
+    if (this->length == 0 || this->budget == 0)
+    {
+        this->end();
+        return false;
+    }
+    return true;
+}
+
+// Reads the size line of the next chunk; false on the last chunk or garbage
+bool HTTPBodyStream::next_chunk()
+{
+    if (this->chunks > 0)
+    {
+        // CRLF closing the previous chunk's data
+        this->client->readStringUntil('\n');
+    }
+    this->chunks++;
+
+    // "1a3;extension\r\n"
+    String line = this->client->readStringUntil('\n');
+    char *end;
+    this->length = strtoul(line.c_str(), &end, 16);
+    if (end == line.c_str())
+    {
+        this->length = 0;
+        return false;
+    }
+    if (this->length > 0)
+    {
+        return true;
+    }
+
+    // Last chunk; skip any trailer headers up to the closing blank line
+    while (true)
+    {
+        String trailer = this->client->readStringUntil('\n');
+        trailer.trim();
+        if (trailer.length() == 0)
+        {
+            return false;
+        }
+    }
+}
+
+// Stream's timedRead and timedPeek keep retrying for the whole timeout, so
+// drop it once the body is over and lookups such as find() fail straight
+// away instead of waiting on bytes that will never come
+void HTTPBodyStream::end()
+{
+    this->ended = true;
+    this->setTimeout(0);
+}
@@ -2,7 +2,77 @@
 #define HTTP_UTILS_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 
-bool readHTTPAnswer(Client *client, String &body, String &headers);
+typedef struct
+{
+    unsigned long connections;
+    unsigned long failures;
+    unsigned long total_connect_ms;
+    unsigned long max_connect_ms;
+    // Free heap consumed by the most recent connection (TLS session state)
+    int32_t last_heap_used;
+} http_connect_stats;
+
+bool connectHTTPClient(Client *client, const char *host, uint16_t port);
+const http_connect_stats &getHTTPConnectStats();
+bool readHTTPAnswer(Client *client, String &body, String &headers, unsigned long timeout_ms = 10 * 1000);
+
+// content_length of a body that is not delimited by Content-Length
+#define HTTP_LENGTH_UNTIL_CLOSE -1
+#define HTTP_LENGTH_CHUNKED -2
+
+// Reads the status line and headers of a response, leaving the client at the
+// start of the body. Returns the status code (0 on timeout or garbage);
+// content_length is one of the HTTP_LENGTH_* values when the body is not
+// delimited by Content-Length.
+int readHTTPHeaders(Client *client, long &content_length);
+
+// Negative results of readHTTPJson; the response arrived but was not usable
+#define HTTP_JSON_TOO_LARGE -1
+#define HTTP_JSON_MALFORMED -2
+
+// Deserializes a response body straight from the client into doc, keeping
+// only the fields set in filter. timeout_ms applies to every wait of the
+// exchange, not just the first byte. A Content-Length over max_length is
+// refused before any of the body is read; chunked and close-delimited bodies
+// are decoded and refused once they pass max_length. Returns the HTTP status,
+// 0 when nothing arrived in time, or one of the HTTP_JSON_* errors.
+int readHTTPJson(Client *client, JsonDocument &doc, const JsonDocument &filter, size_t max_length, unsigned long timeout_ms);
+
+// Exposes only the body of a response, decoding chunked transfer encoding,
+// so a parser reading from it can never run past the end of the response on
+// a kept-alive connection. At most max_length bytes are handed out.
+class HTTPBodyStream : public Stream
+{
+public:
+    // content_length as reported by readHTTPHeaders
+    HTTPBodyStream(Client *client, long content_length, size_t max_length = SIZE_MAX);
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    // True once the body went past max_length and was cut off there
+    bool truncated();
+    bool drain();
+    // Waits for the next byte without consuming it
+    using Stream::timedPeek;
+
+private:
+    bool fill();
+    bool next_chunk();
+    void end();
+
+    Client *client;
+    bool chunked;
+    bool until_close;
+    bool ended;
+    bool over_budget;
+    // Bytes left in the body, or in the current chunk
+    size_t length;
+    // Bytes that may still be handed out under max_length
+    size_t budget;
+    size_t chunks;
+};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,623 @@
+#include "OtaUpdater.h"
+
+String ota_patch_status_to_string(ota_patch_status status)
+{
+    switch (status)
+    {
+    case OTA_PATCH_NONE:
+        return "none";
+    case OTA_PATCH_COMPLETE:
+        return "complete";
+    case OTA_PATCH_BAD_HEADER:
+        return "bad header";
+    case OTA_PATCH_SOURCE_MISMATCH:
+        return "source image mismatch";
+    case OTA_PATCH_BEGIN_FAILED:
+        return "unable to begin update";
+    case OTA_PATCH_RECEIVE_FAILED:
+        return "receive failed";
+    case OTA_PATCH_DECOMPRESS_FAILED:
+        return "decompress failed";
+    case OTA_PATCH_CORRUPT:
+        return "corrupt patch";
+    case OTA_PATCH_WRITE_FAILED:
+        return "flash write failed";
+    case OTA_PATCH_HASH_MISMATCH:
+        return "image hash mismatch";
+    case OTA_PATCH_UNAUTHENTICATED:
+        return "authentication failed";
+    case OTA_PATCH_END_FAILED:
+    default:
+        return "image validation failed";
+    }
+}
+
+static uint32_t read_le32(const uint8_t *data)
+{
+    return (uint32_t)data[0] |
+           ((uint32_t)data[1] << 8) |
+           ((uint32_t)data[2] << 16) |
+           ((uint32_t)data[3] << 24);
+}
+
+// Compares every byte so the time taken does not say where a forged tag
+// first went wrong
+static bool tags_equal(const uint8_t *a, const uint8_t *b, size_t length)
+{
+    uint8_t difference = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        difference |= a[i] ^ b[i];
+    }
+    return difference == 0;
+}
+
+OtaPatchApplier::OtaPatchApplier(const char *secret)
+{
+    this->secret = secret;
+    this->nonce_fresh = false;
+    mbedtls_md_init(&this->hmac);
+    this->active = false;
+    this->inflator = NULL;
+    this->dictionary = NULL;
+    this->write_buffer = NULL;
+    this->write_throttle_ms = 0;
+    mbedtls_sha256_init(&this->sha);
+}
+
+OtaPatchApplier::~OtaPatchApplier()
+{
+    this->abort();
+}
+
+void OtaPatchApplier::challenge(uint8_t *nonce)
+{
+    for (size_t i = 0; i < OTA_NONCE_SIZE; i += sizeof(uint32_t))
+    {
+        uint32_t random = esp_random();
+        memcpy(this->nonce + i, &random, sizeof(random));
+    }
+    memcpy(nonce, this->nonce, OTA_NONCE_SIZE);
+    this->nonce_fresh = true;
+}
+
+bool OtaPatchApplier::start_tag(mbedtls_md_context_t *context, const ota_patch_header &header)
+{
+    // An unset secret would make every tag forgeable
+    if (this->secret == NULL || this->secret[0] == '\0')
+    {
+        return false;
+    }
+    return mbedtls_md_setup(context, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) == 0 &&
+           mbedtls_md_hmac_starts(context, (const uint8_t *)this->secret, strlen(this->secret)) == 0 &&
+           mbedtls_md_hmac_update(context, this->nonce, OTA_NONCE_SIZE) == 0 &&
+           mbedtls_md_hmac_update(context, (const uint8_t *)&header, sizeof(header)) == 0;
+}
+
+ota_patch_status OtaPatchApplier::begin(const ota_patch_header &header, const uint8_t *header_tag)
+{
+    this->abort();
+    this->header = header;
+
+    bool nonce_fresh = this->nonce_fresh;
+    this->nonce_fresh = false;
+
+    if (memcmp(header.magic, OTA_PATCH_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != OTA_PATCH_VERSION ||
+        header.image_size == 0)
+    {
+        return OTA_PATCH_BAD_HEADER;
+    }
+
+    uint8_t expected[OTA_TAG_SIZE];
+    mbedtls_md_context_t context;
+    mbedtls_md_init(&context);
+    bool tagged = nonce_fresh && this->start_tag(&context, header) &&
+                  mbedtls_md_hmac_finish(&context, expected) == 0;
+    mbedtls_md_free(&context);
+    if (!tagged || !tags_equal(expected, header_tag, OTA_TAG_SIZE))
+    {
+        return OTA_PATCH_UNAUTHENTICATED;
+    }
+
+    this->source = esp_ota_get_running_partition();
+    this->target = esp_ota_get_next_update_partition(NULL);
+    if (this->target == NULL || header.image_size > this->target->size)
+    {
+        return OTA_PATCH_BAD_HEADER;
+    }
+
+    if (header.encoding & OTA_ENCODING_DELTA)
+    {
+        // A delta is only meaningful against the exact image it was built from
+        if (header.source_size > this->source->size)
+        {
+            return OTA_PATCH_SOURCE_MISMATCH;
+        }
+
+        uint8_t chunk[256];
+        uint8_t digest[32];
+        mbedtls_sha256_init(&this->sha);
+        mbedtls_sha256_starts_ret(&this->sha, 0);
+        for (uint32_t offset = 0; offset < header.source_size; offset += sizeof(chunk))
+        {
+            size_t length = min((uint32_t)sizeof(chunk), header.source_size - offset);
+            if (esp_partition_read(this->source, offset, chunk, length) != ESP_OK)
+            {
+                mbedtls_sha256_free(&this->sha);
+                return OTA_PATCH_SOURCE_MISMATCH;
+            }
+            mbedtls_sha256_update_ret(&this->sha, chunk, length);
+        }
+        mbedtls_sha256_finish_ret(&this->sha, digest);
+        mbedtls_sha256_free(&this->sha);
+
+        if (memcmp(digest, header.source_sha256, sizeof(digest)) != 0)
+        {
+            return OTA_PATCH_SOURCE_MISMATCH;
+        }
+    }
+
+    this->write_buffer = (uint8_t *)malloc(OTA_WRITE_BUFFER_SIZE);
+    if (this->write_buffer == NULL)
+    {
+        return OTA_PATCH_BEGIN_FAILED;
+    }
+
+    if (header.encoding & OTA_ENCODING_ZLIB)
+    {
+        this->inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+        this->dictionary = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+        if (this->inflator == NULL || this->dictionary == NULL)
+        {
+            this->release();
+            return OTA_PATCH_BEGIN_FAILED;
+        }
+        tinfl_init(this->inflator);
+    }
+
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+    // Erase sector by sector as the image is written instead of up front
+    esp_err_t err = esp_ota_begin(this->target, OTA_WITH_SEQUENTIAL_WRITES, &this->handle);
+#else
+    esp_err_t err = esp_ota_begin(this->target, header.image_size, &this->handle);
+#endif
+    if (err != ESP_OK)
+    {
+#ifdef OTA_UPDATER_DEBUG
+        Serial.printf("esp_ota_begin failed: %s\n", esp_err_to_name(err));
+#endif
+        this->release();
+        return OTA_PATCH_BEGIN_FAILED;
+    }
+
+    mbedtls_sha256_init(&this->sha);
+    mbedtls_sha256_starts_ret(&this->sha, 0);
+    if (!this->start_tag(&this->hmac, header))
+    {
+        esp_ota_abort(this->handle);
+        this->release();
+        return OTA_PATCH_BEGIN_FAILED;
+    }
+
+    this->dictionary_pos = 0;
+    this->inflate_done = false;
+    this->write_buffer_len = 0;
+    this->image_written = 0;
+    this->op = 0;
+    this->op_args_len = 0;
+    this->op_data_remaining = 0;
+    this->active = true;
+    return OTA_PATCH_COMPLETE;
+}
+
+ota_patch_status OtaPatchApplier::write(const uint8_t *data, size_t length)
+{
+    if (!this->active)
+    {
+        return OTA_PATCH_BEGIN_FAILED;
+    }
+
+    mbedtls_md_hmac_update(&this->hmac, data, length);
+
+    ota_patch_status status;
+    if (this->header.encoding & OTA_ENCODING_ZLIB)
+    {
+        status = this->inflate(data, length);
+    }
+    else
+    {
+        status = this->apply(data, length);
+    }
+
+    if (status != OTA_PATCH_COMPLETE)
+    {
+        this->abort();
+    }
+    return status;
+}
+
+ota_patch_status OtaPatchApplier::inflate(const uint8_t *data, size_t length)
+{
+    // Output can still be pending once the input is used up, when the window
+    // wrapped at the end of the dictionary ring
+    bool more_output = false;
+    while ((length > 0 || more_output) && !this->inflate_done)
+    {
+        size_t in_size = length;
+        size_t out_size = TINFL_LZ_DICT_SIZE - this->dictionary_pos;
+        tinfl_status status = tinfl_decompress(this->inflator,
+                                               data, &in_size,
+                                               this->dictionary, this->dictionary + this->dictionary_pos, &out_size,
+                                               TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_size;
+        length -= in_size;
+
+        if (out_size > 0)
+        {
+            ota_patch_status applied = this->apply(this->dictionary + this->dictionary_pos, out_size);
+            if (applied != OTA_PATCH_COMPLETE)
+            {
+                return applied;
+            }
+            this->dictionary_pos = (this->dictionary_pos + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            return OTA_PATCH_DECOMPRESS_FAILED;
+        }
+        if (status == TINFL_STATUS_DONE)
+        {
+            this->inflate_done = true;
+        }
+        more_output = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    return OTA_PATCH_COMPLETE;
+}
+
+ota_patch_status OtaPatchApplier::apply(const uint8_t *data, size_t length)
+{
+    if (!(this->header.encoding & OTA_ENCODING_DELTA))
+    {
+        return this->emit(data, length);
+    }
+
+    while (length > 0)
+    {
+        if (this->op_data_remaining > 0)
+        {
+            size_t chunk = min((size_t)this->op_data_remaining, length);
+            ota_patch_status status = this->emit(data, chunk);
+            if (status != OTA_PATCH_COMPLETE)
+            {
+                return status;
+            }
+            data += chunk;
+            length -= chunk;
+            this->op_data_remaining -= chunk;
+            continue;
+        }
+
+        if (this->op == 0)
+        {
+            this->op = *data++;
+            length--;
+            this->op_args_len = 0;
+            if (this->op != OTA_DELTA_OP_COPY && this->op != OTA_DELTA_OP_DATA)
+            {
+                return OTA_PATCH_CORRUPT;
+            }
+            continue;
+        }
+
+        size_t args_needed = (this->op == OTA_DELTA_OP_COPY) ? 8 : 4;
+        size_t chunk = min(args_needed - this->op_args_len, length);
+        memcpy(this->op_args + this->op_args_len, data, chunk);
+        this->op_args_len += chunk;
+        data += chunk;
+        length -= chunk;
+        if (this->op_args_len < args_needed)
+        {
+            continue;
+        }
+
+        if (this->op == OTA_DELTA_OP_COPY)
+        {
+            ota_patch_status status = this->copy_from_source(read_le32(this->op_args), read_le32(this->op_args + 4));
+            if (status != OTA_PATCH_COMPLETE)
+            {
+                return status;
+            }
+        }
+        else
+        {
+            this->op_data_remaining = read_le32(this->op_args);
+        }
+        this->op = 0;
+    }
+    return OTA_PATCH_COMPLETE;
+}
+
+ota_patch_status OtaPatchApplier::copy_from_source(uint32_t offset, uint32_t length)
+{
+    if (offset > this->header.source_size || length > this->header.source_size - offset)
+    {
+        return OTA_PATCH_CORRUPT;
+    }
+
+    uint8_t chunk[256];
+    while (length > 0)
+    {
+        size_t size = min((uint32_t)sizeof(chunk), length);
+        if (esp_partition_read(this->source, offset, chunk, size) != ESP_OK)
+        {
+            return OTA_PATCH_CORRUPT;
+        }
+        ota_patch_status status = this->emit(chunk, size);
+        if (status != OTA_PATCH_COMPLETE)
+        {
+            return status;
+        }
+        offset += size;
+        length -= size;
+    }
+    return OTA_PATCH_COMPLETE;
+}
+
+ota_patch_status OtaPatchApplier::emit(const uint8_t *data, size_t length)
+{
+    if (length > this->header.image_size - this->image_written)
+    {
+        return OTA_PATCH_CORRUPT;
+    }
+
+    mbedtls_sha256_update_ret(&this->sha, data, length);
+    this->image_written += length;
+
+    while (length > 0)
+    {
+        size_t chunk = min((size_t)(OTA_WRITE_BUFFER_SIZE - this->write_buffer_len), length);
+        memcpy(this->write_buffer + this->write_buffer_len, data, chunk);
+        this->write_buffer_len += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (this->write_buffer_len == OTA_WRITE_BUFFER_SIZE)
+        {
+            ota_patch_status status = this->flush();
+            if (status != OTA_PATCH_COMPLETE)
+            {
+                return status;
+            }
+        }
+    }
+    return OTA_PATCH_COMPLETE;
+}
+
+ota_patch_status OtaPatchApplier::flush()
+{
+    if (this->write_buffer_len == 0)
+    {
+        return OTA_PATCH_COMPLETE;
+    }
+    if (esp_ota_write(this->handle, this->write_buffer, this->write_buffer_len) != ESP_OK)
+    {
+        return OTA_PATCH_WRITE_FAILED;
+    }
+    this->write_buffer_len = 0;
+
+    // Flash writes stall both cores' caches; spacing them out keeps the
+    // rest of the system responsive while an update streams in.
+    if (this->write_throttle_ms > 0)
+    {
+        delay(this->write_throttle_ms);
+    }
+    return OTA_PATCH_COMPLETE;
+}
+
+ota_patch_status OtaPatchApplier::finish(const uint8_t *tag)
+{
+    if (!this->active)
+    {
+        return OTA_PATCH_BEGIN_FAILED;
+    }
+
+    // The image was written to the spare partition as it arrived, but it is
+    // never made bootable unless the sender held the secret
+    uint8_t expected[OTA_TAG_SIZE];
+    if (mbedtls_md_hmac_finish(&this->hmac, expected) != 0 || !tags_equal(expected, tag, OTA_TAG_SIZE))
+    {
+        this->abort();
+        return OTA_PATCH_UNAUTHENTICATED;
+    }
+
+    ota_patch_status status = this->flush();
+    if (status != OTA_PATCH_COMPLETE)
+    {
+        this->abort();
+        return status;
+    }
+
+    if (this->image_written != this->header.image_size ||
+        this->op != 0 || this->op_data_remaining != 0 ||
+        ((this->header.encoding & OTA_ENCODING_ZLIB) && !this->inflate_done))
+    {
+        this->abort();
+        return OTA_PATCH_CORRUPT;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish_ret(&this->sha, digest);
+    if (memcmp(digest, this->header.image_sha256, sizeof(digest)) != 0)
+    {
+        this->abort();
+        return OTA_PATCH_HASH_MISMATCH;
+    }
+
+    esp_ota_handle_t handle = this->handle;
+    this->active = false;
+    this->release();
+
+    if (esp_ota_end(handle) != ESP_OK)
+    {
+        return OTA_PATCH_END_FAILED;
+    }
+    if (esp_ota_set_boot_partition(this->target) != ESP_OK)
+    {
+        return OTA_PATCH_END_FAILED;
+    }
+    return OTA_PATCH_COMPLETE;
+}
+
+void OtaPatchApplier::abort()
+{
+    if (this->active)
+    {
+        esp_ota_abort(this->handle);
+        this->active = false;
+    }
+    this->release();
+}
+
+void OtaPatchApplier::set_write_throttle(unsigned long throttle_ms)
+{
+    this->write_throttle_ms = throttle_ms;
+}
+
+void OtaPatchApplier::release()
+{
+    mbedtls_sha256_free(&this->sha);
+    mbedtls_md_free(&this->hmac);
+    free(this->inflator);
+    free(this->dictionary);
+    free(this->write_buffer);
+    this->inflator = NULL;
+    this->dictionary = NULL;
+    this->write_buffer = NULL;
+}
+
+OtaUpdater::OtaUpdater(uint16_t port, const char *secret) : server(port), applier(secret)
+{
+    memset(&this->stats, 0, sizeof(this->stats));
+    this->receiving = false;
+}
+
+void OtaUpdater::begin()
+{
+    this->server.begin();
+}
+
+ota_patch_status OtaUpdater::handle()
+{
+    WiFiClient client = this->server.available();
+    if (!client)
+    {
+        return OTA_PATCH_NONE;
+    }
+
+#ifdef OTA_UPDATER_DEBUG
+    Serial.println("OtaUpdater: receiving patch from " + client.remoteIP().toString());
+#endif
+
+    unsigned long started = millis();
+    this->receiving = true;
+    ota_patch_status status = this->receive(client);
+    this->receiving = false;
+    this->stats.duration_ms = millis() - started;
+
+    if (status == OTA_PATCH_COMPLETE)
+    {
+        client.print("OK\n");
+    }
+    else
+    {
+        client.print("ERR " + ota_patch_status_to_string(status) + "\n");
+    }
+    client.flush();
+    client.stop();
+
+#ifdef OTA_UPDATER_DEBUG
+    Serial.printf("OtaUpdater: %s, %u payload bytes -> %u image bytes in %lu ms\n",
+                  ota_patch_status_to_string(status).c_str(),
+                  this->stats.payload_bytes, this->stats.image_bytes, this->stats.duration_ms);
+#endif
+    return status;
+}
+
+ota_patch_status OtaUpdater::receive(WiFiClient &client)
+{
+    uint8_t nonce[OTA_NONCE_SIZE];
+    this->applier.challenge(nonce);
+    if (client.write(nonce, sizeof(nonce)) != sizeof(nonce))
+    {
+        return OTA_PATCH_RECEIVE_FAILED;
+    }
+
+    ota_patch_header header;
+    uint8_t tag[OTA_TAG_SIZE];
+    client.setTimeout(OTA_RECEIVE_TIMEOUT / 1000);
+    if (client.readBytes((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+        client.readBytes(tag, sizeof(tag)) != sizeof(tag))
+    {
+        return OTA_PATCH_BAD_HEADER;
+    }
+
+    this->stats.encoding = header.encoding;
+    this->stats.payload_bytes = header.payload_size;
+    this->stats.image_bytes = header.image_size;
+
+    ota_patch_status status = this->applier.begin(header, tag);
+    if (status != OTA_PATCH_COMPLETE)
+    {
+        return status;
+    }
+
+    uint8_t buffer[OTA_READ_BUFFER_SIZE];
+    uint32_t remaining = header.payload_size;
+    unsigned long last_received = millis();
+    while (remaining > 0)
+    {
+        int length = client.read(buffer, min((uint32_t)sizeof(buffer), remaining));
+        if (length <= 0)
+        {
+            if (!client.connected() || millis() - last_received > OTA_RECEIVE_TIMEOUT)
+            {
+                this->applier.abort();
+                return OTA_PATCH_RECEIVE_FAILED;
+            }
+            delay(1);
+            continue;
+        }
+
+        status = this->applier.write(buffer, length);
+        if (status != OTA_PATCH_COMPLETE)
+        {
+            return status;
+        }
+        remaining -= length;
+        last_received = millis();
+    }
+
+    if (client.readBytes(tag, sizeof(tag)) != sizeof(tag))
+    {
+        this->applier.abort();
+        return OTA_PATCH_RECEIVE_FAILED;
+    }
+    return this->applier.finish(tag);
+}
+
+bool OtaUpdater::in_progress()
+{
+    return this->receiving;
+}
+
+void OtaUpdater::set_write_throttle(unsigned long throttle_ms)
+{
+    this->applier.set_write_throttle(throttle_ms);
+}
+
+const ota_patch_stats &OtaUpdater::last_stats()
+{
+    return this->stats;
+}
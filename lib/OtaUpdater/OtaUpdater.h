@@ -0,0 +1,157 @@
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <WiFiServer.h>
+#include <WiFiClient.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/md.h>
+#include "esp32/rom/miniz.h"
+
+// #define OTA_UPDATER_DEBUG 1
+
+// Patch stream layout (all integers little-endian), see tools/ota_patch.py.
+// The device opens with a fresh nonce, then the sender streams:
+//
+//   ota_patch_header | header tag | payload_size bytes of payload | tag
+//
+// Both tags are HMAC-SHA256 keyed with the OTA secret, the header tag over
+// nonce | header and the final tag over nonce | header | payload. The header
+// tag is checked before anything is erased and the final tag before the new
+// image is made bootable; the nonce stops a captured upload being replayed.
+//
+// The payload is either the raw image or a delta op stream, optionally zlib
+// compressed. Delta ops copy ranges out of the running partition or insert
+// literal bytes:
+//
+//   0x01 COPY <uint32 source offset> <uint32 length>
+//   0x02 DATA <uint32 length> <length bytes>
+#define OTA_PATCH_MAGIC "GDOT"
+#define OTA_PATCH_VERSION 2
+#define OTA_NONCE_SIZE 16
+#define OTA_TAG_SIZE 32
+
+#define OTA_ENCODING_ZLIB 0x01
+#define OTA_ENCODING_DELTA 0x02
+
+#define OTA_DELTA_OP_COPY 0x01
+#define OTA_DELTA_OP_DATA 0x02
+
+#define OTA_WRITE_BUFFER_SIZE 4096
+#define OTA_READ_BUFFER_SIZE 1460
+const unsigned long OTA_RECEIVE_TIMEOUT = 10 * 1000;
+
+typedef struct __attribute__((packed))
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t encoding;
+    uint16_t reserved;
+    uint32_t payload_size;
+    uint32_t image_size;
+    uint32_t source_size;
+    uint8_t source_sha256[32];
+    uint8_t image_sha256[32];
+} ota_patch_header;
+
+typedef enum
+{
+    OTA_PATCH_NONE = 0,
+    OTA_PATCH_COMPLETE = 1,
+    OTA_PATCH_BAD_HEADER = -1,
+    OTA_PATCH_SOURCE_MISMATCH = -2,
+    OTA_PATCH_BEGIN_FAILED = -3,
+    OTA_PATCH_RECEIVE_FAILED = -4,
+    OTA_PATCH_DECOMPRESS_FAILED = -5,
+    OTA_PATCH_CORRUPT = -6,
+    OTA_PATCH_WRITE_FAILED = -7,
+    OTA_PATCH_HASH_MISMATCH = -8,
+    OTA_PATCH_END_FAILED = -9,
+    OTA_PATCH_UNAUTHENTICATED = -10,
+} ota_patch_status;
+
+typedef struct
+{
+    uint8_t encoding;
+    uint32_t payload_bytes;
+    uint32_t image_bytes;
+    unsigned long duration_ms;
+} ota_patch_stats;
+
+String ota_patch_status_to_string(ota_patch_status status);
+
+// Applies a patch stream to the next OTA partition as it arrives. RAM use is
+// bounded by the inflate window and the write buffer, regardless of image size.
+class OtaPatchApplier
+{
+public:
+    OtaPatchApplier(const char *secret);
+    ~OtaPatchApplier();
+    // Draws the nonce the sender must sign for the next begin(); each nonce
+    // is good for one attempt
+    void challenge(uint8_t *nonce);
+    ota_patch_status begin(const ota_patch_header &header, const uint8_t *header_tag);
+    ota_patch_status write(const uint8_t *data, size_t length);
+    ota_patch_status finish(const uint8_t *tag);
+    void abort();
+    void set_write_throttle(unsigned long throttle_ms);
+
+private:
+    bool start_tag(mbedtls_md_context_t *context, const ota_patch_header &header);
+    ota_patch_status inflate(const uint8_t *data, size_t length);
+    ota_patch_status apply(const uint8_t *data, size_t length);
+    ota_patch_status emit(const uint8_t *data, size_t length);
+    ota_patch_status copy_from_source(uint32_t offset, uint32_t length);
+    ota_patch_status flush();
+    void release();
+
+    const char *secret;
+    uint8_t nonce[OTA_NONCE_SIZE];
+    bool nonce_fresh;
+    mbedtls_md_context_t hmac;
+
+    ota_patch_header header;
+    const esp_partition_t *source;
+    const esp_partition_t *target;
+    esp_ota_handle_t handle;
+    mbedtls_sha256_context sha;
+    bool active;
+
+    tinfl_decompressor *inflator;
+    uint8_t *dictionary;
+    size_t dictionary_pos;
+    bool inflate_done;
+
+    uint8_t *write_buffer;
+    size_t write_buffer_len;
+    uint32_t image_written;
+    unsigned long write_throttle_ms;
+
+    uint8_t op;
+    uint8_t op_args[8];
+    size_t op_args_len;
+    uint32_t op_data_remaining;
+};
+
+// Accepts patch streams over TCP, one connection at a time.
+class OtaUpdater
+{
+public:
+    OtaUpdater(uint16_t port, const char *secret);
+    void begin();
+    ota_patch_status handle();
+    bool in_progress();
+    void set_write_throttle(unsigned long throttle_ms);
+    const ota_patch_stats &last_stats();
+
+private:
+    ota_patch_status receive(WiFiClient &client);
+
+    WiFiServer server;
+    OtaPatchApplier applier;
+    ota_patch_stats stats;
+    volatile bool receiving;
+};
+#endif
@@ -1,52 +1,61 @@
 #include "PagerDuty.h"
 
-String sendPostToPagerDuty(Client *client, const String &url, JsonObject payload)
+// Fills response with the fields of the Events API answer we use and returns
+// the HTTP status, or what readHTTPJson returned instead
+int sendPostToPagerDuty(Client *client, CircuitBreaker *breaker, const String &url, JsonObject payload, JsonDocument &response)
 {
-    String body;
-    String headers;
-
     if (!client->connected())
     {
 #ifdef PAGER_DUTY_DEBUG
         Serial.println(F("Connecting to PagerDuty"));
 #endif
-        if (!client->connect(PAGER_DUTY_HOST, PAGER_DUTY_PORT))
+        if (!connectHTTPClient(client, PAGER_DUTY_HOST, PAGER_DUTY_PORT))
         {
 #ifdef PAGER_DUTY_DEBUG
             Serial.println(F("Connection error"));
 #endif
+            breaker->record_failure();
+            return 0;
         }
     }
-    if (client->connected())
-    {
-        // POST URI
-        client->print(F("POST /"));
-        client->print(url);
-        client->println(F(" HTTP/1.1"));
-        // Host header
-        client->println(F("Host:" PAGER_DUTY_HOST));
-        // JSON content type
-        client->println(F("Content-Type: application/json"));
-
-        // Content length
-        int length = measureJson(payload);
-        client->print(F("Content-Length:"));
-        client->println(length);
-        // End of headers
-        client->println();
-        // POST message body
-        String out;
-        serializeJson(payload, out);
-
-        client->println(out);
+
+    // POST URI
+    client->print(F("POST /"));
+    client->print(url);
+    client->println(F(" HTTP/1.1"));
+    // Host header
+    client->println(F("Host:" PAGER_DUTY_HOST));
+    // JSON content type
+    client->println(F("Content-Type: application/json"));
+
+    // Content length
+    int length = measureJson(payload);
+    client->print(F("Content-Length:"));
+    client->println(length);
+    // End of headers
+    client->println();
+    // POST message body
+    String out;
+    serializeJson(payload, out);
+
+    client->println(out);
 #ifdef PAGER_DUTY_DEBUG
-        Serial.println(String("Posting:") + out);
+    Serial.println(String("Posting:") + out);
 #endif
 
-        readHTTPAnswer(client, body, headers);
-    }
+    // {"status":"success","message":"Event processed","dedup_key":"..."}
+    StaticJsonDocument<64> filter;
+    filter["status"] = true;
+    filter["dedup_key"] = true;
 
-    return body;
+    unsigned long started = millis();
+    int status = readHTTPJson(client, response, filter, PAGER_DUTY_MAX_RESPONSE_SIZE, breaker->timeout());
+    breaker->record_http_status(status, millis() - started);
+
+#ifdef PAGER_DUTY_DEBUG
+    Serial.printf("PagerDuty answered %d\n", status);
+#endif
+    return status;
 }
 
 void closeClient(Client *client)
@@ -76,6 +85,88 @@ String pd_severity_to_string(pd_severity severity)
     }
 }
 
+String pg_event_action_to_string(pg_event_action action)
+{
+    switch (action)
+    {
+    case ACKNOWLEDGE:
+        return "acknowledge";
+    case RESOLVE:
+        return "resolve";
+    case TRIGGER:
+    default:
+        return "trigger";
+    }
+}
+
+// Queues an action to be sent once PagerDuty answers again. A full queue
+// makes room for a real action by giving up its oldest simulated one;
+// otherwise the newcomer is dropped, so a held back real action never is.
+void parkPagerDutyAction(pd_pending_queue *pending, const pd_pending_action &action)
+{
+#ifdef PAGER_DUTY_DEBUG
+    Serial.println(F("Holding the PagerDuty event back"));
+#endif
+    if (pending->actions.size() >= PAGER_DUTY_PENDING_CAPACITY)
+    {
+        std::deque<pd_pending_action>::iterator simulated = pending->actions.begin();
+        while (simulated != pending->actions.end() && !simulated->simulated)
+        {
+            simulated++;
+        }
+        if (simulated == pending->actions.end() || action.simulated)
+        {
+            pending->dropped++;
+            return;
+        }
+        pending->actions.erase(simulated);
+        pending->dropped++;
+    }
+    pending->actions.push_back(action);
+}
+
+// Posts one Events API action and returns the HTTP status, or what
+// readHTTPJson returned instead; accepted is set when PagerDuty took it
+int postPagerDutyAction(Client *client, CircuitBreaker *breaker, const String &routing_key,
+                        const pd_pending_action &action, bool &accepted)
+{
+    DynamicJsonDocument payload(1024);
+    payload["routing_key"] = routing_key;
+    payload["dedup_key"] = action.dedup_key;
+    payload["event_action"] = pg_event_action_to_string(action.action);
+    payload["payload"]["summary"] = action.summary;
+    payload["payload"]["source"] = action.source;
+    payload["payload"]["severity"] = pd_severity_to_string(action.severity);
+
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> response;
+    int status = sendPostToPagerDuty(client, breaker, "v2/enqueue", payload.as<JsonObject>(), response);
+    closeClient(client);
+
+    accepted = status >= 200 && status < 300 && strcmp(response["status"] | "", "success") == 0;
+    return status;
+}
+
+// Sends one Events API action and returns true when PagerDuty accepted it.
+// An action the breaker skips, or that fails in a way worth retrying, waits
+// in pending; so does one arriving while older actions still wait there.
+bool sendPagerDutyAction(Client *client, CircuitBreaker *breaker, pd_pending_queue *pending,
+                         const String &routing_key, const pd_pending_action &action)
+{
+    if (!pending->actions.empty() || !breaker->allow())
+    {
+        parkPagerDutyAction(pending, action);
+        return false;
+    }
+
+    bool accepted;
+    if (http_status_is_failure(postPagerDutyAction(client, breaker, routing_key, action, accepted)))
+    {
+        parkPagerDutyAction(pending, action);
+        return false;
+    }
+    return accepted;
+}
+
 PagerDuty::PagerDuty(const String &routing_key, Client &client)
 {
 #ifdef PAGER_DUTY_DEBUG
@@ -83,37 +174,156 @@ PagerDuty::PagerDuty(const String &routing_key, Client &client)
 #endif
     this->routing_key = routing_key;
     this->client = &client;
+    this->pending_actions.dropped = 0;
+    this->incidents = 0;
+    this->preferences = NULL;
+    this->key = NULL;
+}
+
+// Saved actions are one per line, their fields separated by tabs
+static String next_field(const String &record, int &from)
+{
+    int end = record.indexOf('\t', from);
+    if (end < 0)
+    {
+        end = record.length();
+    }
+    String field = record.substring(from, end);
+    from = end + 1;
+    return field;
+}
+
+void PagerDuty::begin(Preferences &preferences, const char *key)
+{
+    this->preferences = &preferences;
+    this->key = key;
+
+    String saved = preferences.getString(key, "");
+    if (saved.isEmpty())
+    {
+        return;
+    }
+    // Restored once; whatever is still held back at the next restart is saved again
+    preferences.remove(key);
+
+    int start = 0;
+    while (start < (int)saved.length())
+    {
+        int end = saved.indexOf('\n', start);
+        if (end < 0)
+        {
+            end = saved.length();
+        }
+        String record = saved.substring(start, end);
+        start = end + 1;
+
+        int from = 0;
+        pd_pending_action action;
+        action.action = (pg_event_action)next_field(record, from).toInt();
+        action.severity = (pd_severity)next_field(record, from).toInt();
+        action.dedup_key = next_field(record, from);
+        action.source = next_field(record, from);
+        if (from > (int)record.length())
+        {
+            continue;
+        }
+        action.summary = next_field(record, from);
+        action.simulated = false;
+        parkPagerDutyAction(&this->pending_actions, action);
+    }
+#ifdef PAGER_DUTY_DEBUG
+    Serial.printf("PagerDuty: restored %u held back actions\n", (unsigned int)this->pending_actions.actions.size());
+#endif
+}
+
+bool PagerDuty::checkpoint()
+{
+    if (this->preferences == NULL)
+    {
+        return false;
+    }
+
+    // Simulated actions are not worth sending after a restart
+    String saved;
+    for (const pd_pending_action &action : this->pending_actions.actions)
+    {
+        if (action.simulated)
+        {
+            continue;
+        }
+        saved += (String)(int)action.action + "\t" + (String)(int)action.severity + "\t" +
+                 action.dedup_key + "\t" + action.source + "\t" + action.summary + "\n";
+    }
+    if (saved.isEmpty())
+    {
+        return true;
+    }
+    return this->preferences->putString(this->key, saved) == saved.length();
+}
+
+CircuitBreaker &PagerDuty::circuit_breaker()
+{
+    return this->breaker;
 }
 
-std::shared_ptr<PagerDutyEvent> PagerDuty::create_event(const pd_severity severity, const String &summary, const String &source)
+std::shared_ptr<PagerDutyEvent> PagerDuty::create_event(const pd_severity severity, const String &summary, const String &source,
+                                                        bool simulated)
 {
 #ifdef PAGER_DUTY_DEBUG
     Serial.println("PagerDuty::create_event()");
 #endif
 
-    DynamicJsonDocument payload(1024);
-    payload["routing_key"] = this->routing_key;
-    payload["event_action"] = "trigger";
-    payload["payload"]["summary"] = summary;
-    payload["payload"]["source"] = source;
-    payload["payload"]["severity"] = pd_severity_to_string(severity);
-
-    String response_body = sendPostToPagerDuty(this->client, "v2/enqueue", payload.as<JsonObject>());
-    closeClient(this->client);
-    DynamicJsonDocument response_json(1024);
-    deserializeJson(response_json, response_body);
-
-    String dedup_key = response_json["dedup_key"];
-    std::shared_ptr<PagerDutyEvent> event = std::make_shared<PagerDutyEvent>(PagerDutyEvent(this->routing_key, dedup_key, severity, summary, source, this->client));
+    // Picked on first use rather than at construction, once the radio is up
+    // and esp_random() is truly random, so keys differ across reboots
+    if (this->boot_id.isEmpty())
+    {
+        this->boot_id = String(esp_random(), HEX);
+    }
+    String dedup_key = source + ":" + this->boot_id + "-" + String(++this->incidents);
+    sendPagerDutyAction(this->client, &this->breaker, &this->pending_actions, this->routing_key,
+                        {TRIGGER, dedup_key, severity, summary, source, simulated});
+
+    std::shared_ptr<PagerDutyEvent> event = std::make_shared<PagerDutyEvent>(PagerDutyEvent(this->routing_key, dedup_key, severity, summary, source, simulated, this->client, &this->breaker, &this->pending_actions));
     return event;
 }
 
+bool PagerDuty::pending()
+{
+    return !this->pending_actions.actions.empty();
+}
+
+bool PagerDuty::send_pending()
+{
+    if (this->pending_actions.actions.empty() || !this->breaker.ready() || !this->breaker.allow())
+    {
+        return false;
+    }
+
+    // Stays at the front until it is sent or refused for good
+    bool accepted;
+    if (http_status_is_failure(postPagerDutyAction(this->client, &this->breaker, this->routing_key,
+                                                   this->pending_actions.actions.front(), accepted)))
+    {
+        return false;
+    }
+    this->pending_actions.actions.pop_front();
+    return accepted;
+}
+
+unsigned long PagerDuty::dropped()
+{
+    return this->pending_actions.dropped;
+}
+
 PagerDutyEvent::PagerDutyEvent(const String &routing_key,
                                const String &dedup_key,
                                const pd_severity &severity,
                                const String &payload_summary,
                                const String &payload_source,
-                               Client *client)
+                               bool simulated,
+                               Client *client,
+                               CircuitBreaker *breaker,
+                               pd_pending_queue *pending)
 {
 #ifdef PAGER_DUTY_DEBUG
     Serial.println("PagerDutyEvent::PagerDutyEvent()");
@@ -123,7 +333,10 @@ PagerDutyEvent::PagerDutyEvent(const String &routing_key,
     this->severity = severity;
     this->payload_summary = payload_summary;
     this->payload_source = payload_source;
+    this->simulated = simulated;
     this->client = client;
+    this->breaker = breaker;
+    this->pending = pending;
 }
 
 bool PagerDutyEvent::acknowledge()
@@ -131,26 +344,8 @@ bool PagerDutyEvent::acknowledge()
 #ifdef PAGER_DUTY_DEBUG
     Serial.println("PagerDutyEvent::acknowledge()");
 #endif
-
-    DynamicJsonDocument payload(1024);
-    payload["routing_key"] = this->routing_key;
-    payload["dedup_key"] = this->dedup_key;
-    payload["event_action"] = "acknowledge";
-    payload["payload"]["summary"] = this->payload_summary;
-    payload["payload"]["source"] = this->payload_source;
-    payload["payload"]["severity"] = pd_severity_to_string(severity);
-
-    String response_body = sendPostToPagerDuty(this->client, "v2/enqueue", payload.as<JsonObject>());
-    closeClient(this->client);
-    DynamicJsonDocument response_json(1024);
-    deserializeJson(response_json, response_body);
-
-    String status = response_json["status"];
-    if (status.equals("OK"))
-    {
-        return true;
-    }
-    return false;
+    return sendPagerDutyAction(this->client, this->breaker, this->pending, this->routing_key,
+                               {ACKNOWLEDGE, this->dedup_key, this->severity, this->payload_summary, this->payload_source, this->simulated});
 }
 
 bool PagerDutyEvent::resolve()
@@ -158,23 +353,6 @@ bool PagerDutyEvent::resolve()
 #ifdef PAGER_DUTY_DEBUG
     Serial.println("PagerDutyEvent::resolve()");
 #endif
-    DynamicJsonDocument payload(1024);
-    payload["routing_key"] = this->routing_key;
-    payload["dedup_key"] = this->dedup_key;
-    payload["event_action"] = "resolve";
-    payload["payload"]["summary"] = this->payload_summary;
-    payload["payload"]["source"] = this->payload_source;
-    payload["payload"]["severity"] = pd_severity_to_string(severity);
-
-    String response_body = sendPostToPagerDuty(this->client, "v2/enqueue", payload.as<JsonObject>());
-    closeClient(this->client);
-    DynamicJsonDocument response_json(1024);
-    deserializeJson(response_json, response_body);
-
-    String status = response_json["status"];
-    if (status.equals("OK"))
-    {
-        return true;
-    }
-    return false;
-}
+    return sendPagerDutyAction(this->client, this->breaker, this->pending, this->routing_key,
+                               {RESOLVE, this->dedup_key, this->severity, this->payload_summary, this->payload_source, this->simulated});
+}
\ No newline at end of file
@@ -4,46 +4,21 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <Client.h>
+#include <Preferences.h>
 #include <ArxSmartPtr.h>
+#include <deque>
 #include "../HttpUtils/HttpUtils.h"
+#include "../CircuitBreaker/CircuitBreaker.h"
 
 // #define PAGER_DUTY_DEBUG 1
 
 #define PAGER_DUTY_HOST "events.pagerduty.com"
 #define PAGER_DUTY_PORT 443
-
-// openssl s_client -showcerts -connect events.pagerduty.com:443 </dev/null
-const char PAGER_DUTY_CERTIFICATE_ROOT[] = R"=EOF=(
------BEGIN CERTIFICATE-----
-MIIE6jCCA9KgAwIBAgIQCjUI1VwpKwF9+K1lwA/35DANBgkqhkiG9w0BAQsFADBh
-MQswCQYDVQQGEwJVUzEVMBMGA1UEChMMRGlnaUNlcnQgSW5jMRkwFwYDVQQLExB3
-d3cuZGlnaWNlcnQuY29tMSAwHgYDVQQDExdEaWdpQ2VydCBHbG9iYWwgUm9vdCBD
-QTAeFw0yMDA5MjQwMDAwMDBaFw0zMDA5MjMyMzU5NTlaME8xCzAJBgNVBAYTAlVT
-MRUwEwYDVQQKEwxEaWdpQ2VydCBJbmMxKTAnBgNVBAMTIERpZ2lDZXJ0IFRMUyBS
-U0EgU0hBMjU2IDIwMjAgQ0ExMIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKC
-AQEAwUuzZUdwvN1PWNvsnO3DZuUfMRNUrUpmRh8sCuxkB+Uu3Ny5CiDt3+PE0J6a
-qXodgojlEVbbHp9YwlHnLDQNLtKS4VbL8Xlfs7uHyiUDe5pSQWYQYE9XE0nw6Ddn
-g9/n00tnTCJRpt8OmRDtV1F0JuJ9x8piLhMbfyOIJVNvwTRYAIuE//i+p1hJInuW
-raKImxW8oHzf6VGo1bDtN+I2tIJLYrVJmuzHZ9bjPvXj1hJeRPG/cUJ9WIQDgLGB
-Afr5yjK7tI4nhyfFK3TUqNaX3sNk+crOU6JWvHgXjkkDKa77SU+kFbnO8lwZV21r
-eacroicgE7XQPUDTITAHk+qZ9QIDAQABo4IBrjCCAaowHQYDVR0OBBYEFLdrouqo
-qoSMeeq02g+YssWVdrn0MB8GA1UdIwQYMBaAFAPeUDVW0Uy7ZvCj4hsbw5eyPdFV
-MA4GA1UdDwEB/wQEAwIBhjAdBgNVHSUEFjAUBggrBgEFBQcDAQYIKwYBBQUHAwIw
-EgYDVR0TAQH/BAgwBgEB/wIBADB2BggrBgEFBQcBAQRqMGgwJAYIKwYBBQUHMAGG
-GGh0dHA6Ly9vY3NwLmRpZ2ljZXJ0LmNvbTBABggrBgEFBQcwAoY0aHR0cDovL2Nh
-Y2VydHMuZGlnaWNlcnQuY29tL0RpZ2lDZXJ0R2xvYmFsUm9vdENBLmNydDB7BgNV
-HR8EdDByMDegNaAzhjFodHRwOi8vY3JsMy5kaWdpY2VydC5jb20vRGlnaUNlcnRH
-bG9iYWxSb290Q0EuY3JsMDegNaAzhjFodHRwOi8vY3JsNC5kaWdpY2VydC5jb20v
-RGlnaUNlcnRHbG9iYWxSb290Q0EuY3JsMDAGA1UdIAQpMCcwBwYFZ4EMAQEwCAYG
-Z4EMAQIBMAgGBmeBDAECAjAIBgZngQwBAgMwDQYJKoZIhvcNAQELBQADggEBAHer
-t3onPa679n/gWlbJhKrKW3EX3SJH/E6f7tDBpATho+vFScH90cnfjK+URSxGKqNj
-OSD5nkoklEHIqdninFQFBstcHL4AGw+oWv8Zu2XHFq8hVt1hBcnpj5h232sb0HIM
-ULkwKXq/YFkQZhM6LawVEWwtIwwCPgU7/uWhnOKK24fXSuhe50gG66sSmvKvhMNb
-g0qZgYOrAKHKCjxMoiWJKiKnpPMzTFuMLhoClw+dj20tlQj7T9rxkTgl4ZxuYRiH
-as6xuwAwapu3r9rxxZf+ingkquqTgLozZXq8oXfpf2kUCwA/d5KxTVtzhwoT0JzI
-8ks5T1KESaZMkE4f97Q=
------END CERTIFICATE-----
-)=EOF=";
+// Events API answers are a few short fields; anything bigger is refused unread
+#define PAGER_DUTY_MAX_RESPONSE_SIZE 1024
+#define PAGER_DUTY_RESPONSE_DOC_SIZE 128
+// Actions held back while PagerDuty is unreachable; a door cycle takes two
+#define PAGER_DUTY_PENDING_CAPACITY 16
 
 typedef enum
 {
@@ -60,6 +35,27 @@ typedef enum
     INFO = 3
 } pd_severity;
 
+// An action skipped while the breaker was open, or that failed in a way worth
+// retrying. Simulated ones come from /test and /burst.
+typedef struct
+{
+    pg_event_action action;
+    String dedup_key;
+    pd_severity severity;
+    String summary;
+    String source;
+    bool simulated;
+} pd_pending_action;
+
+// Held back actions, oldest first and sent in that order, so a resolve never
+// overtakes its trigger. When full, simulated actions make room; a real one
+// is never displaced, the newcomer is dropped and counted instead.
+typedef struct
+{
+    std::deque<pd_pending_action> actions;
+    unsigned long dropped;
+} pd_pending_queue;
+
 class PagerDutyEvent
 {
 public:
@@ -68,7 +64,10 @@ public:
                    const pd_severity &severity,
                    const String &payload_summary,
                    const String &payload_source,
-                   Client *client);
+                   bool simulated,
+                   Client *client,
+                   CircuitBreaker *breaker,
+                   pd_pending_queue *pending);
     bool acknowledge();
     bool resolve();
 
@@ -78,17 +77,42 @@ private:
     String payload_summary;
     String payload_source;
     pd_severity severity;
+    bool simulated;
     Client *client;
+    CircuitBreaker *breaker;
+    pd_pending_queue *pending;
 };
 
 class PagerDuty
 {
 public:
     PagerDuty(const String &routing_key, Client &client);
-    std::shared_ptr<PagerDutyEvent> create_event(const pd_severity severity, const String &summary, const String &source);
+    // Takes back the actions checkpoint() saved before the last restart;
+    // they go out first, through send_pending()
+    void begin(Preferences &preferences, const char *key);
+    // Every event is its own incident: the dedup key is the source, a boot id
+    // and a counter, so a new opening never merges into an older incident
+    // and the event can be resolved even when its trigger was held back
+    std::shared_ptr<PagerDutyEvent> create_event(const pd_severity severity, const String &summary, const String &source,
+                                                 bool simulated = false);
+    // True while actions skipped by the open breaker wait to be sent
+    bool pending();
+    // Sends the oldest waiting action once the breaker lets a request through
+    bool send_pending();
+    // Actions dropped because the pending queue was full of real ones
+    unsigned long dropped();
+    // Saves the real actions still held back, so a restart does not lose them
+    bool checkpoint();
+    CircuitBreaker &circuit_breaker();
 
 private:
     String routing_key;
     Client *client;
+    CircuitBreaker breaker;
+    pd_pending_queue pending_actions;
+    String boot_id;
+    unsigned long incidents;
+    Preferences *preferences;
+    const char *key;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "PowerManager.h"
+#include <esp_wifi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+
+String power_state_to_string(power_state state)
+{
+    switch (state)
+    {
+    case POWER_IDLE:
+        return "idle";
+    case POWER_RECONNECTING:
+        return "reconnecting";
+    case POWER_ACTIVE:
+    default:
+        return "active";
+    }
+}
+
+PowerManager::PowerManager(uint8_t door_pin, uint8_t listen_interval, wifi_power_t tx_power, uint32_t max_cpu_mhz)
+{
+    this->door_pin = door_pin;
+    this->listen_interval = listen_interval;
+    this->tx_power = tx_power;
+    this->max_cpu_mhz = max_cpu_mhz;
+    this->light_sleep = false;
+    this->task = NULL;
+    this->edge_pending = false;
+    this->edge_at = 0;
+    this->state = POWER_ACTIVE;
+    this->state_since = 0;
+    this->disconnected_at = 0;
+    this->next_attempt_at = 0;
+    this->attempts = 0;
+    memset(this->bssid, 0, sizeof(this->bssid));
+    this->channel = 0;
+    memset(&this->counters, 0, sizeof(this->counters));
+}
+
+bool PowerManager::connect()
+{
+    // The listen interval is agreed at association, so it has to be in the
+    // station config before the first one
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK)
+    {
+        return false;
+    }
+    config.sta.listen_interval = this->listen_interval;
+    return esp_wifi_set_config(WIFI_IF_STA, &config) == ESP_OK && esp_wifi_connect() == ESP_OK;
+}
+
+bool PowerManager::begin(int door_level)
+{
+    this->task = xTaskGetCurrentTaskHandle();
+    this->state_since = millis();
+    this->remember_access_point();
+
+    // Reconnection is handled here, straight to the last access point
+    WiFi.setAutoReconnect(false);
+    WiFi.setTxPower(this->tx_power);
+
+    bool configured = esp_wifi_set_ps(WIFI_PS_MAX_MODEM) == ESP_OK;
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm_config;
+    pm_config.max_freq_mhz = this->max_cpu_mhz;
+    pm_config.min_freq_mhz = getXtalFrequencyMhz();
+    // Automatic light sleep needs the tickless idle hook as well
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    pm_config.light_sleep_enable = true;
+#else
+    pm_config.light_sleep_enable = false;
+#endif
+    if (esp_pm_configure(&pm_config) == ESP_OK)
+    {
+        this->light_sleep = pm_config.light_sleep_enable;
+    }
+    else
+    {
+        configured = false;
+    }
+#else
+    // No power management in this build, so just run slower
+    setCpuFrequencyMhz(this->max_cpu_mhz);
+#endif
+
+    // Installed already if anything used attachInterrupt()
+    esp_err_t err = gpio_install_isr_service(0);
+    if ((err != ESP_OK && err != ESP_ERR_INVALID_STATE) ||
+        gpio_isr_handler_add((gpio_num_t)this->door_pin, PowerManager::on_door_edge, this) != ESP_OK ||
+        esp_sleep_enable_gpio_wakeup() != ESP_OK)
+    {
+        configured = false;
+    }
+    this->rearm(door_level);
+
+#ifdef POWER_MANAGER_DEBUG
+    Serial.printf("PowerManager: modem sleep, listen interval %u, light sleep %s\n",
+                  this->listen_interval, this->light_sleep ? "on" : "off");
+#endif
+    return configured;
+}
+
+void IRAM_ATTR PowerManager::on_door_edge(void *arg)
+{
+    PowerManager *manager = (PowerManager *)arg;
+    // Light sleep can only wake on a level, so the interrupt is level
+    // triggered too and stays off until the loop has read the door
+    gpio_intr_disable((gpio_num_t)manager->door_pin);
+    if (!manager->edge_pending)
+    {
+        manager->edge_at = millis();
+        manager->edge_pending = true;
+    }
+
+    BaseType_t woken = pdFALSE;
+    if (manager->task != NULL)
+    {
+        vTaskNotifyGiveFromISR(manager->task, &woken);
+    }
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void PowerManager::idle(unsigned long timeout_ms)
+{
+    power_state previous = this->state;
+    if (previous == POWER_ACTIVE)
+    {
+        this->enter(POWER_IDLE);
+    }
+
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms)) > 0)
+    {
+        this->counters.door_wakes++;
+    }
+    else
+    {
+        this->counters.timer_wakes++;
+    }
+
+    if (previous == POWER_ACTIVE)
+    {
+        this->enter(POWER_ACTIVE);
+    }
+}
+
+bool PowerManager::door_edge(unsigned long &edge_at)
+{
+    // The interrupt is off while an edge is pending, so nothing races us here
+    if (!this->edge_pending)
+    {
+        return false;
+    }
+    edge_at = this->edge_at;
+    this->edge_pending = false;
+    return true;
+}
+
+void PowerManager::rearm(int door_level)
+{
+    // An edge that happened since the door was read fires straight away
+    gpio_int_type_t next_level = door_level == HIGH ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+    gpio_wakeup_enable((gpio_num_t)this->door_pin, next_level);
+    gpio_intr_enable((gpio_num_t)this->door_pin);
+}
+
+void PowerManager::alert_dispatched(unsigned long edge_at)
+{
+    unsigned long latency = millis() - edge_at;
+    this->counters.last_alert_latency_ms = latency;
+    this->counters.max_alert_latency_ms = max(this->counters.max_alert_latency_ms, latency);
+}
+
+unsigned long PowerManager::reconnect()
+{
+    unsigned long now = millis();
+    if (this->state != POWER_RECONNECTING)
+    {
+        this->enter(POWER_RECONNECTING);
+        this->disconnected_at = now;
+        this->next_attempt_at = now;
+        this->attempts = 0;
+        this->counters.reconnects++;
+    }
+
+    if ((long)(now - this->next_attempt_at) >= 0)
+    {
+        this->associate(this->attempts == 0);
+        this->attempts++;
+        this->next_attempt_at = now + POWER_RECONNECT_RETRY_INTERVAL;
+    }
+    return now - this->disconnected_at;
+}
+
+bool PowerManager::reconnected()
+{
+    if (this->state != POWER_RECONNECTING)
+    {
+        return false;
+    }
+
+    unsigned long duration = millis() - this->disconnected_at;
+    this->counters.last_reconnect_ms = duration;
+    this->counters.max_reconnect_ms = max(this->counters.max_reconnect_ms, duration);
+    this->remember_access_point();
+    this->enter(POWER_ACTIVE);
+#ifdef POWER_MANAGER_DEBUG
+    Serial.printf("PowerManager: reconnected in %lums after %u attempts\n", duration, this->attempts);
+#endif
+    return true;
+}
+
+bool PowerManager::light_sleep_enabled()
+{
+    return this->light_sleep;
+}
+
+power_stats PowerManager::stats()
+{
+    power_stats current = this->counters;
+    current.residency_ms[this->state] += millis() - this->state_since;
+    return current;
+}
+
+void PowerManager::enter(power_state state)
+{
+    unsigned long now = millis();
+    this->counters.residency_ms[this->state] += now - this->state_since;
+    this->state = state;
+    this->state_since = now;
+}
+
+void PowerManager::associate(bool fast)
+{
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK)
+    {
+        return;
+    }
+
+    config.sta.listen_interval = this->listen_interval;
+    // Going straight to the last access point skips the scan, which is most
+    // of the time a reconnect takes; later attempts scan in case it moved
+    config.sta.bssid_set = fast && this->channel != 0;
+    if (config.sta.bssid_set)
+    {
+        memcpy(config.sta.bssid, this->bssid, sizeof(this->bssid));
+    }
+    config.sta.channel = config.sta.bssid_set ? this->channel : 0;
+
+#ifdef POWER_MANAGER_DEBUG
+    Serial.printf("PowerManager: reconnecting (%s)\n", config.sta.bssid_set ? "last access point" : "scan");
+#endif
+    esp_wifi_disconnect();
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+    esp_wifi_connect();
+}
+
+void PowerManager::remember_access_point()
+{
+    uint8_t *bssid = WiFi.BSSID();
+    if (bssid != NULL && WiFi.status() == WL_CONNECTED)
+    {
+        memcpy(this->bssid, bssid, sizeof(this->bssid));
+        this->channel = WiFi.channel();
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// #define POWER_MANAGER_DEBUG 1
+
+// A lost association is first retried straight to the last access point and
+// channel, then with a full scan this often
+const unsigned long POWER_RECONNECT_RETRY_INTERVAL = 5 * 1000;
+
+typedef enum
+{
+    POWER_ACTIVE = 0,
+    // Blocked until the next deadline or a door edge; the CPU light sleeps
+    // here when the build supports it
+    POWER_IDLE = 1,
+    POWER_RECONNECTING = 2,
+    POWER_STATE_COUNT = 3,
+} power_state;
+
+typedef struct
+{
+    unsigned long long residency_ms[POWER_STATE_COUNT];
+    unsigned long door_wakes;
+    unsigned long timer_wakes;
+    unsigned long reconnects;
+    unsigned long last_reconnect_ms;
+    unsigned long max_reconnect_ms;
+    // From the door edge to the alerts having been handed to every sink
+    unsigned long last_alert_latency_ms;
+    unsigned long max_alert_latency_ms;
+} power_stats;
+
+// Duty-cycles the main loop: WiFi modem sleep with a fixed listen interval,
+// automatic light sleep (when the build enables power management) while the
+// loop is blocked, and a door sensor interrupt that ends the block early so
+// an edge is handled without waiting for the next poll. Also takes over WiFi
+// reconnection so a dropped association does not mean a restart.
+class PowerManager
+{
+public:
+    PowerManager(uint8_t door_pin, uint8_t listen_interval, wifi_power_t tx_power, uint32_t max_cpu_mhz);
+    // Starts the first association with the listen interval applied; call
+    // after WiFi.begin(ssid, password, 0, NULL, false)
+    bool connect();
+    // Call from the loop task once WiFi is connected
+    bool begin(int door_level);
+    // Blocks the calling task for up to timeout_ms
+    void idle(unsigned long timeout_ms);
+    // True once per door edge, with the time the edge was seen
+    bool door_edge(unsigned long &edge_at);
+    // Arms the interrupt and light sleep wakeup for the next door edge
+    void rearm(int door_level);
+    void alert_dispatched(unsigned long edge_at);
+    // Call while the station is disconnected; returns how long it has been down
+    unsigned long reconnect();
+    // True once after a reconnect completes
+    bool reconnected();
+    bool light_sleep_enabled();
+    power_stats stats();
+
+private:
+    static void IRAM_ATTR on_door_edge(void *arg);
+    void enter(power_state state);
+    void associate(bool fast);
+    void remember_access_point();
+
+    uint8_t door_pin;
+    uint8_t listen_interval;
+    wifi_power_t tx_power;
+    uint32_t max_cpu_mhz;
+    bool light_sleep;
+
+    TaskHandle_t task;
+    volatile bool edge_pending;
+    volatile unsigned long edge_at;
+
+    power_state state;
+    unsigned long state_since;
+    unsigned long disconnected_at;
+    unsigned long next_attempt_at;
+    unsigned int attempts;
+    uint8_t bssid[6];
+    uint8_t channel;
+
+    power_stats counters;
+};
+
+String power_state_to_string(power_state state);
+#endif
@@ -0,0 +1,199 @@
+#include "TelegramPoller.h"
+
+TelegramPoller::TelegramPoller(const char *token, const char *host, uint16_t port, unsigned int long_poll_timeout)
+{
+    this->token = token;
+    this->host = host;
+    this->port = port;
+    this->long_poll_timeout = long_poll_timeout;
+    // Must outlast the server side long poll
+    this->response_timeout = (long_poll_timeout + 10) * 1000UL;
+    this->offset = 0;
+    this->queue = NULL;
+    memset(&this->poller_stats, 0, sizeof(this->poller_stats));
+
+    // Only these fields of each update are ever stored
+    this->filter["update_id"] = true;
+    this->filter["message"]["text"] = true;
+    this->filter["message"]["chat"]["id"] = true;
+    this->filter["message"]["from"]["first_name"] = true;
+}
+
+void TelegramPoller::begin(int64_t last_update_id, uint32_t stack_size, UBaseType_t priority, BaseType_t core)
+{
+    this->offset = last_update_id > 0 ? last_update_id + 1 : 0;
+    attachTrustStore(this->client);
+    // Set on Stream itself, in ms, since that is what readHTTPHeaders waits
+    // on; the client's own setTimeout takes seconds on some cores and ms on
+    // others
+    this->client.Stream::setTimeout(this->response_timeout);
+    this->queue = xQueueCreate(TELEGRAM_COMMAND_QUEUE_LENGTH, sizeof(telegram_command));
+    xTaskCreatePinnedToCore(TelegramPoller::task, "telegram", stack_size, this, priority, NULL, core);
+}
+
+bool TelegramPoller::receive(telegram_command &command)
+{
+    return this->queue != NULL && xQueueReceive(this->queue, &command, 0) == pdTRUE;
+}
+
+const telegram_poller_stats &TelegramPoller::stats()
+{
+    return this->poller_stats;
+}
+
+void TelegramPoller::set_dns_cache(DnsCache *cache)
+{
+    this->client.set_dns_cache(cache);
+}
+
+void TelegramPoller::task(void *parameter)
+{
+    TelegramPoller *poller = (TelegramPoller *)parameter;
+    for (;;)
+    {
+        if (!poller->poll())
+        {
+            poller->poller_stats.errors++;
+            poller->client.stop();
+            delay(TELEGRAM_RETRY_DELAY);
+        }
+    }
+}
+
+bool TelegramPoller::poll()
+{
+    bool reused = this->client.connected();
+    if (!reused)
+    {
+#ifdef TELEGRAM_POLLER_DEBUG
+        Serial.println(F("TelegramPoller: connecting"));
+#endif
+        if (!connectHTTPClient(&this->client, this->host, this->port))
+        {
+            return false;
+        }
+    }
+
+    char request[128];
+    snprintf(request, sizeof(request), "/getUpdates?offset=%lld&timeout=%u&allowed_updates=%%5B%%22message%%22%%5D",
+             this->offset, this->long_poll_timeout);
+    this->client.print(F("GET /bot"));
+    this->client.print(this->token);
+    this->client.print(request);
+    this->client.println(F(" HTTP/1.1"));
+    this->client.print(F("Host: "));
+    this->client.println(this->host);
+    this->client.println(F("Connection: keep-alive"));
+    this->client.println();
+    this->poller_stats.polls++;
+
+    // Wait for the response here, where a closed connection is noticed at
+    // once, rather than in readHTTPHeaders which would sit out the timeout
+    unsigned long sent_at = millis();
+    while (!this->client.available())
+    {
+        if (!this->client.connected())
+        {
+            this->client.stop();
+            // Telegram closing a kept-alive connection between polls is
+            // routine; reconnect straight away instead of backing off
+            return reused && this->poll();
+        }
+        if (millis() - sent_at >= this->response_timeout)
+        {
+            return false;
+        }
+        delay(10);
+    }
+
+    // A body delimited by closing the connection would defeat keep-alive
+    long content_length;
+    int status = readHTTPHeaders(&this->client, content_length);
+    if (status == 0 || content_length == HTTP_LENGTH_UNTIL_CLOSE)
+    {
+        return false;
+    }
+
+    HTTPBodyStream body(&this->client, content_length);
+    if (status != 200)
+    {
+#ifdef TELEGRAM_POLLER_DEBUG
+        Serial.printf("TelegramPoller: HTTP %d\n", status);
+#endif
+        body.drain();
+        return false;
+    }
+
+    return this->read_updates(body) && body.drain();
+}
+
+// Skips JSON whitespace and returns the next character without consuming it
+static int peek_token(HTTPBodyStream &body)
+{
+    int c = body.timedPeek();
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+        body.read();
+        c = body.timedPeek();
+    }
+    return c;
+}
+
+bool TelegramPoller::read_updates(HTTPBodyStream &body)
+{
+    // {"ok":true,"result":[{update},{update},...]}, with any whitespace
+    // around the separators
+    if (!body.find("\"result\"") || peek_token(body) != ':' || body.read() < 0 || peek_token(body) != '[' ||
+        body.read() < 0)
+    {
+        return false;
+    }
+    if (peek_token(body) == ']')
+    {
+        return true;
+    }
+
+    while (true)
+    {
+        StaticJsonDocument<TELEGRAM_UPDATE_DOC_SIZE> update;
+        DeserializationError error = deserializeJson(update, body, DeserializationOption::Filter(this->filter));
+        int64_t update_id = update["update_id"] | (int64_t)-1;
+
+        if (error)
+        {
+            // An update too big for the document would be fetched again
+            // forever, so skip it; anything else is retried
+            if (error == DeserializationError::NoMemory && update_id >= this->offset)
+            {
+                this->offset = update_id + 1;
+                this->poller_stats.dropped++;
+            }
+            // The stream is no longer aligned on an update; the caller reconnects
+            return false;
+        }
+
+        // Acknowledged to Telegram by the offset of the next request
+        bool fresh = update_id >= this->offset;
+        if (fresh)
+        {
+            this->offset = update_id + 1;
+        }
+
+        const char *text = update["message"]["text"];
+        if (fresh && text != NULL)
+        {
+            telegram_command command = {};
+            command.update_id = update_id;
+            snprintf(command.chat_id, sizeof(command.chat_id), "%lld", update["message"]["chat"]["id"].as<int64_t>());
+            strlcpy(command.from_name, update["message"]["from"]["first_name"] | "", sizeof(command.from_name));
+            strlcpy(command.text, text, sizeof(command.text));
+            xQueueSend(this->queue, &command, portMAX_DELAY);
+            this->poller_stats.updates++;
+        }
+
+        if (!body.findUntil(",", "]"))
+        {
+            return true;
+        }
+    }
+}
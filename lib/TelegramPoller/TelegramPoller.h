@@ -0,0 +1,68 @@
+#ifndef TELEGRAM_POLLER_H
+#define TELEGRAM_POLLER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFiClientSecure.h>
+#include "../HttpUtils/HttpUtils.h"
+#include "../TrustStore/TrustStore.h"
+#include "../DnsCache/DnsCache.h"
+
+// #define TELEGRAM_POLLER_DEBUG 1
+
+#define TELEGRAM_COMMAND_CHAT_ID_LENGTH 24
+#define TELEGRAM_COMMAND_FROM_LENGTH 33
+#define TELEGRAM_COMMAND_TEXT_LENGTH 160
+#define TELEGRAM_COMMAND_QUEUE_LENGTH 8
+// Holds one filtered update; anything larger is dropped
+#define TELEGRAM_UPDATE_DOC_SIZE 512
+
+// One incoming message, copied out of the getUpdates stream
+typedef struct
+{
+    int64_t update_id;
+    char chat_id[TELEGRAM_COMMAND_CHAT_ID_LENGTH];
+    char from_name[TELEGRAM_COMMAND_FROM_LENGTH];
+    char text[TELEGRAM_COMMAND_TEXT_LENGTH];
+} telegram_command;
+
+const unsigned long TELEGRAM_RETRY_DELAY = 5 * 1000;
+
+typedef struct
+{
+    unsigned long polls;
+    unsigned long updates;
+    unsigned long dropped;
+    unsigned long errors;
+} telegram_poller_stats;
+
+// Holds a single long-poll getUpdates connection open on its own task and
+// parses updates straight off the socket, one at a time, into fixed-size
+// command records handed to the main loop through a queue.
+class TelegramPoller
+{
+public:
+    TelegramPoller(const char *token, const char *host, uint16_t port, unsigned int long_poll_timeout);
+    void begin(int64_t last_update_id, uint32_t stack_size, UBaseType_t priority, BaseType_t core);
+    bool receive(telegram_command &command);
+    const telegram_poller_stats &stats();
+    void set_dns_cache(DnsCache *cache);
+
+private:
+    static void task(void *parameter);
+    bool poll();
+    bool read_updates(HTTPBodyStream &body);
+
+    const char *token;
+    const char *host;
+    uint16_t port;
+    unsigned int long_poll_timeout;
+    // ms to wait for each response, long poll included
+    unsigned long response_timeout;
+    int64_t offset;
+    DnsCachedSecureClient client;
+    QueueHandle_t queue;
+    StaticJsonDocument<192> filter;
+    telegram_poller_stats poller_stats;
+};
+#endif
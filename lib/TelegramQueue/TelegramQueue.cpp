@@ -0,0 +1,138 @@
+#include "TelegramQueue.h"
+
+TelegramQueue::TelegramQueue(UniversalTelegramBot &bot, size_t capacity, float rate_per_second, float burst)
+{
+    this->bot = &bot;
+    this->capacity = capacity;
+    this->rate_per_second = rate_per_second;
+    this->burst = burst;
+    this->tokens = burst;
+    this->last_refill = millis();
+    this->backoff_ms = 0;
+    this->backed_off_at = 0;
+    memset(&this->queue_stats, 0, sizeof(this->queue_stats));
+}
+
+void TelegramQueue::send(const String &chat_id, const String &text, tg_message_priority priority)
+{
+    this->queue_stats.enqueued++;
+
+    if (priority == TG_PRIORITY_REPLY)
+    {
+        // Fold into a reply that is still waiting for the same chat
+        for (auto &pending : this->replies)
+        {
+            if (pending.chat_id == chat_id &&
+                pending.text.length() + strlen(TELEGRAM_MERGE_SEPARATOR) + text.length() <= TELEGRAM_MAX_MESSAGE_LENGTH)
+            {
+                pending.text += TELEGRAM_MERGE_SEPARATOR + text;
+                this->queue_stats.merged++;
+                return;
+            }
+        }
+    }
+
+    if (this->depth() >= this->capacity)
+    {
+        this->drop_oldest();
+    }
+
+    tg_outbound_message message = {chat_id, text, millis(), 0};
+    if (priority == TG_PRIORITY_ALERT)
+    {
+        this->alerts.push_back(message);
+    }
+    else
+    {
+        this->replies.push_back(message);
+    }
+    this->queue_stats.max_depth = max(this->queue_stats.max_depth, this->depth());
+}
+
+void TelegramQueue::drop_oldest()
+{
+    // Replies are expendable; only drop an alert when there is nothing else
+    std::deque<tg_outbound_message> &victims = this->replies.empty() ? this->alerts : this->replies;
+    if (victims.empty())
+    {
+        return;
+    }
+#ifdef TELEGRAM_QUEUE_DEBUG
+    Serial.println("TelegramQueue: queue full, dropping: " + victims.front().text);
+#endif
+    victims.pop_front();
+    this->queue_stats.dropped++;
+}
+
+bool TelegramQueue::refill()
+{
+    unsigned long now = millis();
+    this->tokens = min(this->burst, this->tokens + (now - this->last_refill) * this->rate_per_second / 1000.0f);
+    this->last_refill = now;
+
+    if (this->backoff_ms > 0 && now - this->backed_off_at < this->backoff_ms)
+    {
+        return false;
+    }
+    return this->tokens >= 1.0f;
+}
+
+void TelegramQueue::process()
+{
+    if (this->depth() == 0 || !this->refill())
+    {
+        return;
+    }
+
+    std::deque<tg_outbound_message> &source = this->alerts.empty() ? this->replies : this->alerts;
+    tg_outbound_message &message = source.front();
+    message.attempts++;
+    this->tokens -= 1.0f;
+
+    if (this->bot->sendMessage(message.chat_id, message.text))
+    {
+        unsigned long latency = millis() - message.enqueued_at;
+        this->queue_stats.sent++;
+        this->queue_stats.total_latency_ms += latency;
+        this->queue_stats.max_latency_ms = max(this->queue_stats.max_latency_ms, latency);
+        this->backoff_ms = 0;
+        source.pop_front();
+        return;
+    }
+
+    // UniversalTelegramBot does not expose the HTTP status, so treat every
+    // failure as a possible 429 and back off before touching the API again
+    this->backoff_ms = this->backoff_ms == 0 ? TELEGRAM_QUEUE_MIN_BACKOFF : min(this->backoff_ms * 2, TELEGRAM_QUEUE_MAX_BACKOFF);
+    this->backed_off_at = millis();
+    this->tokens = 0;
+#ifdef TELEGRAM_QUEUE_DEBUG
+    Serial.printf("TelegramQueue: send failed (attempt %u), backing off %lums\n", message.attempts, this->backoff_ms);
+#endif
+
+    if (message.attempts >= TELEGRAM_QUEUE_MAX_ATTEMPTS)
+    {
+        this->queue_stats.failed++;
+        source.pop_front();
+    }
+}
+
+bool TelegramQueue::flush(unsigned long timeout_ms)
+{
+    unsigned long started = millis();
+    while (this->depth() > 0 && millis() - started < timeout_ms)
+    {
+        this->process();
+        delay(10);
+    }
+    return this->depth() == 0;
+}
+
+size_t TelegramQueue::depth()
+{
+    return this->alerts.size() + this->replies.size();
+}
+
+const tg_queue_stats &TelegramQueue::stats()
+{
+    return this->queue_stats;
+}
@@ -0,0 +1,74 @@
+#ifndef TELEGRAM_QUEUE_H
+#define TELEGRAM_QUEUE_H
+
+#include <Arduino.h>
+#include <deque>
+#include <UniversalTelegramBot.h>
+
+// #define TELEGRAM_QUEUE_DEBUG 1
+
+// Telegram rejects messages longer than this
+#define TELEGRAM_MAX_MESSAGE_LENGTH 4096
+#define TELEGRAM_MERGE_SEPARATOR "\n\n"
+
+// Failed sends (including 429s) back off exponentially between these bounds
+const unsigned long TELEGRAM_QUEUE_MIN_BACKOFF = 1000;
+const unsigned long TELEGRAM_QUEUE_MAX_BACKOFF = 60 * 1000;
+#define TELEGRAM_QUEUE_MAX_ATTEMPTS 5
+
+typedef enum
+{
+    TG_PRIORITY_ALERT = 0,
+    TG_PRIORITY_REPLY = 1,
+} tg_message_priority;
+
+typedef struct
+{
+    String chat_id;
+    String text;
+    unsigned long enqueued_at;
+    unsigned int attempts;
+} tg_outbound_message;
+
+typedef struct
+{
+    unsigned long enqueued;
+    unsigned long merged;
+    unsigned long sent;
+    unsigned long failed;
+    unsigned long dropped;
+    unsigned long total_latency_ms;
+    unsigned long max_latency_ms;
+    size_t max_depth;
+} tg_queue_stats;
+
+// Outbound messages are sent one per process() call, alerts ahead of replies,
+// paced by a token bucket so bursts stay under Telegram's rate limits.
+// Replies queued for the same chat are merged into a single message.
+class TelegramQueue
+{
+public:
+    TelegramQueue(UniversalTelegramBot &bot, size_t capacity, float rate_per_second, float burst);
+    void send(const String &chat_id, const String &text, tg_message_priority priority);
+    void process();
+    bool flush(unsigned long timeout_ms);
+    size_t depth();
+    const tg_queue_stats &stats();
+
+private:
+    bool refill();
+    void drop_oldest();
+
+    UniversalTelegramBot *bot;
+    std::deque<tg_outbound_message> alerts;
+    std::deque<tg_outbound_message> replies;
+    size_t capacity;
+    float rate_per_second;
+    float burst;
+    float tokens;
+    unsigned long last_refill;
+    unsigned long backoff_ms;
+    unsigned long backed_off_at;
+    tg_queue_stats queue_stats;
+};
+#endif
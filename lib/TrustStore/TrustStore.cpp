@@ -0,0 +1,6 @@
+#include "TrustStore.h"
+
+void attachTrustStore(WiFiClientSecure &client)
+{
+    client.setCACertBundle(ca_bundle_start);
+}
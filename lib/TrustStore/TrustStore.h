@@ -0,0 +1,16 @@
+#ifndef TRUST_STORE_H
+#define TRUST_STORE_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+// DER CA bundle generated from certs/*.pem by tools/gen_ca_bundle.py and
+// linked into flash by board_build.embed_files (see platformio.ini)
+extern const uint8_t ca_bundle_start[] asm("_binary_certs_x509_crt_bundle_bin_start");
+
+// Points the client at the shared bundle. Trust anchors are looked up by
+// subject during the handshake, so no PEM is parsed and no per-client copy
+// of the CA certificates is kept in RAM.
+void attachTrustStore(WiFiClientSecure &client);
+
+#endif
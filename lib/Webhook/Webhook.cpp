@@ -1,20 +1,54 @@
 #include "Webhook.h"
 
-Webhook::Webhook(const bool ssl, const char *hostname, const uint16_t port, const char *path)
+Webhook::Webhook(const bool ssl, const char *hostname, const uint16_t port, const char *path, DnsCache *dns_cache)
 {
-    WiFiClient *client = (ssl) ? new WiFiClientSecure() : new WiFiClient();
+    WiFiClient *client;
+    if (ssl)
+    {
+        DnsCachedSecureClient *secure_client = new DnsCachedSecureClient(dns_cache);
+        attachTrustStore(*secure_client);
+        client = secure_client;
+    }
+    else
+    {
+        client = new DnsCachedClient(dns_cache);
+    }
     this->client = client;
     this->hostname = hostname;
     this->port = port;
     this->path = path;
+    this->pending_trigger = false;
+    this->preferences = NULL;
+    this->key = NULL;
+}
+
+void Webhook::begin(Preferences &preferences, const char *key)
+{
+    this->preferences = &preferences;
+    this->key = key;
+    if (preferences.getBool(key, false))
+    {
+        this->pending_trigger = true;
+        // Restored once; still held back at the next restart, it is saved again
+        preferences.remove(key);
+    }
 }
 
 trigger_webhook_status Webhook::trigger_webhook(String &body)
 {
+    if (!this->breaker.allow())
+    {
+        this->pending_trigger = true;
+        return CIRCUIT_OPEN;
+    }
+    this->pending_trigger = false;
+
     if (!this->client->connected())
     {
-        if (!client->connect(this->hostname, this->port))
+        if (!connectHTTPClient(this->client, this->hostname, this->port))
         {
+            this->breaker.record_failure();
+            this->pending_trigger = true;
             return UNABLE_CONNECT;
         }
     }
@@ -31,7 +65,52 @@ trigger_webhook_status Webhook::trigger_webhook(String &body)
     this->client->println();
 
     String headers;
-    readHTTPAnswer(this->client, body, headers);
+    unsigned long started = millis();
+    if (!readHTTPAnswer(this->client, body, headers, this->breaker.timeout()))
+    {
+        // Drop the connection so a late answer is not read as the next response
+        this->client->stop();
+        this->breaker.record_failure();
+        this->pending_trigger = true;
+        return NO_RESPONSE;
+    }
+
+    // "HTTP/1.1 200 OK"
+    int status = headers.substring(headers.indexOf(' ') + 1).toInt();
+    this->breaker.record_http_status(status, millis() - started);
+    if (status < 200 || status >= 300)
+    {
+        this->pending_trigger = http_status_is_failure(status);
+        return BAD_STATUS;
+    }
 
     return SUCCESS;
+}
+
+bool Webhook::pending()
+{
+    return this->pending_trigger;
+}
+
+trigger_webhook_status Webhook::send_pending(String &body)
+{
+    if (!this->pending_trigger || !this->breaker.ready())
+    {
+        return CIRCUIT_OPEN;
+    }
+    return this->trigger_webhook(body);
+}
+
+bool Webhook::checkpoint()
+{
+    if (this->preferences == NULL)
+    {
+        return false;
+    }
+    return !this->pending_trigger || this->preferences->putBool(this->key, true) == 1;
+}
+
+CircuitBreaker &Webhook::circuit_breaker()
+{
+    return this->breaker;
 }
\ No newline at end of file
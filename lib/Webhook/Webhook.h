@@ -3,26 +3,50 @@
 
 #include <Arduino.h>
 #include <Client.h>
+#include <Preferences.h>
 #include <WiFiClient.h>
 #include <WiFiClientSecure.h>
 #include "../HttpUtils/HttpUtils.h"
+#include "../TrustStore/TrustStore.h"
+#include "../CircuitBreaker/CircuitBreaker.h"
+#include "../DnsCache/DnsCache.h"
 
 typedef enum
 {
     SUCCESS = 1,
     UNABLE_CONNECT = -1,
+    NO_RESPONSE = -2,
+    CIRCUIT_OPEN = -3,
+    // The endpoint answered with something other than 2xx
+    BAD_STATUS = -4,
 } trigger_webhook_status;
 
 class Webhook
 {
 public:
-    Webhook(const bool ssl, const char *hostname, const short unsigned int port, const char *path);
+    Webhook(const bool ssl, const char *hostname, const short unsigned int port, const char *path, DnsCache *dns_cache = NULL);
+    // Takes back a trigger checkpoint() saved before the last restart
+    void begin(Preferences &preferences, const char *key);
+    // A trigger skipped by the open breaker, or failed in a way worth
+    // retrying, is held back for send_pending()
     trigger_webhook_status trigger_webhook(String &body);
+    // True while a held back trigger waits to be sent
+    bool pending();
+    // Sends the held back trigger once the breaker lets a probe through
+    trigger_webhook_status send_pending(String &body);
+    // Saves a held back trigger, so a restart does not lose it
+    bool checkpoint();
+    CircuitBreaker &circuit_breaker();
 
 private:
     const char *hostname;
     short unsigned int port = 80;
     const char *path;
     WiFiClient *client;
+    CircuitBreaker breaker;
+    // Triggers carry no payload, so one flag covers every skipped one
+    bool pending_trigger;
+    Preferences *preferences;
+    const char *key;
 };
 #endif
\ No newline at end of file
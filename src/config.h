@@ -21,12 +21,32 @@ const unsigned int WIFI_CONNECT_CHECK_INTERVAL = SECOND;
 #define TG_ENABLED
 #define TG_BOT_TOKEN "..."
 #define TG_OWNER_CHAT_ID "..."
-const unsigned long TG_BOT_INTERVAL = 5 * SECOND;
+// Incoming updates are long-polled on their own task; point TG_API_HOST at a
+// local Bot API stand-in to test without Telegram
+#define TG_API_HOST "api.telegram.org"
+#define TG_API_PORT 443
+const unsigned int TG_LONG_POLL_TIMEOUT = 25; // seconds
+#define TG_POLL_TASK_STACK_SIZE 12288
+#define TG_POLL_TASK_PRIORITY 1
+#define TG_POLL_TASK_CORE 0
+// Outbound messages are paced to stay under Telegram's ~1 message/second per chat limit
+const size_t TG_QUEUE_CAPACITY = 16;
+const float TG_SEND_RATE = 1.0;
+const float TG_SEND_BURST = 3.0;
+const unsigned long TG_QUEUE_FLUSH_TIMEOUT = 15 * SECOND;
+// How long /restart waits for a yes/no
+const unsigned long TG_CONFIRM_TIMEOUT = 60 * SECOND;
+
+// Before a restart, PagerDuty and the webhook get this long to send what they
+// hold back; the rest is saved to NVS and sent after the restart
+const unsigned long SINK_FLUSH_TIMEOUT = 10 * SECOND;
+const unsigned long SINK_FLUSH_INTERVAL = 100;
 
 // BLE Key Fobs
 // #define BLE_ENABLED
 #define BLE_SCAN_DURATION 5
 #define BLE_MAX_RSSI -80
+const unsigned long BLE_SCAN_POLL_INTERVAL = 100;
 std::vector<String> keyFobs = {};
 
 // Webhook
@@ -39,6 +59,28 @@ std::vector<String> keyFobs = {};
 // Device
 #define DEVICE_NAME "garage-door-alerter"
 
+// DNS
+// Sink addresses are cached for their DNS TTL and refreshed on this task before they expire
+#define DNS_TASK_STACK_SIZE 4096
+#define DNS_TASK_PRIORITY 1
+#define DNS_TASK_CORE 0
+
+// Time (POSIX TZ string, e.g. "GMT0BST,M3.5.0/1,M10.5.0" for the UK)
+#define NTP_SERVER "pool.ntp.org"
+#define TIMEZONE "UTC0"
+
+// Event history
+// Stored in the (otherwise unused) spiffs data partition so existing devices can be updated over the air
+#define HISTORY_PARTITION_LABEL "spiffs"
+const size_t HISTORY_QUERY_LIMIT = 50;
+
+// Door analytics
+// Openings that overlap this local-time window count as "left open overnight"
+#define OVERNIGHT_START_HOUR 22
+#define OVERNIGHT_END_HOUR 6
+// Saved to NVS at most this often (and before a restart) to limit flash wear
+const unsigned long ANALYTICS_CHECKPOINT_INTERVAL = 60 * 60 * SECOND;
+
 #define DOOR_SENSOR_PIN 13
 #define DOOR_OPENED_LED 25
 #define DOOR_CLOSED_LED 26
@@ -46,6 +88,69 @@ const unsigned long DOOR_CHECK_INTERVAL = 2 * SECOND;
 const unsigned long long DEVICE_TTL = 30LL * 24LL * 60LL * 60LL * SECOND;
 const bool STEALTH_MODE = true;
 
+// Fleet
+// Alerters on the same LAN share their status over UDP multicast (/fleet).
+// Nodes watching the same door share a FLEET_ZONE and elect one of them to
+// send each alert, so an event seen by several nodes only alerts once.
+// #define FLEET_ENABLED
+#define FLEET_GROUP "home"
+// Shared by every node of the group; datagrams not signed with it are ignored
+#define FLEET_SECRET "..."
+#define FLEET_ZONE "garage"
+#define FLEET_MULTICAST_ADDRESS "239.255.42.99"
+#define FLEET_PORT 4242
+const unsigned long FLEET_HEARTBEAT_INTERVAL = 10 * SECOND;
+const unsigned long FLEET_ELECTION_WINDOW = 300;
+// A claim this recent means another node saw the event first; covers the
+// sensing skew between nodes polling the same door
+const unsigned long FLEET_CLAIM_TTL = 3 * DOOR_CHECK_INTERVAL;
+
+// OTA updates
+// Compressed / delta updates are received on OTA_PATCH_PORT (see tools/ota_patch.py)
+#define OTA_PATCH_PORT 3233
+// Patches must be signed with this (ota_patch.py --secret); none are accepted while it is empty
+#define OTA_SECRET "..."
+// Updates are received on core 0 below the main loop's priority
+#define OTA_TASK_STACK_SIZE 8192
+#define OTA_TASK_PRIORITY tskIDLE_PRIORITY
+#define OTA_TASK_CORE 0
+const unsigned long OTA_TASK_INTERVAL = 50;
+// Pause after every flash write so the sensing loop is never starved
+const unsigned long OTA_FLASH_WRITE_THROTTLE = 2;
+
+// Low power
+// Duty-cycles the device for battery or PoE-budget installs: WiFi modem sleep
+// waking every LOW_POWER_LISTEN_INTERVAL beacons (keep it a multiple of the
+// access point's DTIM period), light sleep between loop deadlines when the
+// build has CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE, and a door
+// sensor interrupt that wakes the loop on an edge. A dropped WiFi connection
+// is reconnected instead of restarting. tools/energy_model.py estimates the
+// average current and worst-case alert latency of a configuration.
+// #define LOW_POWER_ENABLED
+#define LOW_POWER_LISTEN_INTERVAL 3
+#define LOW_POWER_TX_POWER WIFI_POWER_11dBm
+// Only the ceiling when the build has power management: handshakes finish
+// sooner at full speed and the CPU scales down while idle anyway
+#define LOW_POWER_CPU_MHZ 240
+// Longest the loop blocks with nothing due; door edges end it early
+const unsigned long LOW_POWER_IDLE_INTERVAL = SECOND;
+// Used instead while messages are queued or commands are running
+const unsigned long LOW_POWER_BUSY_INTERVAL = 20;
+// WiFi down for longer than this still restarts the device
+const unsigned long LOW_POWER_RECONNECT_TIMEOUT = 2 * 60 * SECOND;
+
+// Load testing
+// Points every sink at tools/sink_standin.py on SINK_STANDIN_ADDRESS and adds
+// /burst <n>, which pushes n open/close pairs through the real alert path and
+// reports latency percentiles. The stand-in's CA (sink_standin.py
+// --make-certs) goes in certs/loadtest/, which only builds with this defined
+// bundle.
+// #define LOAD_TEST_ENABLED
+#define SINK_STANDIN_ADDRESS "192.168.1.50"
+const long LOAD_TEST_MAX_BURST = 200;
+const unsigned long LOAD_TEST_EVENT_GAP = 100;
+const unsigned long LOAD_TEST_DRAIN_TIMEOUT = 60 * SECOND;
+
 // Enable debug?
 // #define DEBUG
 
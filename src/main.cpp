@@ -5,6 +5,15 @@
 #include <WiFiClientSecure.h>
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
+#include "OtaUpdater.h"
+#include "HttpUtils.h"
+#include "CircuitBreaker.h"
+#include "TrustStore.h"
+#include "DnsCache.h"
+#include "EventHistory.h"
+#include "DoorAnalytics.h"
+#include "DoorMonitor.h"
+#include <time.h>
 
 #ifdef BLE_ENABLED
 #include "BLEDeviceScanner.h"
@@ -16,48 +25,97 @@
 #define DEBUG_PRINT(x)
 #endif
 
+DnsCache dns_cache;
+
 #ifdef TG_ENABLED
 #include <UniversalTelegramBot.h>
-unsigned long tg_bot_lasttime;
-WiFiClientSecure tg_secured_client;
+#include "TelegramQueue.h"
+#include "CommandEngine.h"
+#include "TelegramPoller.h"
+#include "DoorSimulation.h"
+DnsCachedSecureClient tg_secured_client(&dns_cache);
 UniversalTelegramBot bot(TG_BOT_TOKEN, tg_secured_client);
+TelegramPoller tg_poller(TG_BOT_TOKEN, TG_API_HOST, TG_API_PORT, TG_LONG_POLL_TIMEOUT);
+int64_t tg_last_update_id;
+TelegramQueue tg_queue(bot, TG_QUEUE_CAPACITY, TG_SEND_RATE, TG_SEND_BURST);
+CommandEngine command_engine;
 #endif
 
 #ifdef PD_ENABLED
 #include "PagerDuty.h"
-WiFiClientSecure pd_secured_client;
+DnsCachedSecureClient pd_secured_client(&dns_cache);
 PagerDuty pg(PD_ROUTING_KEY, pd_secured_client);
-std::shared_ptr<PagerDutyEvent> current_pg_event;
 #endif
 
 #ifdef WEBHOOK_ENABLED
 #include "Webhook.h"
-Webhook webhook(WEBHOOK_SSL, WEBHOOK_HOSTNAME, WEBHOOK_PORT, WEBHOOK_PATH);
+Webhook webhook(WEBHOOK_SSL, WEBHOOK_HOSTNAME, WEBHOOK_PORT, WEBHOOK_PATH, &dns_cache);
 #endif
 
 #ifdef BLE_ENABLED
 auto bleDeviceScanner = new BLEDeviceScanner();
 #endif
 
+#ifdef FLEET_ENABLED
+#include "Fleet.h"
+Fleet fleet(FLEET_GROUP, FLEET_SECRET, DEVICE_NAME, FLEET_ZONE, FLEET_MULTICAST_ADDRESS, FLEET_PORT,
+            FLEET_HEARTBEAT_INTERVAL, FLEET_ELECTION_WINDOW, FLEET_CLAIM_TTL);
+#endif
+
+#ifdef LOW_POWER_ENABLED
+#include "PowerManager.h"
+PowerManager power_manager(DOOR_SENSOR_PIN, LOW_POWER_LISTEN_INTERVAL, LOW_POWER_TX_POWER, LOW_POWER_CPU_MHZ);
+#endif
+
+OtaUpdater ota_updater(OTA_PATCH_PORT, OTA_SECRET);
+EventHistory event_history(HISTORY_PARTITION_LABEL);
+DoorMonitor door_monitor(DOOR_SENSOR_PIN, DOOR_CHECK_INTERVAL);
+DoorAnalytics door_analytics(OVERNIGHT_START_HOUR, OVERNIGHT_END_HOUR, ANALYTICS_CHECKPOINT_INTERVAL);
+
 Preferences preferences;
 #define PREFERENCE_NS "garage-door"
 #define PREFERENCE_RESTART_REASON_KEY "restart_reason"
+#define PREFERENCE_TG_UPDATE_KEY "tg_update_id"
+#define PREFERENCE_ANALYTICS_KEY "analytics"
+#define PREFERENCE_PD_PENDING_KEY "pd_pending"
+#define PREFERENCE_WEBHOOK_PENDING_KEY "wh_pending"
 
-unsigned long door_check_lasttime;
 unsigned long startup_time;
 unsigned long door_event_counter;
 
 bool wifi_connected;
-int current_door_state;
-int last_door_state;
 bool restart_flag;
-bool keyFobPresent;
+
+// Alerting state of one stream of door events. /test and /burst use their
+// own, so a simulated close never resolves the incident of a real open;
+// DoorSimulation makes sure only one of them uses it at a time.
+typedef struct
+{
+  // Simulated events are not put to a fleet election
+  bool simulated;
+  bool key_fob_present;
+#ifdef PD_ENABLED
+  std::shared_ptr<PagerDutyEvent> pg_event;
+#endif
+} door_alerts;
+
+door_alerts sensor_alerts = {false};
+door_alerts simulated_alerts = {true};
+
+volatile bool espota_in_progress;
+volatile bool ota_restart_pending;
+// Written by the OTA task, read by the loop once ota_restart_pending is set
+String ota_restart_summary;
+SemaphoreHandle_t ota_restart_mutex;
+unsigned long ota_started;
+unsigned long ota_max_sensing_gap;
 
 const String DOOR_OPENING_MSG = "The garage door has been OPENED.";
 const String DOOR_OPENING_MSG_WITH_KEY_FOB = "The garage door has been OPENED.\n\nKey fob detected - Will not be invoking PagerDuty or Webhook";
 const String DOOR_OPEN_MSG = "The garage door is currently OPEN.";
 const String DOOR_CLOSING_MSG = "The garage door has been CLOSED.";
 const String DOOR_CLOSED_MSG = "The garage door is currently CLOSED.";
+const String PD_HELD_BACK_MSG = "PagerDuty is not reachable - The alert will be sent once it answers again.";
 
 String millisToString(unsigned long long ms)
 {
@@ -75,12 +133,88 @@ String millisToString(unsigned long long ms)
          (String)(mod_minutes) + " minutes, " +
          (String)(mod_seconds) + " seconds";
 }
+// Compact form for short durations, e.g. "1h 5m" or "42s"
+String durationToString(unsigned long seconds)
+{
+  if (seconds >= 60 * 60)
+  {
+    return (String)(seconds / 3600) + "h " + (String)(seconds / 60 % 60) + "m";
+  }
+  if (seconds >= 60)
+  {
+    return (String)(seconds / 60) + "m " + (String)(seconds % 60) + "s";
+  }
+  return (String)seconds + "s";
+}
+
+bool time_synced()
+{
+  // Anything before 2021 means NTP has not answered yet
+  return time(nullptr) > 1609459200;
+}
+
+String timestampToString(uint32_t timestamp)
+{
+  time_t t = timestamp;
+  struct tm local;
+  char buffer[20];
+  localtime_r(&t, &local);
+  strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+  return String(buffer);
+}
+
+// Accepts a unix timestamp, YYYY-MM-DD or YYYY-MM-DDTHH:MM (local time)
+bool parseTimestamp(const String &value, bool end_of_day, uint32_t &timestamp)
+{
+  bool digits = value.length() > 0;
+  for (unsigned int i = 0; i < value.length(); i++)
+  {
+    digits = digits && isDigit(value[i]);
+  }
+  if (digits)
+  {
+    timestamp = strtoul(value.c_str(), NULL, 10);
+    return true;
+  }
+
+  struct tm local = {};
+  const char *end = strptime(value.c_str(), "%Y-%m-%dT%H:%M", &local);
+  if (end == NULL || *end != '\0')
+  {
+    local = {};
+    end = strptime(value.c_str(), "%Y-%m-%d", &local);
+    if (end == NULL || *end != '\0')
+    {
+      return false;
+    }
+    if (end_of_day)
+    {
+      local.tm_hour = 23;
+      local.tm_min = 59;
+      local.tm_sec = 59;
+    }
+  }
+  local.tm_isdst = -1;
+  timestamp = mktime(&local);
+  return true;
+}
+
 void wifi_connect()
 {
   WiFi.setHostname(DEVICE_NAME);
   WiFi.mode(WIFI_STA);
   WiFi.setTxPower(WIFI_POWER_19_5dBm);
+#ifdef LOW_POWER_ENABLED
+  // Set up the station without associating, so the first association
+  // already uses the low-power listen interval
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD, 0, NULL, false);
+  if (!power_manager.connect())
+  {
+    DEBUG_PRINT("Unable to start WiFi association");
+  }
+#else
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+#endif
 
   int duration = 0;
   while (WiFi.status() != WL_CONNECTED && duration < WIFI_CONNECT_TIMEOUT)
@@ -110,9 +244,20 @@ void wifi_connect()
   wifi_connected = true;
 }
 
+// Called from the OTA task; the loop restarts once it has seen the request
+void request_ota_restart(const String &summary)
+{
+  xSemaphoreTake(ota_restart_mutex, portMAX_DELAY);
+  ota_restart_summary = summary;
+  ota_restart_pending = true;
+  xSemaphoreGive(ota_restart_mutex);
+}
+
 void arduino_ota_setup()
 {
   ArduinoOTA.setHostname(DEVICE_NAME);
+  // The OTA task must not reboot underneath the main loop, see monitor_ota_restart()
+  ArduinoOTA.setRebootOnSuccess(false);
   ArduinoOTA
       .onStart([]()
                {
@@ -123,11 +268,21 @@ void arduino_ota_setup()
         type = "filesystem";
 
       // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
-      DEBUG_PRINT("Start updating " + type); })
+      DEBUG_PRINT("Start updating " + type);
+      ota_started = millis();
+      ota_max_sensing_gap = 0;
+      espota_in_progress = true; })
+      .onProgress([](unsigned int progress, unsigned int total)
+                  { delay(OTA_FLASH_WRITE_THROTTLE); })
       .onEnd([]()
-             { DEBUG_PRINT("\nEnd"); })
+             {
+      DEBUG_PRINT("\nEnd");
+      espota_in_progress = false;
+      request_ota_restart("espota upload in " + (String)(millis() - ota_started) + "ms"); })
       .onError([](ota_error_t error)
                {
+      espota_in_progress = false;
+      ota_max_sensing_gap = 0;
       Serial.printf("Error[%u]: ", error);
       if (error == OTA_AUTH_ERROR) DEBUG_PRINT("Auth Failed");
       else if (error == OTA_BEGIN_ERROR) DEBUG_PRINT("Begin Failed");
@@ -136,6 +291,71 @@ void arduino_ota_setup()
       else if (error == OTA_END_ERROR) DEBUG_PRINT("End Failed"); });
 
   ArduinoOTA.begin();
+  ota_updater.set_write_throttle(OTA_FLASH_WRITE_THROTTLE);
+  ota_updater.begin();
+}
+
+bool ota_in_progress()
+{
+  return espota_in_progress || ota_updater.in_progress();
+}
+
+void monitor_ota_patch()
+{
+  ota_patch_status status = ota_updater.handle();
+  if (status == OTA_PATCH_NONE)
+  {
+    return;
+  }
+
+  const ota_patch_stats &stats = ota_updater.last_stats();
+  String summary = (String)stats.payload_bytes + " bytes (" +
+                   ((stats.encoding & OTA_ENCODING_DELTA) ? "delta" : "full") +
+                   ((stats.encoding & OTA_ENCODING_ZLIB) ? ", zlib" : "") +
+                   ") -> " + (String)stats.image_bytes + " byte image in " + (String)stats.duration_ms + "ms";
+  if (status != OTA_PATCH_COMPLETE)
+  {
+    DEBUG_PRINT("OTA patch failed: " + ota_patch_status_to_string(status) + ", " + summary);
+    ota_max_sensing_gap = 0;
+    return;
+  }
+
+  DEBUG_PRINT("OTA patch applied: " + summary);
+  request_ota_restart(summary);
+}
+
+// Receives updates on the protocol core so that door sensing in loop() keeps
+// running at full rate while an image is being written.
+void ota_task(void *parameter)
+{
+  for (;;)
+  {
+    if (!ota_restart_pending)
+    {
+      ArduinoOTA.handle();
+      monitor_ota_patch();
+    }
+    delay(OTA_TASK_INTERVAL);
+  }
+}
+
+void monitor_ota_restart()
+{
+  if (!ota_restart_pending || restart_flag)
+  {
+    return;
+  }
+
+  // Door events are handled by the loop, so every alert raised during the
+  // update has been dispatched by now; queued messages are flushed on restart.
+  xSemaphoreTake(ota_restart_mutex, portMAX_DELAY);
+  String reason = "OTA update applied: " + ota_restart_summary +
+                  ", max door sensing gap " + (String)ota_max_sensing_gap + "ms";
+  xSemaphoreGive(ota_restart_mutex);
+  DEBUG_PRINT(reason);
+  preferences.putString(PREFERENCE_RESTART_REASON_KEY, reason);
+  preferences.end();
+  restart_flag = true;
 }
 
 void update_door_status_led(bool door_closed)
@@ -153,23 +373,56 @@ void update_door_status_led(bool door_closed)
   }
 }
 
-void door_opened_event()
+// Nodes watching the same door elect one of them to alert for each event
+bool fleet_should_notify(bool door_opened)
+{
+#ifdef FLEET_ENABLED
+  // No peer can be heard while the link is down, so alert; the alerts wait
+  // in the sinks until it is back
+  if (WiFi.status() == WL_CONNECTED && !fleet.elect(door_opened ? FLEET_ALERT_OPENED : FLEET_ALERT_CLOSED))
+  {
+    DEBUG_PRINT("Another fleet node is notifying");
+    return false;
+  }
+#endif
+  return true;
+}
+
+#ifdef PD_ENABLED
+// The owner should know when a page is not going out straight away
+void report_pagerduty_held_back()
+{
+#ifdef TG_ENABLED
+  if (pg.pending())
+  {
+    tg_queue.send(TG_OWNER_CHAT_ID, PD_HELD_BACK_MSG, TG_PRIORITY_ALERT);
+  }
+#endif
+}
+#endif
+
+void door_opened_event(door_alerts &alerts)
 {
   update_door_status_led(false);
 
   DEBUG_PRINT(DOOR_OPENING_MSG);
 
 #ifdef BLE_ENABLED
-  keyFobPresent = bleDeviceScanner->isBLEDeviceNearby(keyFobs);
+  alerts.key_fob_present = bleDeviceScanner->isBLEDeviceNearby(keyFobs);
 #endif
 
+  if (!alerts.simulated && !fleet_should_notify(true))
+  {
+    return;
+  }
+
 #ifdef TG_ENABLED
-  DEBUG_PRINT("Sending Telegram message");
-  bot.sendMessage(TG_OWNER_CHAT_ID, (keyFobPresent ? DOOR_OPENING_MSG_WITH_KEY_FOB : DOOR_OPENING_MSG));
-  DEBUG_PRINT("Sent Telegram message");
+  DEBUG_PRINT("Queueing Telegram message");
+  tg_queue.send(TG_OWNER_CHAT_ID, (alerts.key_fob_present ? DOOR_OPENING_MSG_WITH_KEY_FOB : DOOR_OPENING_MSG), TG_PRIORITY_ALERT);
+  DEBUG_PRINT("Queued Telegram message");
 #endif
 
-  if (keyFobPresent)
+  if (alerts.key_fob_present)
   {
     return;
   }
@@ -190,27 +443,45 @@ void door_opened_event()
 
 #ifdef PD_ENABLED
   DEBUG_PRINT("Creating PagerDuty event");
-  current_pg_event = pg.create_event(CRITICAL, "Garage Door Opened", PD_SOURCE);
+  alerts.pg_event = pg.create_event(CRITICAL, alerts.simulated ? "Garage Door Opened (test)" : "Garage Door Opened", PD_SOURCE, alerts.simulated);
   DEBUG_PRINT("Created PagerDuty event");
+  report_pagerduty_held_back();
 #endif
 }
 
-void door_closed_event()
+void door_closed_event(door_alerts &alerts)
 {
   update_door_status_led(true);
 
   DEBUG_PRINT(DOOR_CLOSING_MSG);
 
-  if (keyFobPresent)
+  if (alerts.key_fob_present)
+  {
+    alerts.key_fob_present = false;
+    return;
+  }
+
+#ifdef PD_ENABLED
+  // Resolved by whichever node opened the incident, whoever wins the election
+  if (alerts.pg_event.get() != NULL)
+  {
+    DEBUG_PRINT("Resolving PagerDuty event");
+    alerts.pg_event.get()->resolve();
+    alerts.pg_event.reset();
+    DEBUG_PRINT("Resolved PagerDuty event");
+    report_pagerduty_held_back();
+  }
+#endif
+
+  if (!alerts.simulated && !fleet_should_notify(false))
   {
-    keyFobPresent = false;
     return;
   }
 
 #ifdef TG_ENABLED
-  DEBUG_PRINT("Sending Telegram message");
-  bot.sendMessage(TG_OWNER_CHAT_ID, DOOR_CLOSING_MSG);
-  DEBUG_PRINT("Sent Telegram message");
+  DEBUG_PRINT("Queueing Telegram message");
+  tg_queue.send(TG_OWNER_CHAT_ID, DOOR_CLOSING_MSG, TG_PRIORITY_ALERT);
+  DEBUG_PRINT("Queued Telegram message");
 #endif
 
 #ifdef WEBHOOK_ENABLED
@@ -226,153 +497,549 @@ void door_closed_event()
     DEBUG_PRINT("Unable to invoke webhook");
   }
 #endif
+}
 
+#ifdef LOW_POWER_ENABLED
+// Held sinks park their alerts without touching the network
+void hold_sinks(bool held)
+{
 #ifdef PD_ENABLED
-  if (current_pg_event.get() != NULL)
+  pg.circuit_breaker().hold(held);
+#endif
+#ifdef WEBHOOK_ENABLED
+  webhook.circuit_breaker().hold(held);
+#endif
+}
+#endif
+
+// Alerts a sink held back while it was failing go out on its first probe
+void send_held_back_alerts()
+{
+#ifdef PD_ENABLED
+  if (pg.pending() && pg.send_pending())
   {
-    DEBUG_PRINT("Resolving PagerDuty event");
-    current_pg_event.get()->resolve();
-    current_pg_event.reset();
-    DEBUG_PRINT("Resolved PagerDuty event");
+    DEBUG_PRINT("Sent held back PagerDuty event");
+  }
+#endif
+#ifdef WEBHOOK_ENABLED
+  String webhookResponse;
+  if (webhook.pending() && webhook.send_pending(webhookResponse) == SUCCESS)
+  {
+    DEBUG_PRINT("Invoked held back webhook");
   }
 #endif
 }
 
-#ifdef TG_ENABLED
-void handleNewMessages(int numNewMessages)
+// Whether a sink holds back alerts it could still send before a restart: a
+// closed breaker is only waiting out a retry delay, an open one fails fast
+bool sink_can_flush(bool pending, CircuitBreaker &breaker)
 {
-  DEBUG_PRINT("handleNewMessages");
-  DEBUG_PRINT(String(numNewMessages));
+  return pending && (breaker.ready() || breaker.state() == BREAKER_CLOSED);
+}
 
-  for (int i = 0; i < numNewMessages; i++)
+// Gives held back alerts a last chance before a restart; whatever is still
+// held back is saved to NVS by save_held_back_alerts() and sent after it
+void flush_held_back_alerts(unsigned long timeout_ms)
+{
+  unsigned long started = millis();
+  while (WiFi.status() == WL_CONNECTED && millis() - started < timeout_ms)
   {
-    String chat_id = bot.messages[i].chat_id;
-    String text = bot.messages[i].text;
-
-    if (!chat_id.equals(TG_OWNER_CHAT_ID))
+    bool flushing = false;
+#ifdef PD_ENABLED
+    flushing |= sink_can_flush(pg.pending(), pg.circuit_breaker());
+#endif
+#ifdef WEBHOOK_ENABLED
+    flushing |= sink_can_flush(webhook.pending(), webhook.circuit_breaker());
+#endif
+    if (!flushing)
     {
-      bot.sendMessage(chat_id, "403 FORBIDDEN");
-      continue;
+      return;
     }
+    send_held_back_alerts();
+    delay(SINK_FLUSH_INTERVAL);
+  }
+}
+
+void save_held_back_alerts()
+{
+#ifdef PD_ENABLED
+  if (!pg.checkpoint())
+  {
+    DEBUG_PRINT("Unable to save held back PagerDuty events");
+  }
+#endif
+#ifdef WEBHOOK_ENABLED
+  if (!webhook.checkpoint())
+  {
+    DEBUG_PRINT("Unable to save held back webhook");
+  }
+#endif
+}
+
+// Puts the LEDs back to what the sensor reads once a simulation is over
+void rearm_after_simulation()
+{
+  update_door_status_led(digitalRead(DOOR_SENSOR_PIN) == LOW);
+}
+
+#ifdef TG_ENABLED
+void status_command(CommandSession &session)
+{
+  if (door_monitor.state() == LOW)
+  {
+    tg_queue.send(session.chat_id, DOOR_CLOSED_MSG, TG_PRIORITY_REPLY);
+  }
+  else
+  {
+    tg_queue.send(session.chat_id, DOOR_OPEN_MSG, TG_PRIORITY_REPLY);
+  }
+}
 
-    static bool confirm_restart = false;
+void simulated_door_event(bool opened)
+{
+  if (opened)
+  {
+    door_opened_event(simulated_alerts);
+  }
+  else
+  {
+    door_closed_event(simulated_alerts);
+  }
+}
+
+DoorSimulation door_simulation(simulated_door_event, rearm_after_simulation, [](const String &chat_id, const String &text)
+                               { tg_queue.send(chat_id, text, TG_PRIORITY_REPLY); });
 
-    String from_name = bot.messages[i].from_name;
-    if (from_name == "")
+void restart_command(CommandSession &session)
+{
+  switch (session.step)
+  {
+  case 0:
+    tg_queue.send(session.chat_id, "Please confirm you wish to restart the device (yes/no)?", TG_PRIORITY_REPLY);
+    session.await_input(TG_CONFIRM_TIMEOUT, 1);
+    break;
+  case 1:
+    if (session.input.equalsIgnoreCase("yes"))
     {
-      from_name = "Guest";
+      restart_flag = true;
+      tg_queue.send(session.chat_id, "Restarting...", TG_PRIORITY_REPLY);
+      preferences.putString(PREFERENCE_RESTART_REASON_KEY, "/restart command was issued by " + session.from_name);
+      preferences.end();
     }
+    break;
+  }
+}
 
-    if (confirm_restart)
-    {
-      if (text.equalsIgnoreCase("yes"))
+void history_command(CommandSession &session)
+{
+  const String &args = session.args;
+  int separator = args.indexOf(' ');
+  String from_arg = separator < 0 ? args : args.substring(0, separator);
+  String to_arg = separator < 0 ? "" : args.substring(separator + 1);
+  to_arg.trim();
+
+  uint32_t to = time(nullptr);
+  uint32_t from = to - 24 * 60 * 60;
+  if ((from_arg.length() > 0 && !parseTimestamp(from_arg, false, from)) ||
+      (to_arg.length() > 0 && !parseTimestamp(to_arg, true, to)))
+  {
+    tg_queue.send(session.chat_id, "Usage: /history [from] [to]\nTimes are YYYY-MM-DD, YYYY-MM-DDTHH:MM or unix timestamps. Defaults to the last 24 hours.", TG_PRIORITY_REPLY);
+  }
+  else
+  {
+    String lines;
+    size_t matched = 0;
+    unsigned long started = millis();
+    size_t scanned = event_history.query(from, to, [&](const history_record &record)
+                                         {
+      if (matched++ < HISTORY_QUERY_LIMIT)
       {
-        restart_flag = true;
-        bot.sendMessage(chat_id, "Restarting...");
-        preferences.putString(PREFERENCE_RESTART_REASON_KEY, "/restart command was issued by " + from_name);
-        preferences.end();
-        continue;
+        lines += "\n" + timestampToString(record.timestamp) +
+                 (record.type == HISTORY_DOOR_OPENED ? " OPENED" : " CLOSED") +
+                 ((record.flags & HISTORY_FLAG_TIME_SYNCED) ? "" : " (clock not synced)");
       }
-      confirm_restart = false;
-    }
+      return true; });
+    unsigned long duration = millis() - started;
+
+    tg_queue.send(
+        session.chat_id,
+        "Door events " + timestampToString(from) + " to " + timestampToString(to) + ": " + (String)matched +
+            (matched > HISTORY_QUERY_LIMIT ? " (showing first " + (String)HISTORY_QUERY_LIMIT + ")" : "") +
+            lines +
+            "\n\nScanned " + (String)scanned + " records in " + (String)duration + "ms",
+        TG_PRIORITY_REPLY);
+  }
+}
+
+void uptime_command(CommandSession &session)
+{
+  String uptime = millisToString(millis() - startup_time);
+  tg_queue.send(session.chat_id, uptime, TG_PRIORITY_REPLY);
+}
+
+String breakerToString(CircuitBreaker &breaker)
+{
+  const breaker_stats &stats = breaker.stats();
+  return breaker_state_to_string(breaker.state()) +
+         ", timeout " + (String)breaker.timeout() + "ms, " +
+         (String)stats.opens + " opens, " + (String)stats.short_circuits + " skipped";
+}
 
-    if (text == "/status")
+void send_stats(const String &chat_id, const String &keyFobStat)
+{
+  uint32_t heap_size = ESP.getHeapSize();
+  uint32_t free_heap = ESP.getFreeHeap();
+
+  const http_connect_stats &connect_stats = getHTTPConnectStats();
+  String handshake_avg = connect_stats.connections > 0 ? (String)(connect_stats.total_connect_ms / connect_stats.connections) : "-";
+
+  const tg_queue_stats &queue_stats = tg_queue.stats();
+  String send_latency_avg = queue_stats.sent > 0 ? (String)(queue_stats.total_latency_ms / queue_stats.sent) : "-";
+
+  const telegram_poller_stats &poller_stats = tg_poller.stats();
+  unsigned long uptime_minutes = max((millis() - startup_time) / (60 * SECOND), 1UL);
+
+  const history_stats &event_stats = event_history.stats();
+  String append_avg = event_stats.appends > 0 ? (String)(event_stats.total_append_us / event_stats.appends) : "-";
+
+  const door_analytics_state &analytics = door_analytics.state();
+  String open_avg = analytics.opens > 0 ? durationToString(analytics.total_open_ms / 1000 / analytics.opens) : "-";
+  String busiest_hours;
+  for (int hour = 0; hour < ANALYTICS_HOURS; hour++)
+  {
+    if (analytics.opens_by_hour[hour] > 0)
     {
-      if (current_door_state == LOW)
-      {
-        bot.sendMessage(chat_id, DOOR_CLOSED_MSG);
-      }
-      else
-      {
-        bot.sendMessage(chat_id, DOOR_OPEN_MSG);
-      }
+      busiest_hours += (busiest_hours.length() > 0 ? ", " : "") + (String)hour + "h " + (String)analytics.opens_by_hour[hour];
     }
+  }
+
+  dns_cache_stats dns_stats = dns_cache.stats();
+  unsigned long dns_requests = dns_stats.hits + dns_stats.stale_hits + dns_stats.misses;
+  String dns_hit_rate = dns_requests > 0 ? (String)((dns_stats.hits + dns_stats.stale_hits) * 100 / dns_requests) + "%" : "-";
+  String dns_lookup_avg = dns_stats.lookups > 0 ? (String)(dns_stats.total_lookup_ms / dns_stats.lookups) : "-";
 
-    if (text == "/test")
+  String sink_circuits;
+#ifdef PD_ENABLED
+  sink_circuits += "\nPagerDuty Circuit: " + breakerToString(pg.circuit_breaker()) +
+                   ", " + (String)pg.dropped() + " dropped";
+#endif
+#ifdef WEBHOOK_ENABLED
+  sink_circuits += "\nWebhook Circuit: " + breakerToString(webhook.circuit_breaker());
+#endif
+
+  String power;
+#ifdef LOW_POWER_ENABLED
+  power_stats power_counters = power_manager.stats();
+  unsigned long long power_total = 0;
+  for (int state = 0; state < POWER_STATE_COUNT; state++)
+  {
+    power_total += power_counters.residency_ms[state];
+  }
+  power_total = max(power_total, 1ULL);
+  for (int state = 0; state < POWER_STATE_COUNT; state++)
+  {
+    power += (power.length() > 0 ? ", " : "\nPower Residency: ") + power_state_to_string((power_state)state) + " " +
+             String(power_counters.residency_ms[state] * 100.0 / power_total, 1) + "%";
+  }
+  power += (String)(power_manager.light_sleep_enabled() ? " (light sleep when idle)" : " (no light sleep in this build)") +
+           "\nPower Wakes: " + (String)power_counters.door_wakes + " door edges, " + (String)power_counters.timer_wakes + " timers" +
+           "\nWiFi Reconnects: " + (String)power_counters.reconnects + " (last " + (String)power_counters.last_reconnect_ms + "ms, max " + (String)power_counters.max_reconnect_ms + "ms)" +
+           "\nEdge To Alert: last " + (String)power_counters.last_alert_latency_ms + "ms, max " + (String)power_counters.max_alert_latency_ms + "ms";
+#endif
+
+  tg_queue.send(
+      chat_id,
+      "Number of open door events: " + (String)door_event_counter +
+          "\nOpens Recorded: " + (String)analytics.opens + " (" + String(door_analytics.opens_per_hour(), 1) + "/hour over the last day)" +
+          "\nOpen Duration: p50 " + durationToString(door_analytics.open_duration_quantile(0.50)) +
+          ", p95 " + durationToString(door_analytics.open_duration_quantile(0.95)) +
+          ", p99 " + durationToString(door_analytics.open_duration_quantile(0.99)) +
+          ", avg " + open_avg + ", max " + durationToString(analytics.max_open_ms / 1000) +
+          "\nLeft Open Overnight: " + (String)analytics.overnight_opens +
+          "\nOpens By Hour: " + (busiest_hours.length() > 0 ? busiest_hours : "-") +
+          "\nIP Address: " + WiFi.localIP().toString() +
+          "\nWiFi Signal Strength: " + WiFi.RSSI() +
+          power +
+          "\nHeap Usage: " + (String)(((float)(heap_size - free_heap) / heap_size) * 100) + "%" +
+          "\nUptime: " + millisToString(millis() - startup_time) +
+          "\nTTL Restart Due: " + millisToString(DEVICE_TTL - millis() - startup_time) +
+          "\nMonimoto Key Fob In Range: " + keyFobStat +
+          "\nSink Connections: " + (String)connect_stats.connections + " (" + (String)connect_stats.failures + " failed)" +
+          "\nSink Handshake: avg " + handshake_avg + "ms, max " + (String)connect_stats.max_connect_ms + "ms" +
+          "\nSink Connection Heap: " + (String)connect_stats.last_heap_used + " bytes" +
+          sink_circuits +
+          "\nDNS Cache Hits: " + dns_hit_rate + " (" + (String)dns_stats.stale_hits + " stale, " + (String)dns_stats.misses + " misses)" +
+          "\nDNS Lookups: " + (String)dns_stats.lookups + ", avg " + dns_lookup_avg + "ms, max " + (String)dns_stats.max_lookup_ms + "ms, " + (String)dns_stats.failures + " failed" +
+          "\nTelegram Queue Depth: " + (String)tg_queue.depth() + " (max " + (String)queue_stats.max_depth + ")" +
+          "\nTelegram Messages Merged: " + (String)queue_stats.merged + "/" + (String)queue_stats.enqueued +
+          "\nTelegram Send Latency: avg " + send_latency_avg + "ms, max " + (String)queue_stats.max_latency_ms + "ms" +
+          "\nTelegram Send Failures: " + (String)queue_stats.failed + " (" + (String)queue_stats.dropped + " dropped)" +
+          "\nTelegram Polls: " + (String)poller_stats.polls + " (" + (String)(poller_stats.polls * 60 / uptime_minutes) + "/hour)" +
+          "\nTelegram Updates: " + (String)poller_stats.updates + " (" + (String)poller_stats.dropped + " dropped, " + (String)poller_stats.errors + " poll errors)" +
+          "\nHistory: " + (String)event_history.size() + "/" + (String)event_history.capacity() + " events stored" +
+          "\nHistory Append: avg " + append_avg + "us, max " + (String)event_stats.max_append_us + "us" +
+          "\nHistory Sector Erases: " + (String)event_stats.sector_erases + " in " + (String)event_stats.appends + " appends",
+      TG_PRIORITY_REPLY);
+}
+
+void stats_command(CommandSession &session)
+{
+#ifdef BLE_ENABLED
+  switch (session.step)
+  {
+  case 0:
+    // Scan in the background rather than holding up the loop for the scan duration
+    bleDeviceScanner->startScan();
+    session.sleep(BLE_SCAN_POLL_INTERVAL, 1);
+    break;
+  case 1:
+    if (!bleDeviceScanner->isScanComplete())
     {
-      bot.sendMessage(chat_id, "Starting test in 3 seconds...");
-      delay(3000);
-      door_opened_event();
-      bot.sendMessage(chat_id, "Awaiting 30 seconds before triggering a close event...");
-      delay(30 * 1000);
-      door_closed_event();
-      bot.sendMessage(chat_id, "Test complete! Re-arming the device in 3 seconds...");
-      delay(3000);
-      current_door_state = -1;
+      session.sleep(BLE_SCAN_POLL_INTERVAL, 1);
+      break;
     }
+    send_stats(session.chat_id, bleDeviceScanner->wasBLEDeviceNearby(keyFobs) ? "YES" : "NO");
+    break;
+  }
+#else
+  send_stats(session.chat_id, "No Support");
+#endif
+}
+
+#ifdef FLEET_ENABLED
+void fleet_command(CommandSession &session)
+{
+  String message = "Fleet " FLEET_GROUP ": " + (String)(fleet.node_count() + 1) + " nodes\n" +
+                   "\n" DEVICE_NAME " (" FLEET_ZONE ", this node) - " + (door_monitor.state() == HIGH ? "OPEN" : "CLOSED") +
+                   ", " + (String)door_event_counter + " opens, up " + durationToString((millis() - startup_time) / SECOND);
+
+  for (size_t i = 0; i < fleet.node_count(); i++)
+  {
+    const fleet_node &node = fleet.node(i);
+    message += "\n" + String(node.digest.name) + " (" + String(node.digest.zone) + ") - " +
+               (node.digest.door_open ? "OPEN" : "CLOSED") + ", " + (String)node.digest.open_events + " opens" +
+               ", up " + durationToString(node.digest.uptime_s) +
+               ", seen " + durationToString((millis() - node.last_seen) / SECOND) + " ago";
+  }
+
+  const fleet_stats &stats = fleet.stats();
+  message += "\n\nAlert Elections: " + (String)stats.elections_won + " won, " + (String)stats.elections_lost + " lost" +
+             "\nHeartbeat Interval: " + durationToString(fleet.heartbeat_interval() / SECOND) +
+             "\nFleet Traffic: " + (String)stats.sent + " sent (" + (String)stats.bytes_sent + " bytes), " +
+             (String)stats.received + " received (" + (String)stats.bytes_received + " bytes), " +
+             (String)stats.rejected + " rejected, " + (String)stats.replayed + " replayed";
+
+  tg_queue.send(session.chat_id, message, TG_PRIORITY_REPLY);
+}
+#endif
+
+#ifdef LOAD_TEST_ENABLED
+// Time spent delivering each synthetic alert of the running /burst
+std::vector<unsigned long> burst_latencies;
+unsigned long burst_started;
+unsigned long burst_duration;
+tg_queue_stats burst_queue_baseline;
 
-    if (text == "/restart")
+void burst_command(CommandSession &session)
+{
+  size_t events = constrain(session.args.toInt(), 1, LOAD_TEST_MAX_BURST);
+  switch (session.step)
+  {
+  case 0:
+    if (!door_simulation.claim(session))
     {
-      confirm_restart = true;
-      bot.sendMessage(chat_id, "Please confirm you wish to restart the device (yes/no)?");
+      break;
     }
-
-    if (text == "/uptime")
+    tg_queue.send(session.chat_id, "Sending " + (String)events + " open/close pairs through every sink...", TG_PRIORITY_REPLY);
+    burst_latencies.clear();
+    burst_latencies.reserve(events * 2);
+    burst_queue_baseline = tg_queue.stats();
+    burst_started = millis();
+    session.next(1);
+    break;
+  case 1:
+  case 2:
+  {
+    unsigned long started = millis();
+    if (session.step == 1)
     {
-      String uptime = millisToString(millis() - startup_time);
-      bot.sendMessage(chat_id, uptime);
+      door_simulation.opened();
     }
-
-    if (text == "/stats")
+    else
     {
-      uint32_t heap_size = ESP.getHeapSize();
-      uint32_t free_heap = ESP.getFreeHeap();
+      door_simulation.closed();
+    }
+    burst_latencies.push_back(millis() - started);
 
-#ifdef BLE_ENABLED
-      bool keyFobPresent = bleDeviceScanner->isBLEDeviceNearby(keyFobs);
-      String keyFobStat = bleDeviceScanner->isBLEDeviceNearby(keyFobs) ? "YES" : "NO";
-#else
-      String keyFobStat = "No Support";
-#endif
-
-      bot.sendMessage(
-          chat_id,
-          "Number of open door events: " + (String)door_event_counter +
-              "\nIP Address: " + WiFi.localIP().toString() +
-              "\nWiFi Signal Strength: " + WiFi.RSSI() +
-              "\nHeap Usage: " + (String)(((float)(heap_size - free_heap) / heap_size) * 100) + "%" +
-              "\nUptime: " + millisToString(millis() - startup_time) +
-              "\nTTL Restart Due: " + millisToString(DEVICE_TTL - millis() - startup_time) +
-              "\nMonimoto Key Fob In Range: " + keyFobStat);
+    if (burst_latencies.size() < events * 2)
+    {
+      session.sleep(LOAD_TEST_EVENT_GAP, session.step == 1 ? 2 : 1);
+      break;
     }
+    burst_duration = millis() - burst_started;
+    session.next(3);
+    break;
+  }
+  case 3:
+  {
+    // Let the queued Telegram alerts go out so their latency is counted
+    if (tg_queue.depth() > 0 && millis() - burst_started < burst_duration + LOAD_TEST_DRAIN_TIMEOUT)
+    {
+      session.sleep(100, 3);
+      break;
+    }
+
+    std::sort(burst_latencies.begin(), burst_latencies.end());
+    size_t count = burst_latencies.size();
+    auto percentile = [&](size_t p)
+    { return (String)burst_latencies[(count * p - 1) / 100]; };
+
+    const tg_queue_stats &queue_stats = tg_queue.stats();
+    unsigned long sent = queue_stats.sent - burst_queue_baseline.sent;
+    String send_latency_avg = sent > 0 ? (String)((queue_stats.total_latency_ms - burst_queue_baseline.total_latency_ms) / sent) : "-";
+
+    String report = "Burst: " + (String)events + " events (" + (String)count + " alerts) in " + String(burst_duration / 1000.0, 1) + "s, " +
+                    String(count * 1000.0 / max(burst_duration, 1UL), 2) + " alerts/s" +
+                    "\nAlert latency: p50 " + percentile(50) + "ms, p95 " + percentile(95) + "ms, p99 " + percentile(99) + "ms, max " + (String)burst_latencies.back() + "ms" +
+                    "\nTelegram: " + (String)sent + " sent (avg " + send_latency_avg + "ms after queueing), " +
+                    (String)(queue_stats.failed - burst_queue_baseline.failed) + " failed, " +
+                    (String)(queue_stats.dropped - burst_queue_baseline.dropped) + " dropped";
+#ifdef PD_ENABLED
+    report += "\nPagerDuty Circuit: " + breakerToString(pg.circuit_breaker());
+#endif
+#ifdef WEBHOOK_ENABLED
+    report += "\nWebhook Circuit: " + breakerToString(webhook.circuit_breaker());
+#endif
+    DEBUG_PRINT(report);
+    tg_queue.send(session.chat_id, report, TG_PRIORITY_REPLY);
+
+    rearm_after_simulation();
+    door_simulation.release(session);
+    break;
+  }
   }
 }
 #endif
 
+void command_engine_setup()
+{
+  command_engine.on("/status", status_command);
+  command_engine.on("/test", [](CommandSession &session)
+                    { door_simulation.test_command(session); });
+  command_engine.on("/restart", restart_command);
+  command_engine.on("/history", history_command);
+  command_engine.on("/uptime", uptime_command);
+  command_engine.on("/stats", stats_command);
+#ifdef FLEET_ENABLED
+  command_engine.on("/fleet", fleet_command);
+#endif
+#ifdef LOAD_TEST_ENABLED
+  command_engine.on("/burst", burst_command);
+#endif
+}
+
+void handle_telegram_command(const telegram_command &command)
+{
+  String chat_id = command.chat_id;
+  String text = command.text;
+  DEBUG_PRINT("Telegram command: " + text);
+
+  if (!chat_id.equals(TG_OWNER_CHAT_ID))
+  {
+    tg_queue.send(chat_id, "403 FORBIDDEN", TG_PRIORITY_REPLY);
+    return;
+  }
+
+  String from_name = command.from_name;
+  if (from_name == "")
+  {
+    from_name = "Guest";
+  }
+
+  if (command_engine.dispatch(chat_id, from_name, text) == COMMAND_BUSY)
+  {
+    tg_queue.send(chat_id, "Busy running other commands, please try again shortly.", TG_PRIORITY_REPLY);
+  }
+}
+#endif
+
+void record_door_event(history_event_type type)
+{
+  uint8_t flags = time_synced() ? HISTORY_FLAG_TIME_SYNCED : 0;
+  if (!event_history.append(type, (uint32_t)time(nullptr), flags))
+  {
+    DEBUG_PRINT("Unable to record door event");
+  }
+
+  uint32_t timestamp = time_synced() ? (uint32_t)time(nullptr) : 0;
+  if (type == HISTORY_DOOR_OPENED)
+  {
+    door_analytics.opened(timestamp);
+  }
+  else
+  {
+    door_analytics.closed(timestamp);
+  }
+}
+
 void monitor_door()
 {
-  if (millis() - door_check_lasttime > DOOR_CHECK_INTERVAL)
+#ifdef LOW_POWER_ENABLED
+  // An edge is handled straight away rather than at the next poll
+  unsigned long edge_at = 0;
+  bool edge = power_manager.door_edge(edge_at);
+#else
+  bool edge = false;
+#endif
+  if (edge || door_monitor.due())
   {
     DEBUG_PRINT("Checking door");
-    last_door_state = current_door_state;
-    current_door_state = digitalRead(DOOR_SENSOR_PIN);
+    if (ota_in_progress() && door_monitor.last_check() > 0)
+    {
+      ota_max_sensing_gap = max(ota_max_sensing_gap, millis() - door_monitor.last_check());
+    }
+    door_transition transition = door_monitor.read();
+#ifdef LOW_POWER_ENABLED
+    power_manager.rearm(door_monitor.state());
+#endif
 
-    if ((last_door_state == LOW || last_door_state == -1) && current_door_state == HIGH)
+    if (transition == DOOR_TRANSITION_OPENED)
     {
-      door_opened_event();
+      record_door_event(HISTORY_DOOR_OPENED);
+      door_opened_event(sensor_alerts);
       door_event_counter++;
     }
-    else if ((last_door_state == HIGH || last_door_state == -1) && current_door_state == LOW)
+    else if (transition == DOOR_TRANSITION_CLOSED)
+    {
+      record_door_event(HISTORY_DOOR_CLOSED);
+      door_closed_event(sensor_alerts);
+    }
+#ifdef LOW_POWER_ENABLED
+    if (edge && transition != DOOR_TRANSITION_NONE)
     {
-      door_closed_event();
+      power_manager.alert_dispatched(edge_at);
     }
-    door_check_lasttime = millis();
+#endif
   }
 }
 
 #ifdef TG_ENABLED
 void monitor_telegram_bot()
 {
-  if (millis() - tg_bot_lasttime > TG_BOT_INTERVAL)
+  telegram_command command;
+  while (tg_poller.receive(command))
   {
-    int numNewMessages = bot.getUpdates(bot.last_message_received + 1);
-
-    if (numNewMessages > 0)
+    if (command.update_id <= tg_last_update_id)
     {
-      DEBUG_PRINT("got response");
-      handleNewMessages(numNewMessages);
+      // Already handled before a restart
+      continue;
     }
-    tg_bot_lasttime = millis();
+
+    // Persisted before handling so a command that restarts the device is
+    // never run twice
+    tg_last_update_id = command.update_id;
+    preferences.putLong64(PREFERENCE_TG_UPDATE_KEY, tg_last_update_id);
+    handle_telegram_command(command);
   }
 }
 #endif
@@ -389,8 +1056,58 @@ void setup()
   pinMode(DOOR_OPENED_LED, OUTPUT);
 
   wifi_connect();
+  configTzTime(TIMEZONE, NTP_SERVER);
+
+  // Resolve the sinks now and keep them fresh, so alerts never wait on DNS
+#ifdef TG_ENABLED
+  dns_cache.add(TG_API_HOST);
+#endif
+#ifdef PD_ENABLED
+  dns_cache.add(PAGER_DUTY_HOST);
+#endif
+#ifdef WEBHOOK_ENABLED
+  dns_cache.add(WEBHOOK_HOSTNAME);
+#endif
+#ifdef LOAD_TEST_ENABLED
+  // Every sink is answered by tools/sink_standin.py
+  IPAddress standin;
+  standin.fromString(SINK_STANDIN_ADDRESS);
+#ifdef TG_ENABLED
+  dns_cache.pin(TG_API_HOST, standin);
+  dns_cache.pin(TELEGRAM_HOST, standin);
+#endif
+#ifdef PD_ENABLED
+  dns_cache.pin(PAGER_DUTY_HOST, standin);
+#endif
+#ifdef WEBHOOK_ENABLED
+  dns_cache.pin(WEBHOOK_HOSTNAME, standin);
+#endif
+#endif
+  dns_cache.begin(DNS_TASK_STACK_SIZE, DNS_TASK_PRIORITY, DNS_TASK_CORE);
 
+#ifdef FLEET_ENABLED
+  if (!fleet.begin())
+  {
+    DEBUG_PRINT("Unable to join fleet");
+  }
+#endif
+
+  if (!event_history.begin())
+  {
+    DEBUG_PRINT("Event history unavailable");
+  }
+  door_analytics.begin(preferences, PREFERENCE_ANALYTICS_KEY);
+  // Alerts held back when the device last restarted go out with the first loop
+#ifdef PD_ENABLED
+  pg.begin(preferences, PREFERENCE_PD_PENDING_KEY);
+#endif
+#ifdef WEBHOOK_ENABLED
+  webhook.begin(preferences, PREFERENCE_WEBHOOK_PENDING_KEY);
+#endif
+
+  ota_restart_mutex = xSemaphoreCreateMutex();
   arduino_ota_setup();
+  xTaskCreatePinnedToCore(ota_task, "ota", OTA_TASK_STACK_SIZE, NULL, OTA_TASK_PRIORITY, NULL, OTA_TASK_CORE);
 
 #ifdef BLE_ENABLED
   bleDeviceScanner->setup(BLE_SCAN_DURATION, BLE_MAX_RSSI);
@@ -399,39 +1116,77 @@ void setup()
   String restart_reason = preferences.getString(PREFERENCE_RESTART_REASON_KEY, "");
   DEBUG_PRINT("Reboot reason: " + restart_reason);
 
-  current_door_state = digitalRead(DOOR_SENSOR_PIN);
+  door_monitor.begin();
 #ifdef TG_ENABLED
-  tg_secured_client.setCACert(TELEGRAM_CERTIFICATE_ROOT);
+  command_engine_setup();
+  attachTrustStore(tg_secured_client);
+  tg_last_update_id = preferences.getLong64(PREFERENCE_TG_UPDATE_KEY, 0);
+  tg_poller.set_dns_cache(&dns_cache);
+  tg_poller.begin(tg_last_update_id, TG_POLL_TASK_STACK_SIZE, TG_POLL_TASK_PRIORITY, TG_POLL_TASK_CORE);
   String current_door_msg = DOOR_OPEN_MSG;
-  if (current_door_state == LOW)
+  if (door_monitor.state() == LOW)
   {
     current_door_msg = DOOR_CLOSED_MSG;
   }
   if (restart_reason.length() > 0)
   {
     preferences.putString(PREFERENCE_RESTART_REASON_KEY, "");
-    bot.sendMessage(TG_OWNER_CHAT_ID, "Device is online. Reason for restart: \n" + restart_reason + "\n\n" + current_door_msg);
+    tg_queue.send(TG_OWNER_CHAT_ID, "Device is online. Reason for restart: \n" + restart_reason + "\n\n" + current_door_msg, TG_PRIORITY_ALERT);
   }
   else
   {
-    bot.sendMessage(TG_OWNER_CHAT_ID, "Device is online.\n\n" + current_door_msg);
+    tg_queue.send(TG_OWNER_CHAT_ID, "Device is online.\n\n" + current_door_msg, TG_PRIORITY_ALERT);
   }
 #endif
 
 #ifdef PD_ENABLED
-  pd_secured_client.setCACert(PAGER_DUTY_CERTIFICATE_ROOT);
+  attachTrustStore(pd_secured_client);
+#endif
+
+#ifdef LOW_POWER_ENABLED
+  if (!power_manager.begin(door_monitor.state()))
+  {
+    DEBUG_PRINT("Power management partly unavailable");
+  }
 #endif
 
   startup_time = millis();
 }
 
-void loop()
+#ifdef LOW_POWER_ENABLED
+// How long the loop can block before something is due
+unsigned long low_power_idle_time()
 {
-  ArduinoOTA.handle();
+#ifdef TG_ENABLED
+  if (tg_queue.depth() > 0 || command_engine.active_sessions() > 0)
+  {
+    return LOW_POWER_BUSY_INTERVAL;
+  }
+#endif
+  if (ota_in_progress() || restart_flag)
+  {
+    return LOW_POWER_BUSY_INTERVAL;
+  }
+  unsigned long since_check = millis() - door_monitor.last_check();
+  unsigned long until_check = since_check < DOOR_CHECK_INTERVAL ? DOOR_CHECK_INTERVAL - since_check : 0;
+  return min(until_check, LOW_POWER_IDLE_INTERVAL);
+}
+#endif
 
+void loop()
+{
   if (restart_flag)
   {
     DEBUG_PRINT("restart_flag=true");
+    flush_held_back_alerts(SINK_FLUSH_TIMEOUT);
+#ifdef TG_ENABLED
+    tg_queue.flush(TG_QUEUE_FLUSH_TIMEOUT);
+#endif
+    // Preferences may already have been closed by whoever requested the restart
+    preferences.begin(PREFERENCE_NS, false);
+    door_analytics.checkpoint();
+    save_held_back_alerts();
+    preferences.end();
     delay(1000);
     ESP.restart();
     return;
@@ -439,6 +1194,20 @@ void loop()
 
   if (WiFi.status() != WL_CONNECTED)
   {
+#ifdef LOW_POWER_ENABLED
+    // Keep watching the door while rejoining: the interrupt stays off after
+    // an edge until monitor_door() reads the door and rearms it. Telegram
+    // alerts wait in the queue and the other sinks hold theirs until the
+    // link is back.
+    if (power_manager.reconnect() < LOW_POWER_RECONNECT_TIMEOUT)
+    {
+      hold_sinks(true);
+      monitor_door();
+      door_analytics.tick();
+      power_manager.idle(LOW_POWER_BUSY_INTERVAL);
+      return;
+    }
+#endif
     // was previously connected to wifi
     DEBUG_PRINT("Wifi connection lost");
     preferences.putString(PREFERENCE_RESTART_REASON_KEY, "Wifi connection lost");
@@ -461,9 +1230,35 @@ void loop()
     return;
   }
 
+#ifdef LOW_POWER_ENABLED
+  if (power_manager.reconnected())
+  {
+    DEBUG_PRINT("Wifi reconnected");
+    hold_sinks(false);
+#ifdef FLEET_ENABLED
+    fleet.rejoin();
+#endif
+  }
+#endif
+
   monitor_door();
+  send_held_back_alerts();
+  door_analytics.tick();
+
+#ifdef FLEET_ENABLED
+  fleet.set_state(door_monitor.state() == HIGH, door_event_counter);
+  fleet.tick();
+#endif
 
 #ifdef TG_ENABLED
   monitor_telegram_bot();
+  command_engine.tick();
+  tg_queue.process();
+#endif
+
+  monitor_ota_restart();
+
+#ifdef LOW_POWER_ENABLED
+  power_manager.idle(low_power_idle_time());
 #endif
 }
\ No newline at end of file
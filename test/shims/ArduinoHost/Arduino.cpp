@@ -0,0 +1,238 @@
+#include "ArduinoHost.h"
+#include <WiFi.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+static std::atomic<bool> manual_clock(false);
+static std::atomic<unsigned long> manual_ms(0);
+// What host_advance_clock() added to the wall clock
+static std::atomic<unsigned long> skipped_ms(0);
+static std::atomic<int> pins[64];
+static std::atomic<uint64_t> efuse_mac(0x24d7eb0a0b0cULL);
+static std::atomic<unsigned long> restarts(0);
+static std::mutex random_mutex;
+static std::mt19937 random_engine(0x5eed);
+
+static unsigned long elapsed_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count() +
+           skipped_ms * 1000UL;
+}
+
+unsigned long millis()
+{
+    return manual_clock ? manual_ms.load() : elapsed_us() / 1000;
+}
+
+unsigned long micros()
+{
+    return manual_clock ? manual_ms.load() * 1000 : elapsed_us();
+}
+
+void delay(unsigned long ms)
+{
+    if (manual_clock)
+    {
+        manual_ms += ms;
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (!manual_clock)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+void yield()
+{
+    std::this_thread::yield();
+}
+
+void host_use_manual_clock(bool manual)
+{
+    if (manual && !manual_clock)
+    {
+        manual_ms = elapsed_us() / 1000;
+    }
+    manual_clock = manual;
+}
+
+void host_advance_clock(unsigned long ms)
+{
+    if (manual_clock)
+    {
+        manual_ms += ms;
+        return;
+    }
+    skipped_ms += ms;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (mode == INPUT_PULLUP && pin < 64)
+    {
+        pins[pin] = HIGH;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < 64 ? pins[pin].load() : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    host_set_pin(pin, value);
+}
+
+void host_set_pin(uint8_t pin, int level)
+{
+    if (pin < 64)
+    {
+        pins[pin] = level;
+    }
+}
+
+uint32_t esp_random()
+{
+    std::lock_guard<std::mutex> lock(random_mutex);
+    return random_engine();
+}
+
+void host_seed_random(uint32_t seed)
+{
+    std::lock_guard<std::mutex> lock(random_mutex);
+    random_engine.seed(seed);
+}
+
+long random(long max)
+{
+    return max <= 0 ? 0 : esp_random() % max;
+}
+
+long random(long min, long max)
+{
+    return min >= max ? min : min + random(max - min);
+}
+
+uint32_t getXtalFrequencyMhz()
+{
+    return 40;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    return true;
+}
+
+size_t host_strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t copied = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_OTA_VALIDATE_FAILED:
+        return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
+
+// The host has no fixed heap; report something plausible and constant so
+// code that logs heap deltas still runs
+uint32_t EspClass::getFreeHeap()
+{
+    return 200 * 1024;
+}
+
+uint32_t EspClass::getHeapSize()
+{
+    return 320 * 1024;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    return 180 * 1024;
+}
+
+uint64_t EspClass::getEfuseMac()
+{
+    return efuse_mac;
+}
+
+void EspClass::restart()
+{
+    restarts++;
+}
+
+void host_set_efuse_mac(uint64_t mac)
+{
+    efuse_mac = mac;
+}
+
+unsigned long host_restart_count()
+{
+    return restarts;
+}
+
+void host_exit(int status)
+{
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
@@ -0,0 +1,86 @@
+#ifndef ARDUINO_HOST_ARDUINO_H
+#define ARDUINO_HOST_ARDUINO_H
+
+// Just enough of the ESP32 Arduino core to build the libraries in lib/ for
+// the native environment. See ArduinoHost.h for the controls tests use.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+#include "freertos_host.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "esp_err.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define IRAM_ATTR
+#define PROGMEM
+#define F(string_literal) (string_literal)
+#define PSTR(string_literal) (string_literal)
+
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Not in glibc before 2.38
+size_t host_strlcpy(char *destination, const char *source, size_t size);
+#define strlcpy host_strlcpy
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+uint32_t esp_random();
+long random(long max);
+long random(long min, long max);
+uint32_t getXtalFrequencyMhz();
+bool setCpuFrequencyMhz(uint32_t mhz);
+
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getHeapSize();
+    uint32_t getMinFreeHeap();
+    uint64_t getEfuseMac();
+    void restart();
+};
+extern EspClass ESP;
+
+// Like the core, which brings in the network base classes too
+#include "IPAddress.h"
+#include "Client.h"
+
+#endif
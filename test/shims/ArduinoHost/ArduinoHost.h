@@ -0,0 +1,42 @@
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Controls for tests running the libraries on the host, see test/README.
+
+// Stops millis() following the wall clock; it then only moves through
+// host_advance_clock() and delay(), which returns at once
+void host_use_manual_clock(bool manual);
+// Moves millis() forward; on the wall clock it stays that far ahead, which
+// skips a retry delay without waiting it out
+void host_advance_clock(unsigned long ms);
+
+// Level digitalRead() returns for pin
+void host_set_pin(uint8_t pin, int level);
+
+// What WiFi.status() reports and what WiFi.hostByName() answers with
+void host_set_wifi_status(int status);
+void host_set_host_address(const char *host, const IPAddress &address);
+// Sends connections for port to another one, so libraries with fixed ports
+// (443 for the sinks) reach servers the test started
+void host_redirect_port(uint16_t port, uint16_t to);
+
+// Seeds esp_random() so runs can be repeated
+void host_seed_random(uint32_t seed);
+
+// Station MAC, which some libraries derive node ids from
+void host_set_efuse_mac(uint64_t mac);
+
+// Forgets everything stored through Preferences
+void host_clear_preferences();
+
+// Times ESP.restart() was called
+unsigned long host_restart_count();
+
+// Flushes the output and ends the process without running static
+// destructors, for tests that leave tasks running
+void host_exit(int status);
+
+#endif
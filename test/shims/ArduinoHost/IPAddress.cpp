@@ -0,0 +1,101 @@
+#include "IPAddress.h"
+#include <string.h>
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+IPAddress::IPAddress()
+{
+    this->address.dword = 0;
+}
+
+IPAddress::IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+{
+    this->address.bytes[0] = first;
+    this->address.bytes[1] = second;
+    this->address.bytes[2] = third;
+    this->address.bytes[3] = fourth;
+}
+
+IPAddress::IPAddress(uint32_t address)
+{
+    this->address.dword = address;
+}
+
+IPAddress::IPAddress(const uint8_t *address)
+{
+    memcpy(this->address.bytes, address, sizeof(this->address.bytes));
+}
+
+bool IPAddress::fromString(const char *address)
+{
+    uint16_t accumulator = 0;
+    uint8_t dots = 0;
+    bool digits = false;
+    for (; *address != '\0'; address++)
+    {
+        char c = *address;
+        if (c >= '0' && c <= '9')
+        {
+            accumulator = accumulator * 10 + (c - '0');
+            if (accumulator > 255)
+            {
+                return false;
+            }
+            digits = true;
+        }
+        else if (c == '.' && digits && dots < 3)
+        {
+            this->address.bytes[dots++] = accumulator;
+            accumulator = 0;
+            digits = false;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (dots != 3 || !digits)
+    {
+        return false;
+    }
+    this->address.bytes[3] = accumulator;
+    return true;
+}
+
+bool IPAddress::fromString(const String &address)
+{
+    return this->fromString(address.c_str());
+}
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u",
+             this->address.bytes[0], this->address.bytes[1], this->address.bytes[2], this->address.bytes[3]);
+    return String(text);
+}
+
+IPAddress::operator uint32_t() const
+{
+    return this->address.dword;
+}
+
+bool IPAddress::operator==(const IPAddress &address) const
+{
+    return this->address.dword == address.address.dword;
+}
+
+bool IPAddress::operator!=(const IPAddress &address) const
+{
+    return this->address.dword != address.address.dword;
+}
+
+uint8_t IPAddress::operator[](int index) const
+{
+    return this->address.bytes[index];
+}
+
+uint8_t &IPAddress::operator[](int index)
+{
+    return this->address.bytes[index];
+}
@@ -0,0 +1,36 @@
+#ifndef ARDUINO_HOST_IPADDRESS_H
+#define ARDUINO_HOST_IPADDRESS_H
+
+#include <stdint.h>
+#include "WString.h"
+
+// IPv4 only, stored in network order like the core
+class IPAddress
+{
+public:
+    IPAddress();
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth);
+    IPAddress(uint32_t address);
+    IPAddress(const uint8_t *address);
+
+    bool fromString(const char *address);
+    bool fromString(const String &address);
+    String toString() const;
+
+    operator uint32_t() const;
+    bool operator==(const IPAddress &address) const;
+    bool operator!=(const IPAddress &address) const;
+    uint8_t operator[](int index) const;
+    uint8_t &operator[](int index);
+
+private:
+    union
+    {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } address;
+};
+
+extern const IPAddress INADDR_NONE;
+
+#endif
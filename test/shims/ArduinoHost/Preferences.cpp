@@ -0,0 +1,195 @@
+#include "Preferences.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef std::map<std::string, std::vector<uint8_t>> host_namespace;
+
+static std::mutex storage_mutex;
+static std::map<std::string, host_namespace> storage;
+
+void host_clear_preferences()
+{
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    storage.clear();
+}
+
+Preferences::Preferences()
+{
+    this->started = false;
+    this->read_only = false;
+}
+
+Preferences::~Preferences()
+{
+    this->end();
+}
+
+bool Preferences::begin(const char *name, bool read_only)
+{
+    if (this->started || name == NULL || strlen(name) > 15)
+    {
+        return false;
+    }
+    this->name = name;
+    this->read_only = read_only;
+    this->started = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    this->started = false;
+}
+
+bool Preferences::clear()
+{
+    if (!this->started || this->read_only)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    storage[this->name.c_str()].clear();
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!this->started || this->read_only)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    return storage[this->name.c_str()].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    if (!this->started)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    host_namespace &values = storage[this->name.c_str()];
+    return values.find(key) != values.end();
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    // NVS keys are at most 15 characters
+    if (!this->started || this->read_only || key == NULL || strlen(key) > 15 || value == NULL)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    const uint8_t *bytes = (const uint8_t *)value;
+    storage[this->name.c_str()][key].assign(bytes, bytes + length);
+    return length;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t length)
+{
+    if (!this->started || key == NULL)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    host_namespace &values = storage[this->name.c_str()];
+    auto found = values.find(key);
+    if (found == values.end() || found->second.size() > length)
+    {
+        return 0;
+    }
+    memcpy(buffer, found->second.data(), found->second.size());
+    return found->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    if (!this->started || key == NULL)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(storage_mutex);
+    host_namespace &values = storage[this->name.c_str()];
+    auto found = values.find(key);
+    return found == values.end() ? 0 : found->second.size();
+}
+
+size_t Preferences::putString(const char *key, const char *value)
+{
+    return this->putBytes(key, value, strlen(value) + 1) > 0 ? strlen(value) : 0;
+}
+
+size_t Preferences::putString(const char *key, const String &value)
+{
+    return this->putString(key, value.c_str());
+}
+
+String Preferences::getString(const char *key, const String &default_value)
+{
+    size_t length = this->getBytesLength(key);
+    if (length == 0)
+    {
+        return default_value;
+    }
+    std::vector<char> buffer(length);
+    this->getBytes(key, buffer.data(), length);
+    return String(buffer.data());
+}
+
+template <typename T>
+size_t Preferences::put(const char *key, T value)
+{
+    return this->putBytes(key, &value, sizeof(value));
+}
+
+template <typename T>
+T Preferences::get(const char *key, T default_value)
+{
+    T value;
+    return this->getBytesLength(key) == sizeof(value) && this->getBytes(key, &value, sizeof(value)) == sizeof(value)
+               ? value
+               : default_value;
+}
+
+size_t Preferences::putBool(const char *key, bool value)
+{
+    return this->put<uint8_t>(key, value);
+}
+
+bool Preferences::getBool(const char *key, bool default_value)
+{
+    return this->get<uint8_t>(key, default_value) != 0;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+    return this->put(key, value);
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t default_value)
+{
+    return this->get(key, default_value);
+}
+
+size_t Preferences::putULong(const char *key, uint32_t value)
+{
+    return this->put(key, value);
+}
+
+uint32_t Preferences::getULong(const char *key, uint32_t default_value)
+{
+    return this->get(key, default_value);
+}
+
+size_t Preferences::putLong64(const char *key, int64_t value)
+{
+    return this->put(key, value);
+}
+
+int64_t Preferences::getLong64(const char *key, int64_t default_value)
+{
+    return this->get(key, default_value);
+}
@@ -0,0 +1,45 @@
+#ifndef ARDUINO_HOST_PREFERENCES_H
+#define ARDUINO_HOST_PREFERENCES_H
+
+#include "Arduino.h"
+
+// NVS kept in process memory; namespaces outlive the Preferences objects
+// that opened them, like flash outlives a restart
+class Preferences
+{
+public:
+    Preferences();
+    ~Preferences();
+    bool begin(const char *name, bool read_only = false);
+    void end();
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytes(const char *key, void *buffer, size_t length);
+    size_t getBytesLength(const char *key);
+    size_t putString(const char *key, const char *value);
+    size_t putString(const char *key, const String &value);
+    String getString(const char *key, const String &default_value = String());
+    size_t putBool(const char *key, bool value);
+    bool getBool(const char *key, bool default_value = false);
+    size_t putUInt(const char *key, uint32_t value);
+    uint32_t getUInt(const char *key, uint32_t default_value = 0);
+    size_t putULong(const char *key, uint32_t value);
+    uint32_t getULong(const char *key, uint32_t default_value = 0);
+    size_t putLong64(const char *key, int64_t value);
+    int64_t getLong64(const char *key, int64_t default_value = 0);
+
+private:
+    template <typename T>
+    size_t put(const char *key, T value);
+    template <typename T>
+    T get(const char *key, T default_value);
+
+    String name;
+    bool started;
+    bool read_only;
+};
+
+#endif
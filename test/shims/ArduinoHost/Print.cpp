@@ -0,0 +1,97 @@
+#include "Print.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <vector>
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        if (this->write(*buffer++) == 0)
+        {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length < 0)
+    {
+        va_end(args);
+        return 0;
+    }
+    std::vector<char> buffer(length + 1);
+    vsnprintf(buffer.data(), buffer.size(), format, args);
+    va_end(args);
+    return this->write((const uint8_t *)buffer.data(), length);
+}
+
+size_t Print::print(const String &value)
+{
+    return this->write((const uint8_t *)value.c_str(), value.length());
+}
+
+size_t Print::print(const char *value)
+{
+    return this->write(value);
+}
+
+size_t Print::print(char value)
+{
+    return this->write((uint8_t)value);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(int value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(long value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(long long value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+    return this->print(String(value, base));
+}
+
+size_t Print::print(double value, int digits)
+{
+    return this->print(String(value, digits));
+}
+
+size_t Print::println()
+{
+    return this->write("\r\n");
+}
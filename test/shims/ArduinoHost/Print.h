@@ -0,0 +1,58 @@
+#ifndef ARDUINO_HOST_PRINT_H
+#define ARDUINO_HOST_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str)
+    {
+        return str == NULL ? 0 : this->write((const uint8_t *)str, strlen(str));
+    }
+    size_t write(const char *buffer, size_t size)
+    {
+        return this->write((const uint8_t *)buffer, size);
+    }
+    virtual void flush() {}
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const String &value);
+    size_t print(const char *value);
+    size_t print(char value);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = this->print(value);
+        return n + this->println();
+    }
+    template <typename T>
+    size_t println(const T &value, int format)
+    {
+        size_t n = this->print(value, format);
+        return n + this->println();
+    }
+    size_t println();
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "Arduino.h"
+
+void Stream::setTimeout(unsigned long timeout)
+{
+    this->_timeout = timeout;
+}
+
+unsigned long Stream::getTimeout() const
+{
+    return this->_timeout;
+}
+
+int Stream::timedRead()
+{
+    this->_startMillis = millis();
+    do
+    {
+        int c = this->read();
+        if (c >= 0)
+        {
+            return c;
+        }
+        delay(1);
+    } while (millis() - this->_startMillis < this->_timeout);
+    return -1;
+}
+
+int Stream::timedPeek()
+{
+    this->_startMillis = millis();
+    do
+    {
+        int c = this->peek();
+        if (c >= 0)
+        {
+            return c;
+        }
+        delay(1);
+    } while (millis() - this->_startMillis < this->_timeout);
+    return -1;
+}
+
+int Stream::peekNextDigit()
+{
+    while (true)
+    {
+        int c = this->timedPeek();
+        if (c < 0 || c == '-' || (c >= '0' && c <= '9'))
+        {
+            return c;
+        }
+        this->read();
+    }
+}
+
+bool Stream::find(const char *target)
+{
+    return this->find(target, strlen(target));
+}
+
+bool Stream::find(const char *target, size_t length)
+{
+    MultiTarget targets[1] = {{target, length, 0}};
+    return this->findMulti(targets, 1) == 0;
+}
+
+bool Stream::findUntil(const char *target, const char *terminator)
+{
+    MultiTarget targets[2] = {{target, strlen(target), 0}, {terminator, strlen(terminator), 0}};
+    return this->findMulti(targets, terminator[0] != '\0' ? 2 : 1) == 0;
+}
+
+// Same matching as the core, including its fallback when a partial match fails
+int Stream::findMulti(MultiTarget *targets, int count)
+{
+    for (MultiTarget *t = targets; t < targets + count; ++t)
+    {
+        if (t->len <= 0)
+        {
+            return t - targets;
+        }
+    }
+
+    while (true)
+    {
+        int c = this->timedRead();
+        if (c < 0)
+        {
+            return -1;
+        }
+
+        for (MultiTarget *t = targets; t < targets + count; ++t)
+        {
+            if (c == t->str[t->index])
+            {
+                if (++t->index == t->len)
+                {
+                    return t - targets;
+                }
+                continue;
+            }
+
+            if (t->index == 0)
+            {
+                continue;
+            }
+
+            size_t original_index = t->index;
+            do
+            {
+                --t->index;
+                if (c != t->str[t->index])
+                {
+                    continue;
+                }
+                if (t->index == 0)
+                {
+                    t->index++;
+                    break;
+                }
+                size_t diff = original_index - t->index;
+                size_t i;
+                for (i = 0; i < t->index; ++i)
+                {
+                    if (t->str[i] != t->str[i + diff])
+                    {
+                        break;
+                    }
+                }
+                if (i == t->index)
+                {
+                    t->index++;
+                    break;
+                }
+            } while (t->index);
+        }
+    }
+}
+
+long Stream::parseInt()
+{
+    bool negative = false;
+    long value = 0;
+    int c = this->peekNextDigit();
+    if (c < 0)
+    {
+        return 0;
+    }
+    do
+    {
+        if (c == '-')
+        {
+            negative = true;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            value = value * 10 + c - '0';
+        }
+        this->read();
+        c = this->timedPeek();
+    } while ((c >= '0' && c <= '9') || (c == '-' && value == 0 && !negative));
+    return negative ? -value : value;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = this->timedRead();
+        if (c < 0)
+        {
+            break;
+        }
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+    size_t index = 0;
+    while (index < length)
+    {
+        int c = this->timedRead();
+        if (c < 0 || c == terminator)
+        {
+            break;
+        }
+        *buffer++ = (char)c;
+        index++;
+    }
+    return index;
+}
+
+String Stream::readString()
+{
+    String result;
+    int c = this->timedRead();
+    while (c >= 0)
+    {
+        result += (char)c;
+        c = this->timedRead();
+    }
+    return result;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    String result;
+    int c = this->timedRead();
+    while (c >= 0 && c != terminator)
+    {
+        result += (char)c;
+        c = this->timedRead();
+    }
+    return result;
+}
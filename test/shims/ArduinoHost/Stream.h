@@ -0,0 +1,49 @@
+#ifndef ARDUINO_HOST_STREAM_H
+#define ARDUINO_HOST_STREAM_H
+
+#include "Print.h"
+
+// Arduino's Stream: reads wait up to the timeout, in milliseconds, for every
+// missing byte
+class Stream : public Print
+{
+public:
+    Stream() : _timeout(1000), _startMillis(0) {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout);
+    unsigned long getTimeout() const;
+
+    bool find(const char *target);
+    bool find(const char *target, size_t length);
+    bool findUntil(const char *target, const char *terminator);
+    long parseInt();
+
+    virtual size_t readBytes(char *buffer, size_t length);
+    virtual size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        return this->readBytes((char *)buffer, length);
+    }
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    String readString();
+    String readStringUntil(char terminator);
+
+protected:
+    struct MultiTarget
+    {
+        const char *str;
+        size_t len;
+        size_t index;
+    };
+    int findMulti(MultiTarget *targets, int count);
+    int timedRead();
+    int timedPeek();
+    int peekNextDigit();
+
+    unsigned long _timeout;
+    unsigned long _startMillis;
+};
+
+#endif
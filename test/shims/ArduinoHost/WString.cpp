@@ -0,0 +1,427 @@
+#include "WString.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static std::string format_integer(unsigned long long value, bool negative, unsigned char base)
+{
+    if (base < 2 || base > 36)
+    {
+        base = 10;
+    }
+    std::string digits;
+    do
+    {
+        int digit = value % base;
+        digits.push_back(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value > 0);
+    if (negative)
+    {
+        digits.push_back('-');
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+static std::string format_signed(long long value, unsigned char base)
+{
+    // Like the core, only base 10 is printed with a sign
+    if (base == 10 && value < 0)
+    {
+        return format_integer(0ULL - (unsigned long long)value, true, base);
+    }
+    return format_integer(base == 10 ? (unsigned long long)value : (unsigned long)value, false, base);
+}
+
+static std::string format_float(double value, unsigned int decimals)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    return buffer;
+}
+
+String::String(const char *value) : value(value != NULL ? value : "") {}
+String::String(const char *value, size_t length) : value(value, length) {}
+String::String(const std::string &value) : value(value) {}
+String::String(char value) : value(1, value) {}
+String::String(unsigned char value, unsigned char base) : value(format_integer(value, false, base)) {}
+String::String(int value, unsigned char base) : value(format_signed(value, base)) {}
+String::String(unsigned int value, unsigned char base) : value(format_integer(value, false, base)) {}
+String::String(long value, unsigned char base) : value(format_signed(value, base)) {}
+String::String(unsigned long value, unsigned char base) : value(format_integer(value, false, base)) {}
+String::String(long long value, unsigned char base) : value(format_signed(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : value(format_integer(value, false, base)) {}
+String::String(float value, unsigned int decimals) : value(format_float(value, decimals)) {}
+String::String(double value, unsigned int decimals) : value(format_float(value, decimals)) {}
+
+String &String::operator=(const char *value)
+{
+    this->value = value != NULL ? value : "";
+    return *this;
+}
+
+bool String::reserve(unsigned int size)
+{
+    this->value.reserve(size);
+    return true;
+}
+
+unsigned int String::length() const
+{
+    return this->value.length();
+}
+
+bool String::isEmpty() const
+{
+    return this->value.empty();
+}
+
+const char *String::c_str() const
+{
+    return this->value.c_str();
+}
+
+char *String::begin()
+{
+    return &this->value[0];
+}
+
+char *String::end()
+{
+    return &this->value[0] + this->value.length();
+}
+
+const char *String::begin() const
+{
+    return this->value.c_str();
+}
+
+const char *String::end() const
+{
+    return this->value.c_str() + this->value.length();
+}
+
+bool String::concat(const String &value)
+{
+    this->value += value.value;
+    return true;
+}
+
+bool String::concat(const char *value)
+{
+    if (value == NULL)
+    {
+        return false;
+    }
+    this->value += value;
+    return true;
+}
+
+bool String::concat(const char *value, unsigned int length)
+{
+    if (value == NULL)
+    {
+        return false;
+    }
+    this->value.append(value, length);
+    return true;
+}
+
+bool String::concat(char value)
+{
+    this->value.push_back(value);
+    return true;
+}
+
+String &String::operator+=(const String &value)
+{
+    this->concat(value);
+    return *this;
+}
+
+String &String::operator+=(const char *value)
+{
+    this->concat(value);
+    return *this;
+}
+
+String &String::operator+=(char value)
+{
+    this->concat(value);
+    return *this;
+}
+
+int String::compareTo(const String &value) const
+{
+    return this->value.compare(value.value);
+}
+
+bool String::equals(const String &value) const
+{
+    return this->value == value.value;
+}
+
+bool String::equals(const char *value) const
+{
+    return value != NULL && this->value == value;
+}
+
+bool String::equalsIgnoreCase(const String &value) const
+{
+    if (this->value.length() != value.value.length())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < this->value.length(); i++)
+    {
+        if (tolower((unsigned char)this->value[i]) != tolower((unsigned char)value.value[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+    return this->startsWith(prefix, 0);
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const
+{
+    return offset + prefix.value.length() <= this->value.length() &&
+           this->value.compare(offset, prefix.value.length(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    return suffix.value.length() <= this->value.length() &&
+           this->value.compare(this->value.length() - suffix.value.length(), suffix.value.length(), suffix.value) == 0;
+}
+
+bool String::operator==(const String &value) const
+{
+    return this->equals(value);
+}
+
+bool String::operator==(const char *value) const
+{
+    return this->equals(value);
+}
+
+bool String::operator!=(const String &value) const
+{
+    return !this->equals(value);
+}
+
+bool String::operator!=(const char *value) const
+{
+    return !this->equals(value);
+}
+
+bool String::operator<(const String &value) const
+{
+    return this->value < value.value;
+}
+
+bool String::operator>(const String &value) const
+{
+    return this->value > value.value;
+}
+
+char String::charAt(unsigned int index) const
+{
+    return index < this->value.length() ? this->value[index] : 0;
+}
+
+void String::setCharAt(unsigned int index, char value)
+{
+    if (index < this->value.length())
+    {
+        this->value[index] = value;
+    }
+}
+
+char String::operator[](unsigned int index) const
+{
+    return this->charAt(index);
+}
+
+char &String::operator[](unsigned int index)
+{
+    return this->value[index];
+}
+
+int String::indexOf(char value) const
+{
+    return this->indexOf(value, 0);
+}
+
+int String::indexOf(char value, unsigned int from) const
+{
+    size_t found = this->value.find(value, from);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+int String::indexOf(const String &value) const
+{
+    return this->indexOf(value, 0);
+}
+
+int String::indexOf(const String &value, unsigned int from) const
+{
+    size_t found = this->value.find(value.value, from);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+int String::lastIndexOf(char value) const
+{
+    size_t found = this->value.rfind(value);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+int String::lastIndexOf(const String &value) const
+{
+    size_t found = this->value.rfind(value.value);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+String String::substring(unsigned int from) const
+{
+    return this->substring(from, this->value.length());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to)
+    {
+        std::swap(from, to);
+    }
+    if (from >= this->value.length())
+    {
+        return String();
+    }
+    to = std::min(to, (unsigned int)this->value.length());
+    return String(this->value.substr(from, to - from));
+}
+
+void String::replace(char find, char replace)
+{
+    std::replace(this->value.begin(), this->value.end(), find, replace);
+}
+
+void String::replace(const String &find, const String &replace)
+{
+    if (find.value.empty())
+    {
+        return;
+    }
+    size_t position = 0;
+    while ((position = this->value.find(find.value, position)) != std::string::npos)
+    {
+        this->value.replace(position, find.value.length(), replace.value);
+        position += replace.value.length();
+    }
+}
+
+void String::remove(unsigned int index)
+{
+    if (index < this->value.length())
+    {
+        this->value.erase(index);
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index < this->value.length())
+    {
+        this->value.erase(index, count);
+    }
+}
+
+void String::toLowerCase()
+{
+    for (char &c : this->value)
+    {
+        c = tolower((unsigned char)c);
+    }
+}
+
+void String::toUpperCase()
+{
+    for (char &c : this->value)
+    {
+        c = toupper((unsigned char)c);
+    }
+}
+
+void String::trim()
+{
+    size_t first = this->value.find_first_not_of(" \t\r\n\f\v");
+    if (first == std::string::npos)
+    {
+        this->value.clear();
+        return;
+    }
+    size_t last = this->value.find_last_not_of(" \t\r\n\f\v");
+    this->value = this->value.substr(first, last - first + 1);
+}
+
+long String::toInt() const
+{
+    return atol(this->value.c_str());
+}
+
+float String::toFloat() const
+{
+    return atof(this->value.c_str());
+}
+
+double String::toDouble() const
+{
+    return atof(this->value.c_str());
+}
+
+String operator+(const String &left, const String &right)
+{
+    String result(left);
+    result.concat(right);
+    return result;
+}
+
+String operator+(const String &left, const char *right)
+{
+    String result(left);
+    result.concat(right);
+    return result;
+}
+
+String operator+(const char *left, const String &right)
+{
+    String result(left);
+    result.concat(right);
+    return result;
+}
+
+String operator+(const String &left, char right)
+{
+    String result(left);
+    result.concat(right);
+    return result;
+}
+
+String operator+(char left, const String &right)
+{
+    String result(left);
+    result.concat(right);
+    return result;
+}
+
+bool operator==(const char *left, const String &right)
+{
+    return right.equals(left);
+}
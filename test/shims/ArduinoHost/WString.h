@@ -0,0 +1,124 @@
+#ifndef ARDUINO_HOST_WSTRING_H
+#define ARDUINO_HOST_WSTRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Arduino's String on top of std::string
+class String
+{
+public:
+    String(const char *value = "");
+    String(const char *value, size_t length);
+    String(const std::string &value);
+    String(const String &value) = default;
+    String(String &&value) = default;
+    explicit String(char value);
+    String(unsigned char value, unsigned char base = 10);
+    String(int value, unsigned char base = 10);
+    String(unsigned int value, unsigned char base = 10);
+    String(long value, unsigned char base = 10);
+    String(unsigned long value, unsigned char base = 10);
+    String(long long value, unsigned char base = 10);
+    String(unsigned long long value, unsigned char base = 10);
+    String(float value, unsigned int decimals = 2);
+    String(double value, unsigned int decimals = 2);
+
+    String &operator=(const String &value) = default;
+    String &operator=(String &&value) = default;
+    String &operator=(const char *value);
+
+    bool reserve(unsigned int size);
+    unsigned int length() const;
+    bool isEmpty() const;
+    const char *c_str() const;
+    char *begin();
+    char *end();
+    const char *begin() const;
+    const char *end() const;
+
+    bool concat(const String &value);
+    bool concat(const char *value);
+    bool concat(const char *value, unsigned int length);
+    bool concat(char value);
+    template <typename T>
+    String &operator+=(const T &value)
+    {
+        this->concat(String(value));
+        return *this;
+    }
+    String &operator+=(const String &value);
+    String &operator+=(const char *value);
+    String &operator+=(char value);
+
+    int compareTo(const String &value) const;
+    bool equals(const String &value) const;
+    bool equals(const char *value) const;
+    bool equalsIgnoreCase(const String &value) const;
+    bool startsWith(const String &prefix) const;
+    bool startsWith(const String &prefix, unsigned int offset) const;
+    bool endsWith(const String &suffix) const;
+    bool operator==(const String &value) const;
+    bool operator==(const char *value) const;
+    bool operator!=(const String &value) const;
+    bool operator!=(const char *value) const;
+    bool operator<(const String &value) const;
+    bool operator>(const String &value) const;
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char value);
+    char operator[](unsigned int index) const;
+    char &operator[](unsigned int index);
+
+    int indexOf(char value) const;
+    int indexOf(char value, unsigned int from) const;
+    int indexOf(const String &value) const;
+    int indexOf(const String &value, unsigned int from) const;
+    int lastIndexOf(char value) const;
+    int lastIndexOf(const String &value) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+
+    void replace(char find, char replace);
+    void replace(const String &find, const String &replace);
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+private:
+    std::string value;
+};
+
+// Named by libraries that special-case the core's concatenation temporaries
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &value) : String(value) {}
+    StringSumHelper(const char *value) : String(value) {}
+};
+
+String operator+(const String &left, const String &right);
+String operator+(const String &left, const char *right);
+String operator+(const char *left, const String &right);
+String operator+(const String &left, char right);
+String operator+(char left, const String &right);
+template <typename T>
+String operator+(const String &left, const T &right)
+{
+    return left + String(right);
+}
+template <typename T>
+String operator+(const T &left, const String &right)
+{
+    return String(left) + right;
+}
+bool operator==(const char *left, const String &right);
+
+#endif
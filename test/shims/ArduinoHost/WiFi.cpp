@@ -0,0 +1,110 @@
+#include "ArduinoHost.h"
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <netdb.h>
+#include <string>
+
+WiFiClass WiFi;
+
+static std::atomic<int> wifi_status(WL_CONNECTED);
+static std::mutex hosts_mutex;
+static std::map<std::string, uint32_t> hosts;
+static std::map<uint16_t, uint16_t> ports;
+
+void host_set_wifi_status(int status)
+{
+    wifi_status = status;
+}
+
+void host_set_host_address(const char *host, const IPAddress &address)
+{
+    std::lock_guard<std::mutex> lock(hosts_mutex);
+    hosts[host] = (uint32_t)address;
+}
+
+void host_redirect_port(uint16_t port, uint16_t to)
+{
+    std::lock_guard<std::mutex> lock(hosts_mutex);
+    ports[port] = to;
+}
+
+uint16_t host_redirected_port(uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(hosts_mutex);
+    auto found = ports.find(port);
+    return found != ports.end() ? found->second : port;
+}
+
+wl_status_t WiFiClass::status()
+{
+    return (wl_status_t)wifi_status.load();
+}
+
+int WiFiClass::hostByName(const char *host, IPAddress &address)
+{
+    {
+        std::lock_guard<std::mutex> lock(hosts_mutex);
+        auto found = hosts.find(host);
+        if (found != hosts.end())
+        {
+            address = IPAddress(found->second);
+            return 1;
+        }
+    }
+    if (address.fromString(host))
+    {
+        return 1;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    addrinfo *result = NULL;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+    {
+        return 0;
+    }
+    address = IPAddress((uint32_t)((sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(result);
+    return 1;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return IPAddress(127, 0, 0, 1);
+}
+
+// No DNS server of our own, so lookups go through hostByName()
+IPAddress WiFiClass::dnsIP(uint8_t index)
+{
+    return IPAddress();
+}
+
+int8_t WiFiClass::RSSI()
+{
+    return -50;
+}
+
+String WiFiClass::macAddress()
+{
+    uint64_t mac = ESP.getEfuseMac();
+    char text[18];
+    snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+             (uint8_t)mac, (uint8_t)(mac >> 8), (uint8_t)(mac >> 16),
+             (uint8_t)(mac >> 24), (uint8_t)(mac >> 32), (uint8_t)(mac >> 40));
+    return String(text);
+}
+
+bool WiFiClass::disconnect(bool wifioff)
+{
+    wifi_status = WL_DISCONNECTED;
+    return true;
+}
+
+bool WiFiClass::reconnect()
+{
+    wifi_status = WL_CONNECTED;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef ARDUINO_HOST_WIFI_H
+#define ARDUINO_HOST_WIFI_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+#include "WiFiUdp.h"
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+// Reports whatever the test set through ArduinoHost.h; the host's own
+// network is always there
+class WiFiClass
+{
+public:
+    wl_status_t status();
+    int hostByName(const char *host, IPAddress &address);
+    IPAddress localIP();
+    IPAddress dnsIP(uint8_t index = 0);
+    int8_t RSSI();
+    String macAddress();
+    bool disconnect(bool wifioff = false);
+    bool reconnect();
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,295 @@
+#include "WiFiClient.h"
+#include "WiFi.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HOST_SOCKET_BUFFER_SIZE 1436
+#define HOST_CONNECT_TIMEOUT 3000
+
+// See host_redirect_port()
+uint16_t host_redirected_port(uint16_t port);
+
+struct host_socket
+{
+    int fd;
+    // The peer finished sending, or the connection broke
+    bool eof;
+    bool broken;
+    // Received bytes not handed out yet, like the core's rx buffer
+    uint8_t buffer[HOST_SOCKET_BUFFER_SIZE];
+    size_t buffer_pos;
+    size_t buffer_len;
+
+    host_socket(int fd) : fd(fd), eof(false), broken(false), buffer_pos(0), buffer_len(0) {}
+    ~host_socket()
+    {
+        close(this->fd);
+    }
+
+    size_t buffered()
+    {
+        return this->buffer_len - this->buffer_pos;
+    }
+
+    // Pulls whatever already arrived into the buffer without waiting
+    void fill()
+    {
+        if (this->buffered() > 0 || this->eof || this->broken)
+        {
+            return;
+        }
+        ssize_t received = recv(this->fd, this->buffer, sizeof(this->buffer), MSG_DONTWAIT);
+        if (received > 0)
+        {
+            this->buffer_pos = 0;
+            this->buffer_len = received;
+        }
+        else if (received == 0)
+        {
+            this->eof = true;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            this->broken = true;
+        }
+    }
+};
+
+WiFiClient::WiFiClient()
+{
+}
+
+WiFiClient::WiFiClient(int fd)
+{
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    this->socket = std::make_shared<host_socket>(fd);
+}
+
+WiFiClient::~WiFiClient()
+{
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    return this->connect(ip, port, HOST_CONNECT_TIMEOUT);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout_ms)
+{
+    this->stop();
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(host_redirected_port(port));
+    address.sin_addr.s_addr = (uint32_t)ip;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int result = ::connect(fd, (sockaddr *)&address, sizeof(address));
+    if (result < 0 && errno == EINPROGRESS)
+    {
+        pollfd waiting = {fd, POLLOUT, 0};
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (poll(&waiting, 1, timeout_ms) == 1 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0)
+        {
+            result = 0;
+        }
+    }
+    if (result < 0)
+    {
+        close(fd);
+        return 0;
+    }
+    fcntl(fd, F_SETFL, flags);
+
+    WiFiClient connected(fd);
+    this->socket = connected.socket;
+    return 1;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    return this->connect(host, port, HOST_CONNECT_TIMEOUT);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout_ms)
+{
+    IPAddress address;
+    if (!WiFi.hostByName(host, address))
+    {
+        return 0;
+    }
+    return this->connect(address, port, timeout_ms);
+}
+
+size_t WiFiClient::write(uint8_t c)
+{
+    return this->write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+    // Sending still works after the peer shut down its side
+    if (!this->socket || this->socket->broken)
+    {
+        return 0;
+    }
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t result = send(this->socket->fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (result <= 0)
+        {
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            this->socket->broken = true;
+            break;
+        }
+        sent += result;
+    }
+    return sent;
+}
+
+int WiFiClient::available()
+{
+    if (!this->socket)
+    {
+        return 0;
+    }
+    this->socket->fill();
+    int pending = 0;
+    if (!this->socket->eof && !this->socket->broken)
+    {
+        ioctl(this->socket->fd, FIONREAD, &pending);
+    }
+    return this->socket->buffered() + pending;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return this->read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+    if (!this->socket)
+    {
+        return -1;
+    }
+    this->socket->fill();
+    size_t length = std::min(size, this->socket->buffered());
+    if (length == 0)
+    {
+        return -1;
+    }
+    memcpy(buffer, this->socket->buffer + this->socket->buffer_pos, length);
+    this->socket->buffer_pos += length;
+    return length;
+}
+
+int WiFiClient::peek()
+{
+    if (!this->socket)
+    {
+        return -1;
+    }
+    this->socket->fill();
+    return this->socket->buffered() > 0 ? this->socket->buffer[this->socket->buffer_pos] : -1;
+}
+
+void WiFiClient::flush()
+{
+}
+
+void WiFiClient::stop()
+{
+    this->socket.reset();
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (!this->socket)
+    {
+        return 0;
+    }
+    this->socket->fill();
+    return this->socket->buffered() > 0 || (!this->socket->eof && !this->socket->broken);
+}
+
+WiFiClient::operator bool()
+{
+    return this->connected();
+}
+
+bool WiFiClient::operator==(const WiFiClient &other) const
+{
+    return this->socket == other.socket;
+}
+
+int WiFiClient::setTimeout(uint32_t seconds)
+{
+    Stream::setTimeout(seconds * 1000);
+    return 0;
+}
+
+int WiFiClient::setNoDelay(bool nodelay)
+{
+    int value = nodelay;
+    return this->socket ? setsockopt(this->socket->fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) : -1;
+}
+
+int WiFiClient::fd() const
+{
+    return this->socket ? this->socket->fd : -1;
+}
+
+IPAddress WiFiClient::remoteIP() const
+{
+    sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    if (!this->socket || getpeername(this->socket->fd, (sockaddr *)&address, &length) != 0)
+    {
+        return IPAddress();
+    }
+    return IPAddress((uint32_t)address.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const
+{
+    sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    if (!this->socket || getpeername(this->socket->fd, (sockaddr *)&address, &length) != 0)
+    {
+        return 0;
+    }
+    return ntohs(address.sin_port);
+}
+
+IPAddress WiFiClient::localIP() const
+{
+    sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    if (!this->socket || getsockname(this->socket->fd, (sockaddr *)&address, &length) != 0)
+    {
+        return IPAddress();
+    }
+    return IPAddress((uint32_t)address.sin_addr.s_addr);
+}
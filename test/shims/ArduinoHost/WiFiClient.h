@@ -0,0 +1,47 @@
+#ifndef ARDUINO_HOST_WIFI_CLIENT_H
+#define ARDUINO_HOST_WIFI_CLIENT_H
+
+#include "Client.h"
+#include <memory>
+
+struct host_socket;
+
+// Plain TCP over POSIX sockets. Copies share the socket, which closes when
+// the last copy lets go of it.
+class WiFiClient : public Client
+{
+public:
+    WiFiClient();
+    explicit WiFiClient(int fd);
+    virtual ~WiFiClient();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout_ms);
+    int connect(const char *host, uint16_t port) override;
+    int connect(const char *host, uint16_t port, int32_t timeout_ms);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+    bool operator==(const WiFiClient &other) const;
+
+    // Seconds, like the core; also sets the Stream timeout
+    int setTimeout(uint32_t seconds);
+    int setNoDelay(bool nodelay);
+    int fd() const;
+    IPAddress remoteIP() const;
+    uint16_t remotePort() const;
+    IPAddress localIP() const;
+
+protected:
+    std::shared_ptr<host_socket> socket;
+};
+
+#endif
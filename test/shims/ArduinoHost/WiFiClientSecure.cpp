@@ -0,0 +1,63 @@
+#include "WiFiClientSecure.h"
+
+WiFiClientSecure::WiFiClientSecure()
+{
+    this->_CA_cert = NULL;
+    this->_cert = NULL;
+    this->_private_key = NULL;
+    this->_ca_bundle = NULL;
+    this->_use_insecure = false;
+    this->_timeout = 30 * 1000;
+    this->_handshake_timeout = 120 * 1000;
+}
+
+int WiFiClientSecure::connect(const char *host, uint16_t port)
+{
+    return this->connect(host, port, this->_CA_cert, this->_cert, this->_private_key);
+}
+
+int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char *host, const char *ca, const char *cert, const char *key)
+{
+    return WiFiClient::connect(ip, port);
+}
+
+int WiFiClientSecure::connect(const char *host, uint16_t port, const char *ca, const char *cert, const char *key)
+{
+    return WiFiClient::connect(host, port);
+}
+
+void WiFiClientSecure::setInsecure()
+{
+    this->_use_insecure = true;
+}
+
+void WiFiClientSecure::setCACert(const char *ca)
+{
+    this->_CA_cert = ca;
+}
+
+void WiFiClientSecure::setCertificate(const char *cert)
+{
+    this->_cert = cert;
+}
+
+void WiFiClientSecure::setPrivateKey(const char *key)
+{
+    this->_private_key = key;
+}
+
+void WiFiClientSecure::setCACertBundle(const uint8_t *bundle)
+{
+    this->_ca_bundle = bundle;
+}
+
+void WiFiClientSecure::setHandshakeTimeout(unsigned long seconds)
+{
+    this->_handshake_timeout = seconds * 1000;
+}
+
+int WiFiClientSecure::setTimeout(uint32_t seconds)
+{
+    this->_timeout = seconds * 1000;
+    return 0;
+}
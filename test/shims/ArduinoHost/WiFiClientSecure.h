@@ -0,0 +1,39 @@
+#ifndef ARDUINO_HOST_WIFI_CLIENT_SECURE_H
+#define ARDUINO_HOST_WIFI_CLIENT_SECURE_H
+
+#include "WiFiClient.h"
+
+// Stands in for the TLS client with plain TCP, so the libraries can talk to
+// tools/sink_standin.py started with --tls-port 0. Certificates are taken
+// and ignored.
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    WiFiClientSecure();
+
+    using WiFiClient::connect;
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, const char *host, const char *ca, const char *cert, const char *key);
+    int connect(const char *host, uint16_t port, const char *ca, const char *cert, const char *key);
+
+    void setInsecure();
+    void setCACert(const char *ca);
+    void setCertificate(const char *cert);
+    void setPrivateKey(const char *key);
+    void setCACertBundle(const uint8_t *bundle);
+    void setHandshakeTimeout(unsigned long seconds);
+    // Seconds. Like arduino-esp32 2.0.x this only covers the TLS layer and
+    // leaves the Stream timeout used by readBytes() and friends alone.
+    int setTimeout(uint32_t seconds);
+
+protected:
+    const char *_CA_cert;
+    const char *_cert;
+    const char *_private_key;
+    const uint8_t *_ca_bundle;
+    bool _use_insecure;
+    unsigned long _timeout;
+    unsigned long _handshake_timeout;
+};
+
+#endif
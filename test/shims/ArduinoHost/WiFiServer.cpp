@@ -0,0 +1,98 @@
+#include "WiFiServer.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiServer::WiFiServer(uint16_t port, uint8_t max_clients)
+{
+    this->fd = -1;
+    this->port = port;
+    this->max_clients = max_clients;
+}
+
+WiFiServer::~WiFiServer()
+{
+    this->end();
+}
+
+void WiFiServer::begin(uint16_t port)
+{
+    if (port != 0)
+    {
+        this->port = port;
+    }
+    this->end();
+    this->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (this->fd < 0)
+    {
+        return;
+    }
+    int reuse = 1;
+    setsockopt(this->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(this->port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(this->fd, (sockaddr *)&address, sizeof(address)) != 0 || listen(this->fd, this->max_clients) != 0)
+    {
+        ::close(this->fd);
+        this->fd = -1;
+        return;
+    }
+    fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+WiFiClient WiFiServer::available()
+{
+    return this->accept();
+}
+
+WiFiClient WiFiServer::accept()
+{
+    if (this->fd < 0)
+    {
+        return WiFiClient();
+    }
+    int client = ::accept(this->fd, NULL, NULL);
+    if (client < 0)
+    {
+        return WiFiClient();
+    }
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) & ~O_NONBLOCK);
+    return WiFiClient(client);
+}
+
+bool WiFiServer::hasClient()
+{
+    pollfd waiting = {this->fd, POLLIN, 0};
+    return this->fd >= 0 && poll(&waiting, 1, 0) == 1;
+}
+
+void WiFiServer::end()
+{
+    if (this->fd >= 0)
+    {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+void WiFiServer::close()
+{
+    this->end();
+}
+
+void WiFiServer::stop()
+{
+    this->end();
+}
+
+WiFiServer::operator bool()
+{
+    return this->fd >= 0;
+}
@@ -0,0 +1,27 @@
+#ifndef ARDUINO_HOST_WIFI_SERVER_H
+#define ARDUINO_HOST_WIFI_SERVER_H
+
+#include "WiFiClient.h"
+
+// Listens on the loopback interface only
+class WiFiServer
+{
+public:
+    WiFiServer(uint16_t port = 80, uint8_t max_clients = 4);
+    ~WiFiServer();
+    void begin(uint16_t port = 0);
+    WiFiClient available();
+    WiFiClient accept();
+    bool hasClient();
+    void end();
+    void close();
+    void stop();
+    operator bool();
+
+private:
+    int fd;
+    uint16_t port;
+    uint8_t max_clients;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "WiFiUdp.h"
+#include "WiFi.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HOST_UDP_MAX_PACKET 1460
+
+WiFiUDP::WiFiUDP()
+{
+    this->fd = -1;
+    this->remote_port = 0;
+    this->rx_pos = 0;
+    this->tx_port = 0;
+}
+
+WiFiUDP::~WiFiUDP()
+{
+    this->stop();
+}
+
+bool WiFiUDP::open_socket()
+{
+    if (this->fd >= 0)
+    {
+        return true;
+    }
+    this->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (this->fd < 0)
+    {
+        return false;
+    }
+    int enable = 1;
+    setsockopt(this->fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(this->fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+
+    in_addr loopback = {htonl(INADDR_LOOPBACK)};
+    unsigned char loop = 1;
+    setsockopt(this->fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    setsockopt(this->fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    return true;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    this->stop();
+    if (!this->open_socket())
+    {
+        return 0;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(this->fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        this->stop();
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress address, uint16_t port)
+{
+    if (!this->begin(port))
+    {
+        return 0;
+    }
+    ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = (uint32_t)address;
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    if (setsockopt(this->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)
+    {
+        this->stop();
+        return 0;
+    }
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    if (this->fd >= 0)
+    {
+        close(this->fd);
+        this->fd = -1;
+    }
+    this->tx.clear();
+    this->rx.clear();
+    this->rx_pos = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    if (!this->open_socket())
+    {
+        return 0;
+    }
+    this->tx.clear();
+    this->tx_ip = ip;
+    this->tx_port = port;
+    return 1;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+    IPAddress address;
+    if (!WiFi.hostByName(host, address))
+    {
+        return 0;
+    }
+    return this->beginPacket(address, port);
+}
+
+int WiFiUDP::endPacket()
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(this->tx_port);
+    address.sin_addr.s_addr = (uint32_t)this->tx_ip;
+    ssize_t sent = sendto(this->fd, this->tx.data(), this->tx.size(), 0, (sockaddr *)&address, sizeof(address));
+    bool complete = sent == (ssize_t)this->tx.size();
+    this->tx.clear();
+    return complete ? 1 : 0;
+}
+
+size_t WiFiUDP::write(uint8_t c)
+{
+    return this->write(&c, 1);
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    size = std::min(size, HOST_UDP_MAX_PACKET - this->tx.size());
+    this->tx.insert(this->tx.end(), buffer, buffer + size);
+    return size;
+}
+
+int WiFiUDP::parsePacket()
+{
+    this->rx.clear();
+    this->rx_pos = 0;
+    if (this->fd < 0)
+    {
+        return 0;
+    }
+
+    uint8_t buffer[HOST_UDP_MAX_PACKET];
+    sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    ssize_t received = recvfrom(this->fd, buffer, sizeof(buffer), MSG_DONTWAIT, (sockaddr *)&address, &length);
+    if (received <= 0)
+    {
+        return 0;
+    }
+    this->rx.assign(buffer, buffer + received);
+    this->remote_ip = IPAddress((uint32_t)address.sin_addr.s_addr);
+    this->remote_port = ntohs(address.sin_port);
+    return received;
+}
+
+int WiFiUDP::available()
+{
+    return this->rx.size() - this->rx_pos;
+}
+
+int WiFiUDP::read()
+{
+    return this->rx_pos < this->rx.size() ? this->rx[this->rx_pos++] : -1;
+}
+
+int WiFiUDP::read(unsigned char *buffer, size_t length)
+{
+    size_t count = std::min(length, this->rx.size() - this->rx_pos);
+    memcpy(buffer, this->rx.data() + this->rx_pos, count);
+    this->rx_pos += count;
+    return count;
+}
+
+int WiFiUDP::read(char *buffer, size_t length)
+{
+    return this->read((unsigned char *)buffer, length);
+}
+
+int WiFiUDP::peek()
+{
+    return this->rx_pos < this->rx.size() ? this->rx[this->rx_pos] : -1;
+}
+
+void WiFiUDP::flush()
+{
+    this->rx_pos = this->rx.size();
+}
+
+IPAddress WiFiUDP::remoteIP()
+{
+    return this->remote_ip;
+}
+
+uint16_t WiFiUDP::remotePort()
+{
+    return this->remote_port;
+}
@@ -0,0 +1,49 @@
+#ifndef ARDUINO_HOST_WIFI_UDP_H
+#define ARDUINO_HOST_WIFI_UDP_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include <vector>
+
+// Datagrams over POSIX sockets. Multicast groups are joined on the loopback
+// interface, so several instances in one process hear each other.
+class WiFiUDP : public Stream
+{
+public:
+    WiFiUDP();
+    ~WiFiUDP();
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress address, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char *host, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    int parsePacket();
+    int available() override;
+    int read() override;
+    int read(unsigned char *buffer, size_t length);
+    int read(char *buffer, size_t length);
+    int peek() override;
+    void flush() override;
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+private:
+    bool open_socket();
+
+    int fd;
+    IPAddress remote_ip;
+    uint16_t remote_port;
+    std::vector<uint8_t> tx;
+    std::vector<uint8_t> rx;
+    size_t rx_pos;
+    IPAddress tx_ip;
+    uint16_t tx_port;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#include "esp32/rom/crc.h"
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *buffer++;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
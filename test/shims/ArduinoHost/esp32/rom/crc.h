@@ -0,0 +1,10 @@
+#ifndef ARDUINO_HOST_ROM_CRC_H
+#define ARDUINO_HOST_ROM_CRC_H
+
+#include <stdint.h>
+
+// Same convention as the ROM: the running crc is passed in and returned
+// without the final inversion being visible to the caller
+uint32_t crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef ARDUINO_HOST_ROM_MINIZ_H
+#define ARDUINO_HOST_ROM_MINIZ_H
+
+// The ROM carries tinfl; on the host it comes from the miniz package in
+// platformio.ini
+#include <miniz.h>
+
+#endif
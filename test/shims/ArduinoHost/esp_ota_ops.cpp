@@ -0,0 +1,143 @@
+#include "esp_ota_ops.h"
+#include <mutex>
+
+static std::mutex ota_mutex;
+static const esp_partition_t *boot_partition = NULL;
+static const esp_partition_t *update_partition = NULL;
+static esp_ota_handle_t next_handle = 1;
+static esp_ota_handle_t open_handle = 0;
+static size_t written = 0;
+static size_t last_image_size = 0;
+
+static const esp_partition_t *app(int slot)
+{
+    return host_add_partition(slot == 0 ? "app0" : "app1", ESP_PARTITION_TYPE_APP,
+                              slot == 0 ? ESP_PARTITION_SUBTYPE_APP_OTA_0 : ESP_PARTITION_SUBTYPE_APP_OTA_1,
+                              HOST_OTA_APP_SIZE);
+}
+
+const esp_partition_t *esp_ota_get_running_partition()
+{
+    return app(0);
+}
+
+const esp_partition_t *esp_ota_get_boot_partition()
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    return boot_partition != NULL ? boot_partition : app(0);
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    app(0);
+    return app(1);
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *handle)
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    if (partition == NULL || partition == app(0) || handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (image_size != OTA_SIZE_UNKNOWN && image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (image_size != OTA_WITH_SEQUENTIAL_WRITES)
+    {
+        size_t erase = image_size == OTA_SIZE_UNKNOWN ? partition->size : (image_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+        esp_err_t err = esp_partition_erase_range(partition, 0, erase);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    update_partition = partition;
+    open_handle = next_handle++;
+    written = 0;
+    *handle = open_handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    if (handle == 0 || handle != open_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Sequential writes erase each sector as the image reaches it
+    for (size_t sector = (written + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+         sector < written + size; sector += SPI_FLASH_SEC_SIZE)
+    {
+        uint8_t *flash = host_partition_data(update_partition);
+        bool erased = true;
+        for (size_t i = sector; i < sector + SPI_FLASH_SEC_SIZE && erased; i++)
+        {
+            erased = flash[i] == 0xff;
+        }
+        if (!erased && esp_partition_erase_range(update_partition, sector, SPI_FLASH_SEC_SIZE) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+    }
+    esp_err_t err = esp_partition_write(update_partition, written, data, size);
+    if (err == ESP_OK)
+    {
+        written += size;
+    }
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    if (handle == 0 || handle != open_handle)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    open_handle = 0;
+    if (written == 0)
+    {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    last_image_size = written;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    if (handle == 0 || handle != open_handle)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    open_handle = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    if (partition == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    boot_partition = partition;
+    return ESP_OK;
+}
+
+size_t host_ota_image_size()
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    return last_image_size;
+}
+
+void host_reset_ota()
+{
+    std::lock_guard<std::mutex> lock(ota_mutex);
+    boot_partition = NULL;
+    open_handle = 0;
+    last_image_size = 0;
+}
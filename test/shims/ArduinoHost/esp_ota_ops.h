@@ -0,0 +1,29 @@
+#ifndef ARDUINO_HOST_ESP_OTA_OPS_H
+#define ARDUINO_HOST_ESP_OTA_OPS_H
+
+#include "esp_partition.h"
+
+// Two app slots laid out like default_larger_ota.csv; the running image is
+// whatever the test wrote into app0 with host_partition_data()
+
+typedef uint32_t esp_ota_handle_t;
+
+#define OTA_SIZE_UNKNOWN 0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+#define HOST_OTA_APP_SIZE 0x180000
+
+const esp_partition_t *esp_ota_get_running_partition();
+const esp_partition_t *esp_ota_get_boot_partition();
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+
+// Bytes written by the last successful update
+size_t host_ota_image_size();
+// Boots from app0 again and forgets the last update
+void host_reset_ota();
+
+#endif
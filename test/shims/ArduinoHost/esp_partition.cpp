@@ -0,0 +1,146 @@
+#include "esp_partition.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct host_partition
+{
+    esp_partition_t info;
+    std::vector<uint8_t> data;
+    host_partition_stats stats;
+};
+
+static std::mutex partitions_mutex;
+static std::vector<std::unique_ptr<host_partition>> partitions;
+
+static host_partition *find(const esp_partition_t *partition)
+{
+    for (auto &candidate : partitions)
+    {
+        if (&candidate->info == partition)
+        {
+            return candidate.get();
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t *host_add_partition(const char *label, esp_partition_type_t type, esp_partition_subtype_t subtype, uint32_t size)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    uint32_t address = 0x9000;
+    for (auto &candidate : partitions)
+    {
+        if (strcmp(candidate->info.label, label) == 0)
+        {
+            return &candidate->info;
+        }
+        address = candidate->info.address + candidate->info.size;
+    }
+
+    std::unique_ptr<host_partition> partition(new host_partition());
+    partition->info.type = type;
+    partition->info.subtype = subtype;
+    partition->info.address = address;
+    partition->info.size = size;
+    strncpy(partition->info.label, label, sizeof(partition->info.label) - 1);
+    partition->info.encrypted = false;
+    partition->data.assign(size, 0xff);
+    memset(&partition->stats, 0, sizeof(partition->stats));
+    partitions.push_back(std::move(partition));
+    return &partitions.back()->info;
+}
+
+uint8_t *host_partition_data(const esp_partition_t *partition)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    host_partition *found = find(partition);
+    return found != NULL ? found->data.data() : NULL;
+}
+
+host_partition_stats &host_partition_counters(const esp_partition_t *partition)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    return find(partition)->stats;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    for (auto &candidate : partitions)
+    {
+        if ((type == ESP_PARTITION_TYPE_ANY || candidate->info.type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || candidate->info.subtype == subtype) &&
+            (label == NULL || strcmp(candidate->info.label, label) == 0))
+        {
+            return &candidate->info;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    host_partition *found = find(partition);
+    if (found == NULL || buffer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > found->info.size || size > found->info.size - offset)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buffer, found->data.data() + offset, size);
+    found->stats.reads++;
+    found->stats.bytes_read += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    host_partition *found = find(partition);
+    if (found == NULL || buffer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > found->info.size || size > found->info.size - offset)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Programming can only clear bits
+    const uint8_t *bytes = (const uint8_t *)buffer;
+    for (size_t i = 0; i < size; i++)
+    {
+        found->data[offset + i] &= bytes[i];
+    }
+    found->stats.writes++;
+    found->stats.bytes_written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    std::lock_guard<std::mutex> lock(partitions_mutex);
+    host_partition *found = find(partition);
+    if (found == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > found->info.size || size > found->info.size - offset)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(found->data.data() + offset, 0xff, size);
+    found->stats.erases += size / SPI_FLASH_SEC_SIZE;
+    found->stats.bytes_erased += size;
+    return ESP_OK;
+}
@@ -0,0 +1,61 @@
+#ifndef ARDUINO_HOST_ESP_PARTITION_H
+#define ARDUINO_HOST_ESP_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Partitions are RAM buffers with NOR flash rules: erase sets whole sectors
+// to 0xff and a write can only clear bits. See host_add_partition().
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+    ESP_PARTITION_TYPE_ANY = 0xff,
+} esp_partition_type_t;
+
+typedef enum
+{
+    ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+    ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+    ESP_PARTITION_SUBTYPE_DATA_OTA = 0x00,
+    ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+    ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef struct
+{
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+typedef struct
+{
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long erases;
+    unsigned long bytes_read;
+    unsigned long bytes_written;
+    unsigned long bytes_erased;
+} host_partition_stats;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *buffer, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *buffer, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+// Creates an erased partition, or returns the existing one with this label
+const esp_partition_t *host_add_partition(const char *label, esp_partition_type_t type, esp_partition_subtype_t subtype, uint32_t size);
+uint8_t *host_partition_data(const esp_partition_t *partition);
+host_partition_stats &host_partition_counters(const esp_partition_t *partition);
+
+#endif
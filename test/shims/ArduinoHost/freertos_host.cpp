@@ -0,0 +1,228 @@
+#include "freertos_host.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+void delay(unsigned long ms);
+unsigned long millis();
+
+struct host_task
+{
+    TaskFunction_t function;
+    void *parameter;
+};
+
+struct host_queue
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+};
+
+struct host_semaphore
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    unsigned int count;
+};
+
+static thread_local TaskHandle_t current_task = NULL;
+static std::recursive_mutex critical;
+
+// Waits on a condition for at most ticks, where portMAX_DELAY never expires
+template <typename Lock, typename Predicate>
+static bool wait_for(std::condition_variable &changed, Lock &lock, TickType_t ticks, Predicate ready)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        changed.wait(lock, ready);
+        return true;
+    }
+    return changed.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_size,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    TaskHandle_t task = new host_task{function, parameter};
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    // Tasks never return on the device; the process ends with them running
+    std::thread([task]()
+                {
+                    current_task = task;
+                    task->function(task->parameter); })
+        .detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_size,
+                       void *parameter, UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_size, parameter, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == NULL || handle == current_task)
+    {
+        // Parks the calling thread; there is no safe way to end it from here
+        for (;;)
+        {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delay(ticks);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return current_task;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return current_task == NULL ? 1 : 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = new host_queue();
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!wait_for(queue->changed, lock, ticks, [queue]()
+                  { return queue->items.size() < queue->length; }))
+    {
+        return pdFALSE;
+    }
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return xQueueSend(queue, item, ticks);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!wait_for(queue->changed, lock, ticks, [queue]()
+                  { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!wait_for(queue->changed, lock, ticks, [queue]()
+                  { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->items.clear();
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t semaphore = new host_semaphore();
+    semaphore->count = 1;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    SemaphoreHandle_t semaphore = new host_semaphore();
+    semaphore->count = 0;
+    return semaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (!wait_for(semaphore->changed, lock, ticks, [semaphore]()
+                  { return semaphore->count > 0; }))
+    {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->count > 0)
+    {
+        return pdFALSE;
+    }
+    semaphore->count++;
+    semaphore->changed.notify_one();
+    return pdTRUE;
+}
+
+void host_enter_critical()
+{
+    critical.lock();
+}
+
+void host_exit_critical()
+{
+    critical.unlock();
+}
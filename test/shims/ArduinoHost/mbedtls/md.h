@@ -0,0 +1,41 @@
+#ifndef ARDUINO_HOST_MBEDTLS_MD_H
+#define ARDUINO_HOST_MBEDTLS_MD_H
+
+#include "sha256.h"
+
+// SHA-256 is the only digest the host provides
+
+typedef enum
+{
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6,
+} mbedtls_md_type_t;
+
+typedef struct
+{
+    mbedtls_md_type_t type;
+    unsigned char size;
+    unsigned char block_size;
+} mbedtls_md_info_t;
+
+typedef struct
+{
+    const mbedtls_md_info_t *md_info;
+    mbedtls_sha256_context sha;
+    unsigned char opad[64];
+    int hmac;
+} mbedtls_md_context_t;
+
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type);
+void mbedtls_md_init(mbedtls_md_context_t *ctx);
+void mbedtls_md_free(mbedtls_md_context_t *ctx);
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac);
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen);
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output);
+int mbedtls_md_hmac(const mbedtls_md_info_t *md_info, const unsigned char *key, size_t keylen,
+                    const unsigned char *input, size_t ilen, unsigned char *output);
+
+#endif
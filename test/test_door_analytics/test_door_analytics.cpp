@@ -0,0 +1,213 @@
+// The P-square open duration quantiles of DoorAnalytics against the exact
+// quantiles of what was fed in, for a few shapes of door usage, plus the
+// cost of each update and a checkpoint round trip through Preferences.
+
+#include <ArduinoHost.h>
+#include <DoorAnalytics.h>
+#include <Preferences.h>
+#include <unity.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#define TEST_EVENTS 200000
+#define TEST_KEY "analytics"
+
+static void report(const char *format, ...)
+{
+    char message[200];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    TEST_MESSAGE(message);
+}
+
+// One open of duration_ms, without a wall clock
+static void open_for(DoorAnalytics &analytics, uint32_t duration_ms)
+{
+    analytics.opened(0);
+    host_advance_clock(duration_ms);
+    analytics.closed(0);
+}
+
+// Nearest rank, in seconds, like the sketch before it has five observations
+static float exact_quantile(std::vector<uint32_t> durations, float probability)
+{
+    size_t rank = std::max((size_t)ceil(probability * durations.size()), (size_t)1) - 1;
+    std::nth_element(durations.begin(), durations.begin() + rank, durations.end());
+    return durations[rank] / 1000.0f;
+}
+
+// Feeds TEST_EVENTS durations drawn by next and checks every estimate is
+// within tolerance of the exact quantile, relative to it
+static void check_accuracy(const char *name, std::function<uint32_t()> next, const float tolerance[3])
+{
+    DoorAnalytics analytics(22, 6, 60 * 60 * 1000);
+    std::vector<uint32_t> durations;
+    durations.reserve(TEST_EVENTS);
+    for (int i = 0; i < TEST_EVENTS; i++)
+    {
+        durations.push_back(next());
+        open_for(analytics, durations.back());
+    }
+
+    const float probabilities[3] = {0.50f, 0.95f, 0.99f};
+    char summary[200];
+    int length = snprintf(summary, sizeof(summary), "%s:", name);
+    for (int i = 0; i < 3; i++)
+    {
+        float exact = exact_quantile(durations, probabilities[i]);
+        float estimate = analytics.open_duration_quantile(probabilities[i]);
+        float error = fabsf(estimate - exact) / exact;
+        length += snprintf(summary + length, sizeof(summary) - length, " p%d %.1f s vs %.1f s (%.2f%%)",
+                           (int)(probabilities[i] * 100), estimate, exact, 100 * error);
+        TEST_ASSERT_FLOAT_WITHIN_MESSAGE(tolerance[i] * exact, exact, estimate, name);
+    }
+    TEST_MESSAGE(summary);
+    TEST_ASSERT_EQUAL(TEST_EVENTS, analytics.state().opens);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_lognormal_durations()
+{
+    // Most opens are a minute or so, some are left open for a long while
+    std::mt19937 generator(35);
+    std::lognormal_distribution<double> duration_s(4.0, 1.0);
+    const float tolerance[3] = {0.01f, 0.02f, 0.03f};
+    check_accuracy("lognormal", [&]()
+                   { return (uint32_t)(duration_s(generator) * 1000); },
+                   tolerance);
+}
+
+void test_bimodal_durations()
+{
+    // Drive-through opens of ~20 s, and one in ten a car washed in the driveway
+    std::mt19937 generator(36);
+    std::normal_distribution<double> quick(20.0, 4.0);
+    std::normal_distribution<double> long_open(1800.0, 300.0);
+    std::uniform_real_distribution<double> which(0, 1);
+    const float tolerance[3] = {0.03f, 0.05f, 0.05f};
+    check_accuracy("bimodal", [&]()
+                   {
+                       double seconds = which(generator) < 0.9 ? quick(generator) : long_open(generator);
+                       return (uint32_t)(std::max(seconds, 1.0) * 1000); },
+                   tolerance);
+}
+
+void test_a_change_in_habits_is_caught_up_with()
+{
+    // Opens get three times longer after the first tenth of the run. The
+    // markers only move a step per observation, so the estimate lags such a
+    // change for a while; by the end it has to agree with the whole history.
+    std::mt19937 generator(37);
+    std::uniform_real_distribution<double> jitter(0.5, 1.5);
+    int i = 0;
+    const float tolerance[3] = {0.02f, 0.02f, 0.02f};
+    check_accuracy("change in habits", [&]()
+                   { return (uint32_t)((i++ < TEST_EVENTS / 10 ? 30.0 : 90.0) * jitter(generator) * 1000); },
+                   tolerance);
+}
+
+void test_few_observations_are_exact()
+{
+    DoorAnalytics analytics(22, 6, 60 * 60 * 1000);
+    TEST_ASSERT_EQUAL_FLOAT(0, analytics.open_duration_quantile(0.5f));
+
+    const uint32_t durations[] = {40000, 10000, 30000, 20000};
+    for (uint32_t duration : durations)
+    {
+        open_for(analytics, duration);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(20, analytics.open_duration_quantile(0.50f));
+    TEST_ASSERT_EQUAL_FLOAT(40, analytics.open_duration_quantile(0.95f));
+    TEST_ASSERT_EQUAL_FLOAT(40, analytics.open_duration_quantile(0.99f));
+}
+
+void test_update_cost_is_constant()
+{
+    DoorAnalytics analytics(22, 6, 60 * 60 * 1000);
+    std::mt19937 generator(38);
+    std::lognormal_distribution<double> duration_s(4.0, 1.0);
+
+    // closed() updates all three sketches; time it over the first and the
+    // last tenth of the run
+    const int slice = TEST_EVENTS / 10;
+    double slice_ns[2] = {0, 0};
+    for (int i = 0; i < TEST_EVENTS; i++)
+    {
+        analytics.opened(0);
+        host_advance_clock((uint32_t)(duration_s(generator) * 1000));
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        analytics.closed(0);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+        if (i < slice)
+        {
+            slice_ns[0] += ns;
+        }
+        else if (i >= TEST_EVENTS - slice)
+        {
+            slice_ns[1] += ns;
+        }
+    }
+
+    report("closed(): %.0f ns per update over the first %d opens, %.0f ns over the last %d; %u bytes of state",
+           slice_ns[0] / slice, slice, slice_ns[1] / slice, slice, (unsigned)sizeof(door_analytics_state));
+    // Nothing grows with the number of observations
+    TEST_ASSERT_LESS_THAN(2 * slice_ns[0] + 1000.0 * slice, slice_ns[1]);
+}
+
+void test_checkpoint_round_trip()
+{
+    Preferences preferences;
+    preferences.begin("test", false);
+    DoorAnalytics analytics(22, 6, 60 * 60 * 1000);
+    analytics.begin(preferences, TEST_KEY);
+
+    std::mt19937 generator(39);
+    std::lognormal_distribution<double> duration_s(4.0, 1.0);
+    for (int i = 0; i < 1000; i++)
+    {
+        open_for(analytics, (uint32_t)(duration_s(generator) * 1000));
+    }
+    TEST_ASSERT_TRUE(analytics.checkpoint());
+
+    DoorAnalytics restarted(22, 6, 60 * 60 * 1000);
+    restarted.begin(preferences, TEST_KEY);
+    TEST_ASSERT_EQUAL_MEMORY(&analytics.state(), &restarted.state(), sizeof(door_analytics_state));
+
+    // Both carry on exactly alike
+    for (int i = 0; i < 1000; i++)
+    {
+        uint32_t duration = (uint32_t)(duration_s(generator) * 1000);
+        open_for(analytics, duration);
+        open_for(restarted, duration);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(&analytics.state(), &restarted.state(), sizeof(door_analytics_state));
+    preferences.end();
+}
+
+int main(int argc, char **argv)
+{
+    host_use_manual_clock(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_lognormal_durations);
+    RUN_TEST(test_bimodal_durations);
+    RUN_TEST(test_a_change_in_habits_is_caught_up_with);
+    RUN_TEST(test_few_observations_are_exact);
+    RUN_TEST(test_update_cost_is_constant);
+    RUN_TEST(test_checkpoint_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,161 @@
+// /test through CommandEngine and DoorSimulation while the real door moves:
+// every real transition is still seen by DoorMonitor, and a second
+// simulation asked for meanwhile is turned down instead of sharing the
+// first one's alert state.
+
+#include <ArduinoHost.h>
+#include <CommandEngine.h>
+#include <DoorMonitor.h>
+#include <DoorSimulation.h>
+#include <unity.h>
+#include <utility>
+#include <vector>
+
+#define TEST_PIN 4
+#define TEST_CHECK_INTERVAL 2000
+#define TEST_LOOP_INTERVAL 20
+
+static std::vector<bool> simulated;
+static int rearms;
+static std::vector<std::pair<String, String>> replies;
+static std::vector<door_transition> seen;
+
+static CommandEngine engine;
+static DoorMonitor monitor(TEST_PIN, TEST_CHECK_INTERVAL);
+static DoorSimulation simulation([](bool opened)
+                                 { simulated.push_back(opened); },
+                                 []()
+                                 { rearms++; },
+                                 [](const String &chat_id, const String &text)
+                                 { replies.push_back(std::make_pair(chat_id, text)); });
+
+// One pass of the main loop
+static void loop_once()
+{
+    host_advance_clock(TEST_LOOP_INTERVAL);
+    if (monitor.due())
+    {
+        door_transition transition = monitor.read();
+        if (transition != DOOR_TRANSITION_NONE)
+        {
+            seen.push_back(transition);
+        }
+    }
+    engine.tick();
+}
+
+static void run_for(unsigned long ms)
+{
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += TEST_LOOP_INTERVAL)
+    {
+        loop_once();
+    }
+}
+
+static size_t replies_to(const String &chat_id, const char *text)
+{
+    size_t count = 0;
+    for (const std::pair<String, String> &reply : replies)
+    {
+        count += reply.first == chat_id && reply.second == text;
+    }
+    return count;
+}
+
+void setUp()
+{
+    simulated.clear();
+    rearms = 0;
+    replies.clear();
+    seen.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_real_transitions_are_all_seen_during_a_test()
+{
+    TEST_ASSERT_EQUAL(COMMAND_STARTED, engine.dispatch("1", "Owner", "/test"));
+
+    // The door opens and closes every 3 seconds for the whole test,
+    // including right as the simulated open and close fire
+    std::vector<door_transition> expected;
+    int level = LOW;
+    unsigned long total = DOOR_SIMULATION_START_DELAY + DOOR_SIMULATION_OPEN_DURATION + DOOR_SIMULATION_REARM_DELAY + 3000;
+    for (unsigned long elapsed = 0; elapsed < total; elapsed += 3000)
+    {
+        level = level == LOW ? HIGH : LOW;
+        host_set_pin(TEST_PIN, level);
+        expected.push_back(level == HIGH ? DOOR_TRANSITION_OPENED : DOOR_TRANSITION_CLOSED);
+        run_for(3000);
+    }
+
+    TEST_ASSERT_EQUAL(expected.size(), seen.size());
+    TEST_ASSERT_TRUE(expected == seen);
+    TEST_ASSERT_EQUAL(2, simulated.size());
+    TEST_ASSERT_TRUE(simulated[0]);
+    TEST_ASSERT_FALSE(simulated[1]);
+    TEST_ASSERT_EQUAL(1, rearms);
+    TEST_ASSERT_FALSE(simulation.running());
+    TEST_ASSERT_EQUAL(0, engine.active_sessions());
+}
+
+void test_a_second_simulation_is_turned_down()
+{
+    TEST_ASSERT_EQUAL(COMMAND_STARTED, engine.dispatch("1", "Owner", "/test"));
+    run_for(DOOR_SIMULATION_START_DELAY + 1000);
+    TEST_ASSERT_TRUE(simulation.running());
+
+    // From another chat, and again from the first one
+    TEST_ASSERT_EQUAL(COMMAND_STARTED, engine.dispatch("2", "Guest", "/test"));
+    TEST_ASSERT_EQUAL(COMMAND_STARTED, engine.dispatch("1", "Owner", "/test"));
+    TEST_ASSERT_EQUAL(1, replies_to("2", DOOR_SIMULATION_BUSY_MSG));
+    TEST_ASSERT_EQUAL(1, replies_to("1", DOOR_SIMULATION_BUSY_MSG));
+    TEST_ASSERT_EQUAL(1, engine.active_sessions());
+
+    run_for(DOOR_SIMULATION_OPEN_DURATION + DOOR_SIMULATION_REARM_DELAY);
+    TEST_ASSERT_EQUAL(2, simulated.size());
+    TEST_ASSERT_EQUAL(1, rearms);
+    TEST_ASSERT_FALSE(simulation.running());
+
+    // Free again once the first one is done
+    TEST_ASSERT_EQUAL(COMMAND_STARTED, engine.dispatch("2", "Guest", "/test"));
+    TEST_ASSERT_TRUE(simulation.running());
+    run_for(DOOR_SIMULATION_START_DELAY + DOOR_SIMULATION_OPEN_DURATION + DOOR_SIMULATION_REARM_DELAY + 1000);
+    TEST_ASSERT_EQUAL(4, simulated.size());
+    TEST_ASSERT_FALSE(simulation.running());
+}
+
+void test_claims_are_exclusive()
+{
+    CommandSession first;
+    CommandSession second;
+    second.chat_id = "2";
+    TEST_ASSERT_TRUE(simulation.claim(first));
+    // Claiming again from the owner is fine
+    TEST_ASSERT_TRUE(simulation.claim(first));
+    TEST_ASSERT_FALSE(simulation.claim(second));
+    // Only the owner can release it
+    simulation.release(second);
+    TEST_ASSERT_TRUE(simulation.running());
+    simulation.release(first);
+    TEST_ASSERT_TRUE(simulation.claim(second));
+    simulation.release(second);
+    TEST_ASSERT_FALSE(simulation.running());
+}
+
+int main(int argc, char **argv)
+{
+    host_use_manual_clock(true);
+    host_set_pin(TEST_PIN, LOW);
+    monitor.begin();
+    engine.on("/test", [](CommandSession &session)
+              { simulation.test_command(session); });
+
+    UNITY_BEGIN();
+    RUN_TEST(test_real_transitions_are_all_seen_during_a_test);
+    RUN_TEST(test_a_second_simulation_is_turned_down);
+    RUN_TEST(test_claims_are_exclusive);
+    return UNITY_END();
+}
@@ -0,0 +1,199 @@
+// EventHistory over 100k appends on a partition the size of the one in
+// default_larger_ota.csv, so the log wraps a few times. Every query is
+// checked against a brute force scan of what the log should still hold, and
+// the run reports append cost, query latency, flash reads and wear.
+
+#include <ArduinoHost.h>
+#include <EventHistory.h>
+#include <unity.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <vector>
+
+#define TEST_PARTITION_LABEL "history"
+#define TEST_PARTITION_SIZE 0x90000
+#define TEST_EVENTS 100000
+#define TEST_QUERIES 2000
+
+static const esp_partition_t *partition;
+// Every record ever appended, in order; the log holds the newest of them
+static std::vector<history_record> appended;
+
+static uint32_t retained(EventHistory &history)
+{
+    return std::min((uint32_t)appended.size(), history.size());
+}
+
+// What query() should hand out for [from, to]
+static std::vector<uint32_t> expected_sequences(EventHistory &history, uint32_t from, uint32_t to)
+{
+    std::vector<uint32_t> sequences;
+    for (size_t i = appended.size() - retained(history); i < appended.size(); i++)
+    {
+        if (appended[i].timestamp >= from && appended[i].timestamp <= to)
+        {
+            sequences.push_back(appended[i].sequence);
+        }
+    }
+    return sequences;
+}
+
+static std::vector<uint32_t> queried_sequences(EventHistory &history, uint32_t from, uint32_t to)
+{
+    std::vector<uint32_t> sequences;
+    history.query(from, to, [&](const history_record &record)
+                  {
+                      sequences.push_back(record.sequence);
+                      return true; });
+    return sequences;
+}
+
+static void report(const char *format, ...)
+{
+    char message[200];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    TEST_MESSAGE(message);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_appends_wrap_around_the_partition()
+{
+    EventHistory history(TEST_PARTITION_LABEL);
+    TEST_ASSERT_TRUE(history.begin());
+
+    // Door events minutes to hours apart, with the odd clock step backwards
+    // that append() has to clamp
+    host_seed_random(30);
+    uint32_t timestamp = 1700000000;
+    for (uint32_t i = 0; i < TEST_EVENTS; i++)
+    {
+        timestamp += esp_random() % 20 == 0 ? -(int32_t)(esp_random() % 600) : esp_random() % 7200;
+        history_event_type type = i % 2 == 0 ? HISTORY_DOOR_OPENED : HISTORY_DOOR_CLOSED;
+        TEST_ASSERT_TRUE(history.append(type, timestamp, HISTORY_FLAG_TIME_SYNCED));
+
+        history_record record;
+        record.timestamp = appended.empty() ? timestamp : std::max(timestamp, appended.back().timestamp);
+        record.sequence = i;
+        appended.push_back(record);
+    }
+
+    uint32_t records_per_sector = HISTORY_SECTOR_SIZE / sizeof(history_record);
+    uint32_t sectors = TEST_PARTITION_SIZE / HISTORY_SECTOR_SIZE;
+    TEST_ASSERT_EQUAL(sectors * records_per_sector, history.capacity());
+    // The sector being filled plus every other sector, full
+    TEST_ASSERT_EQUAL((TEST_EVENTS - 1) % records_per_sector + 1 + (sectors - 1) * records_per_sector, history.size());
+
+    const history_stats &stats = history.stats();
+    const host_partition_stats &flash = host_partition_counters(partition);
+    report("%u appends: avg %.2f us, max %lu us; %lu sector erases (%.1f per sector), %lu bytes written",
+           TEST_EVENTS, (double)stats.total_append_us / stats.appends, stats.max_append_us,
+           stats.sector_erases, (double)flash.erases / sectors, flash.bytes_written);
+    TEST_ASSERT_EQUAL((TEST_EVENTS + records_per_sector - 1) / records_per_sector, stats.sector_erases);
+}
+
+void test_queries_match_a_brute_force_scan()
+{
+    EventHistory history(TEST_PARTITION_LABEL);
+    TEST_ASSERT_TRUE(history.begin());
+    uint32_t oldest = appended[appended.size() - retained(history)].timestamp;
+    uint32_t newest = appended.back().timestamp;
+
+    host_seed_random(31);
+    unsigned long total_us = 0;
+    unsigned long max_us = 0;
+    host_partition_stats before = host_partition_counters(partition);
+    for (int i = 0; i < TEST_QUERIES; i++)
+    {
+        // Mostly short windows, like /history; some reach before the oldest
+        // record or past the newest
+        uint32_t from = oldest - 3600 + esp_random() % (newest - oldest + 7200);
+        uint32_t span = i % 10 == 0 ? esp_random() % (newest - oldest) : esp_random() % (7 * 24 * 3600);
+        uint32_t to = from + span;
+
+        unsigned long started = micros();
+        std::vector<uint32_t> queried = queried_sequences(history, from, to);
+        unsigned long duration = micros() - started;
+        total_us += duration;
+        max_us = std::max(max_us, duration);
+
+        std::vector<uint32_t> expected = expected_sequences(history, from, to);
+        TEST_ASSERT_EQUAL(expected.size(), queried.size());
+        TEST_ASSERT_TRUE(expected == queried);
+    }
+    const host_partition_stats &after = host_partition_counters(partition);
+    report("%d queries: avg %.1f us, max %lu us, avg %.0f flash bytes read",
+           TEST_QUERIES, (double)total_us / TEST_QUERIES, max_us,
+           (double)(after.bytes_read - before.bytes_read) / TEST_QUERIES);
+}
+
+void test_a_narrow_query_only_reads_the_sectors_it_needs()
+{
+    EventHistory history(TEST_PARTITION_LABEL);
+    TEST_ASSERT_TRUE(history.begin());
+    const history_record &middle = appended[appended.size() - retained(history) / 2];
+
+    host_partition_stats before = host_partition_counters(partition);
+    std::vector<uint32_t> queried = queried_sequences(history, middle.timestamp, middle.timestamp + 3600);
+    const host_partition_stats &after = host_partition_counters(partition);
+
+    TEST_ASSERT_TRUE(expected_sequences(history, middle.timestamp, middle.timestamp + 3600) == queried);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * HISTORY_SECTOR_SIZE, after.bytes_read - before.bytes_read);
+}
+
+void test_a_query_stops_when_the_callback_says_so()
+{
+    EventHistory history(TEST_PARTITION_LABEL);
+    TEST_ASSERT_TRUE(history.begin());
+
+    std::vector<uint32_t> queried;
+    history.query(0, UINT32_MAX, [&](const history_record &record)
+                  {
+                      queried.push_back(record.sequence);
+                      return queried.size() < 50; });
+    TEST_ASSERT_EQUAL(50, queried.size());
+    TEST_ASSERT_EQUAL(appended[appended.size() - retained(history)].sequence, queried.front());
+}
+
+void test_begin_resumes_after_a_restart()
+{
+    EventHistory history(TEST_PARTITION_LABEL);
+    TEST_ASSERT_TRUE(history.begin());
+    uint32_t size = history.size();
+
+    TEST_ASSERT_TRUE(history.append(HISTORY_DOOR_OPENED, appended.back().timestamp + 60, HISTORY_FLAG_TIME_SYNCED));
+    history_record record;
+    record.timestamp = appended.back().timestamp + 60;
+    record.sequence = appended.back().sequence + 1;
+    appended.push_back(record);
+
+    EventHistory restarted(TEST_PARTITION_LABEL);
+    TEST_ASSERT_TRUE(restarted.begin());
+    TEST_ASSERT_EQUAL(size + 1, restarted.size());
+    std::vector<uint32_t> newest = queried_sequences(restarted, record.timestamp, record.timestamp);
+    TEST_ASSERT_EQUAL(1, newest.size());
+    TEST_ASSERT_EQUAL(record.sequence, newest[0]);
+}
+
+int main(int argc, char **argv)
+{
+    partition = host_add_partition(TEST_PARTITION_LABEL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, TEST_PARTITION_SIZE);
+    appended.reserve(TEST_EVENTS + 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_appends_wrap_around_the_partition);
+    RUN_TEST(test_queries_match_a_brute_force_scan);
+    RUN_TEST(test_a_narrow_query_only_reads_the_sectors_it_needs);
+    RUN_TEST(test_a_query_stops_when_the_callback_says_so);
+    RUN_TEST(test_begin_resumes_after_a_restart);
+    return UNITY_END();
+}
@@ -0,0 +1,298 @@
+// Several Fleet nodes in one process over loopback multicast: heartbeats
+// reach every node, concurrent claims elect exactly one, and an eavesdropper
+// replaying a captured datagram or forging a stale one gets nowhere.
+
+#include <ArduinoHost.h>
+#include <Fleet.h>
+#include <unity.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "test fleet"
+#define TEST_SECRET "test fleet secret"
+#define TEST_ADDRESS "239.255.71.36"
+#define TEST_HEARTBEAT_INTERVAL 1000
+#define TEST_ELECTION_WINDOW 300
+#define TEST_CLAIM_TTL 2000
+#define TEST_NODES 3
+// Node id of the forged datagrams
+#define TEST_FORGED_NODE 0x0000f00d
+
+static const uint16_t port = 34330 + getpid() % 1000;
+static Fleet *nodes[TEST_NODES];
+static const char *names[TEST_NODES] = {"north", "south", "east"};
+// Listens to the group like any node and sends whatever it likes to it
+static WiFiUDP eavesdropper;
+static IPAddress group_address;
+
+static void tick_all(unsigned long ms)
+{
+    unsigned long started = millis();
+    while (millis() - started < ms)
+    {
+        for (Fleet *node : nodes)
+        {
+            node->tick();
+        }
+        delay(5);
+    }
+}
+
+static void send_raw(const std::vector<uint8_t> &datagram)
+{
+    TEST_ASSERT_TRUE(eavesdropper.beginPacket(group_address, port));
+    eavesdropper.write(datagram.data(), datagram.size());
+    TEST_ASSERT_TRUE(eavesdropper.endPacket());
+}
+
+// A heartbeat from TEST_FORGED_NODE, signed under secret
+static std::vector<uint8_t> forge_heartbeat(uint32_t sequence, uint32_t timestamp, const char *secret)
+{
+    fleet_header header;
+    memcpy(header.magic, FLEET_MAGIC, sizeof(header.magic));
+    header.version = FLEET_VERSION;
+    header.type = FLEET_HEARTBEAT;
+    header.reserved = 0;
+    header.group = crc32_le(0, (const uint8_t *)TEST_GROUP, strlen(TEST_GROUP));
+    header.node_id = TEST_FORGED_NODE;
+    header.boot = 1;
+    header.sequence = sequence;
+    header.timestamp = timestamp;
+
+    fleet_digest digest;
+    memset(&digest, 0, sizeof(digest));
+    digest.heartbeat_interval_s = 60;
+    strcpy(digest.name, "forged");
+    strcpy(digest.zone, "shed");
+
+    std::vector<uint8_t> datagram((const uint8_t *)&header, (const uint8_t *)&header + sizeof(header));
+    datagram.insert(datagram.end(), (const uint8_t *)&digest, (const uint8_t *)&digest + sizeof(digest));
+    uint8_t hmac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)secret, strlen(secret),
+                    datagram.data(), datagram.size(), hmac);
+    datagram.insert(datagram.end(), hmac, hmac + FLEET_TAG_SIZE);
+    return datagram;
+}
+
+static bool knows(Fleet &fleet, uint32_t node_id)
+{
+    for (size_t i = 0; i < fleet.node_count(); i++)
+    {
+        if (fleet.node(i).node_id == node_id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_heartbeats_reach_every_node()
+{
+    unsigned long started = millis();
+    bool complete = false;
+    while (!complete && millis() - started < 5 * TEST_HEARTBEAT_INTERVAL)
+    {
+        tick_all(50);
+        complete = true;
+        for (Fleet *node : nodes)
+        {
+            complete = complete && node->node_count() == TEST_NODES - 1;
+        }
+    }
+    TEST_ASSERT_TRUE(complete);
+
+    for (int i = 0; i < TEST_NODES; i++)
+    {
+        for (int j = 0; j < TEST_NODES; j++)
+        {
+            TEST_ASSERT_TRUE(i == j || knows(*nodes[i], nodes[j]->node_id()));
+        }
+        // Each peer under the name it announced
+        for (size_t k = 0; k < nodes[i]->node_count(); k++)
+        {
+            const fleet_node &peer = nodes[i]->node(k);
+            for (int j = 0; j < TEST_NODES; j++)
+            {
+                TEST_ASSERT_TRUE(nodes[j]->node_id() != peer.node_id || strcmp(names[j], peer.digest.name) == 0);
+            }
+        }
+        TEST_ASSERT_EQUAL(0, nodes[i]->stats().rejected);
+        TEST_ASSERT_EQUAL(0, nodes[i]->stats().replayed);
+    }
+}
+
+// Outcome of the last elect_all() on each node
+static bool won[TEST_NODES];
+
+// Runs elect(alert) on every node at once and returns how many won
+static int elect_all(fleet_alert_type alert)
+{
+    std::atomic<bool> go(false);
+    std::vector<std::thread> electors;
+    for (int i = 0; i < TEST_NODES; i++)
+    {
+        electors.push_back(std::thread([i, alert, &go]()
+                                       {
+                                           while (!go)
+                                           {
+                                               std::this_thread::yield();
+                                           }
+                                           won[i] = nodes[i]->elect(alert); }));
+    }
+    go = true;
+    for (std::thread &elector : electors)
+    {
+        elector.join();
+    }
+
+    int winners = 0;
+    for (int i = 0; i < TEST_NODES; i++)
+    {
+        winners += won[i];
+    }
+    return winners;
+}
+
+void test_concurrent_claims_elect_one_node()
+{
+    // Every node saw the door open at the same moment. Whichever claims
+    // first wins, unless others claimed before hearing it; then the lowest
+    // node id among them does.
+    TEST_ASSERT_EQUAL(1, elect_all(FLEET_ALERT_OPENED));
+    unsigned long won = 0;
+    unsigned long lost = 0;
+    for (Fleet *node : nodes)
+    {
+        won += node->stats().elections_won;
+        lost += node->stats().elections_lost;
+    }
+    TEST_ASSERT_EQUAL(1, won);
+    TEST_ASSERT_EQUAL(TEST_NODES - 1, lost);
+}
+
+void test_a_claim_already_seen_backs_off()
+{
+    // A node sensing the same event late finds the claims and stays quiet
+    // without waiting out an election
+    Fleet *loser = won[0] ? nodes[1] : nodes[0];
+    unsigned long started = millis();
+    TEST_ASSERT_FALSE(loser->elect(FLEET_ALERT_OPENED));
+    TEST_ASSERT_LESS_THAN(TEST_ELECTION_WINDOW, millis() - started);
+
+    // Claims expire, and a different alert is a separate election
+    delay(TEST_CLAIM_TTL);
+    tick_all(2 * TEST_HEARTBEAT_INTERVAL);
+    TEST_ASSERT_EQUAL(1, elect_all(FLEET_ALERT_CLOSED));
+}
+
+void test_a_replayed_datagram_is_dropped()
+{
+    // Capture the heartbeat node 0 sends for its change of state
+    while (eavesdropper.parsePacket() > 0)
+    {
+    }
+    nodes[0]->set_state(true, 1);
+    std::vector<uint8_t> captured;
+    unsigned long started = millis();
+    while (captured.empty() && millis() - started < 5 * TEST_HEARTBEAT_INTERVAL)
+    {
+        tick_all(10);
+        int size;
+        while ((size = eavesdropper.parsePacket()) > 0)
+        {
+            std::vector<uint8_t> datagram(size);
+            eavesdropper.read(datagram.data(), size);
+            fleet_header header;
+            memcpy(&header, datagram.data(), sizeof(header));
+            if (header.node_id == nodes[0]->node_id() && header.type == FLEET_HEARTBEAT)
+            {
+                captured = datagram;
+            }
+        }
+    }
+    TEST_ASSERT_FALSE(captured.empty());
+    // Let every node take the original
+    tick_all(100);
+
+    unsigned long replayed[TEST_NODES];
+    for (int i = 0; i < TEST_NODES; i++)
+    {
+        replayed[i] = nodes[i]->stats().replayed;
+    }
+    send_raw(captured);
+    send_raw(captured);
+    tick_all(100);
+
+    // Node 0 ignores its own datagrams; the others drop both copies
+    TEST_ASSERT_EQUAL(replayed[0], nodes[0]->stats().replayed);
+    TEST_ASSERT_EQUAL(replayed[1] + 2, nodes[1]->stats().replayed);
+    TEST_ASSERT_EQUAL(replayed[2] + 2, nodes[2]->stats().replayed);
+}
+
+void test_a_stale_or_forged_datagram_is_dropped()
+{
+    uint32_t now = time(nullptr);
+    TEST_ASSERT_GREATER_OR_EQUAL(FLEET_MIN_TIMESTAMP, now);
+    unsigned long replayed = nodes[1]->stats().replayed;
+    unsigned long rejected = nodes[1]->stats().rejected;
+
+    // Correctly signed, but two minutes old
+    send_raw(forge_heartbeat(1, now - 120, TEST_SECRET));
+    tick_all(100);
+    TEST_ASSERT_EQUAL(replayed + 1, nodes[1]->stats().replayed);
+    TEST_ASSERT_FALSE(knows(*nodes[1], TEST_FORGED_NODE));
+
+    // Current, but signed with another secret
+    send_raw(forge_heartbeat(2, now, "not the secret"));
+    tick_all(100);
+    TEST_ASSERT_EQUAL(rejected + 1, nodes[1]->stats().rejected);
+    TEST_ASSERT_FALSE(knows(*nodes[1], TEST_FORGED_NODE));
+
+    // The same node with a current timestamp is let in; an older sequence
+    // from it afterwards is not
+    send_raw(forge_heartbeat(3, now, TEST_SECRET));
+    tick_all(100);
+    TEST_ASSERT_TRUE(knows(*nodes[1], TEST_FORGED_NODE));
+    send_raw(forge_heartbeat(2, now, TEST_SECRET));
+    tick_all(100);
+    TEST_ASSERT_EQUAL(replayed + 2, nodes[1]->stats().replayed);
+}
+
+int main(int argc, char **argv)
+{
+    group_address.fromString(TEST_ADDRESS);
+    host_seed_random(36);
+    for (int i = 0; i < TEST_NODES; i++)
+    {
+        nodes[i] = new Fleet(TEST_GROUP, TEST_SECRET, names[i], "garage", TEST_ADDRESS, port,
+                             TEST_HEARTBEAT_INTERVAL, TEST_ELECTION_WINDOW, TEST_CLAIM_TTL);
+        // Node ids come from the MAC
+        host_set_efuse_mac(0x24000000a000 + i);
+        if (!nodes[i]->begin())
+        {
+            return 1;
+        }
+    }
+    if (!eavesdropper.beginMulticast(group_address, port))
+    {
+        return 1;
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_heartbeats_reach_every_node);
+    RUN_TEST(test_concurrent_claims_elect_one_node);
+    RUN_TEST(test_a_claim_already_seen_backs_off);
+    RUN_TEST(test_a_replayed_datagram_is_dropped);
+    RUN_TEST(test_a_stale_or_forged_datagram_is_dropped);
+    return UNITY_END();
+}
@@ -0,0 +1,384 @@
+// readHTTPJson against the path PagerDuty used before it: readHTTPAnswer
+// into a String, then deserializeJson into a DynamicJsonDocument(1024).
+// Both read the same responses from memory; the run reports peak RAM (heap
+// plus documents on the stack) and time per response, and checks that
+// malformed, truncated, chunked and oversized responses are handled without
+// leaking. Run it under pio test -e native_asan as well.
+
+#include <ArduinoHost.h>
+#include <ArduinoJson.h>
+#include <HttpUtils.h>
+#include <PagerDuty.h>
+#include <unity.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+
+#define TEST_TIMEOUT 200
+#define TEST_ITERATIONS 1000
+#define TEST_OLD_DOC_SIZE 1024
+
+// Every heap allocation of the test goes through here, so the bytes in use
+// and their high-water mark are known at any point
+static size_t heap_in_use;
+static size_t heap_peak;
+
+static void *tracked_alloc(size_t size)
+{
+    // The size lives in front of the block, which keeps its alignment
+    size_t *block = (size_t *)malloc(size + 16);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    *block = size;
+    heap_in_use += size;
+    heap_peak = std::max(heap_peak, heap_in_use);
+    return (uint8_t *)block + 16;
+}
+
+static void tracked_free(void *pointer)
+{
+    if (pointer == NULL)
+    {
+        return;
+    }
+    size_t *block = (size_t *)((uint8_t *)pointer - 16);
+    heap_in_use -= *block;
+    free(block);
+}
+
+void *operator new(size_t size)
+{
+    void *pointer = tracked_alloc(size);
+    if (pointer == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    tracked_free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    tracked_free(pointer);
+}
+
+void operator delete(void *pointer, size_t size) noexcept
+{
+    tracked_free(pointer);
+}
+
+void operator delete[](void *pointer, size_t size) noexcept
+{
+    tracked_free(pointer);
+}
+
+// What DynamicJsonDocument allocates with, counted
+struct TrackedAllocator
+{
+    void *allocate(size_t size)
+    {
+        return tracked_alloc(size);
+    }
+
+    void deallocate(void *pointer)
+    {
+        tracked_free(pointer);
+    }
+
+    void *reallocate(void *pointer, size_t size)
+    {
+        void *moved = tracked_alloc(size);
+        if (moved != NULL && pointer != NULL)
+        {
+            size_t *block = (size_t *)((uint8_t *)pointer - 16);
+            memcpy(moved, pointer, std::min(*block, size));
+            tracked_free(pointer);
+        }
+        return moved;
+    }
+};
+
+// Hands out a canned response, as if it had all arrived; closed says
+// whether the server hangs up once it has been read
+class BufferClient : public Client
+{
+public:
+    BufferClient(const std::string &response, bool closed = false) : response(response), position(0), closed(closed), stopped(false) {}
+
+    int connect(IPAddress ip, uint16_t port) override { return 1; }
+    int connect(const char *host, uint16_t port) override { return 1; }
+    size_t write(uint8_t c) override { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) override { return size; }
+    int available() override { return this->stopped ? 0 : this->response.length() - this->position; }
+    int read() override { return this->available() > 0 ? (uint8_t)this->response[this->position++] : -1; }
+    int peek() override { return this->available() > 0 ? (uint8_t)this->response[this->position] : -1; }
+    void flush() override {}
+    void stop() override { this->stopped = true; }
+    uint8_t connected() override { return !this->stopped && (!this->closed || this->available() > 0); }
+    operator bool() override { return this->connected(); }
+    using Print::write;
+
+    int read(uint8_t *buffer, size_t size) override
+    {
+        size_t length = std::min(size, (size_t)this->available());
+        memcpy(buffer, this->response.data() + this->position, length);
+        this->position += length;
+        return length;
+    }
+
+    bool consumed()
+    {
+        return this->position == this->response.length();
+    }
+
+private:
+    std::string response;
+    size_t position;
+    bool closed;
+    bool stopped;
+};
+
+typedef struct
+{
+    int status;
+    std::string pd_status;
+    std::string dedup_key;
+} parsed_response;
+
+static std::string response(int status, const std::string &body)
+{
+    return "HTTP/1.1 " + std::to_string(status) + " Whatever\r\n"
+                                                  "Content-Type: application/json\r\n"
+                                                  "Content-Length: " +
+           std::to_string(body.length()) + "\r\n"
+                                           "Connection: keep-alive\r\n\r\n" +
+           body;
+}
+
+// body cut into chunks of chunk_size, with a trailer after the last one
+static std::string chunked_response(int status, const std::string &body, size_t chunk_size)
+{
+    std::string encoded = "HTTP/1.1 " + std::to_string(status) + " Whatever\r\n"
+                                                                 "Transfer-Encoding: chunked\r\n\r\n";
+    char size_line[16];
+    for (size_t i = 0; i < body.length(); i += chunk_size)
+    {
+        std::string chunk = body.substr(i, chunk_size);
+        snprintf(size_line, sizeof(size_line), "%zx\r\n", chunk.length());
+        encoded += std::string(size_line) + chunk + "\r\n";
+    }
+    return encoded + "0\r\nX-Trailer: 1\r\n\r\n";
+}
+
+static const std::string accepted_body =
+    "{\"status\":\"success\",\"message\":\"Event processed\",\"dedup_key\":\"garage:1f2e3d4c-17\"}";
+
+// A 400 with a long list of errors, still under PAGER_DUTY_MAX_RESPONSE_SIZE
+static std::string rejected_body()
+{
+    std::string body = "{\"status\":\"invalid event\",\"message\":\"Event object is invalid\",\"errors\":[";
+    for (int i = 0; i < 20; i++)
+    {
+        body += std::string(i > 0 ? "," : "") + "\"Length of 'summary' is too long (error " + std::to_string(i) + ")\"";
+    }
+    return body + "]}";
+}
+
+static parsed_response parse_old(Client &client)
+{
+    parsed_response parsed = {0, "", ""};
+    String body;
+    String headers;
+    if (!readHTTPAnswer(&client, body, headers, TEST_TIMEOUT))
+    {
+        return parsed;
+    }
+    BasicJsonDocument<TrackedAllocator> response(TEST_OLD_DOC_SIZE);
+    deserializeJson(response, body);
+    parsed.status = headers.substring(headers.indexOf(' ') + 1).toInt();
+    parsed.pd_status = response["status"] | "";
+    parsed.dedup_key = response["dedup_key"] | "";
+    return parsed;
+}
+
+// Stack space of the documents parse_new uses, which the heap count misses
+static size_t new_stack_bytes;
+
+static parsed_response parse_new(Client &client)
+{
+    StaticJsonDocument<64> filter;
+    filter["status"] = true;
+    filter["dedup_key"] = true;
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> response;
+    new_stack_bytes = sizeof(filter) + sizeof(response);
+
+    parsed_response parsed = {0, "", ""};
+    parsed.status = readHTTPJson(&client, response, filter, PAGER_DUTY_MAX_RESPONSE_SIZE, TEST_TIMEOUT);
+    parsed.pd_status = response["status"] | "";
+    parsed.dedup_key = response["dedup_key"] | "";
+    return parsed;
+}
+
+// Peak RAM used by one parse, beyond what was in use before it
+static size_t peak_ram(parsed_response (*parse)(Client &), const std::string &canned, parsed_response &parsed)
+{
+    BufferClient client(canned);
+    size_t before = heap_in_use;
+    heap_peak = heap_in_use;
+    parsed = parse(client);
+    TEST_ASSERT_TRUE(client.consumed());
+    return heap_peak - before;
+}
+
+static double micros_per_parse(parsed_response (*parse)(Client &), const std::string &canned)
+{
+    unsigned long started = micros();
+    for (int i = 0; i < TEST_ITERATIONS; i++)
+    {
+        BufferClient client(canned);
+        parse(client);
+    }
+    return (double)(micros() - started) / TEST_ITERATIONS;
+}
+
+static void report(const char *format, ...)
+{
+    char message[200];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    TEST_MESSAGE(message);
+}
+
+// Runs readHTTPJson on canned and checks its result and that nothing leaked
+static int parse_checked(const std::string &canned, bool closed, JsonDocument &doc)
+{
+    StaticJsonDocument<64> filter;
+    filter["status"] = true;
+    filter["dedup_key"] = true;
+
+    size_t before = heap_in_use;
+    int status;
+    {
+        BufferClient client(canned, closed);
+        status = readHTTPJson(&client, doc, filter, PAGER_DUTY_MAX_RESPONSE_SIZE, TEST_TIMEOUT);
+    }
+    // Whatever the document holds is counted too
+    doc.clear();
+    TEST_ASSERT_EQUAL(before, heap_in_use);
+    return status;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_both_paths_agree()
+{
+    parsed_response old_parsed;
+    parsed_response new_parsed;
+    peak_ram(parse_old, response(202, accepted_body), old_parsed);
+    peak_ram(parse_new, response(202, accepted_body), new_parsed);
+    TEST_ASSERT_EQUAL(202, old_parsed.status);
+    TEST_ASSERT_EQUAL(202, new_parsed.status);
+    TEST_ASSERT_EQUAL_STRING("success", new_parsed.pd_status.c_str());
+    TEST_ASSERT_EQUAL_STRING(old_parsed.pd_status.c_str(), new_parsed.pd_status.c_str());
+    TEST_ASSERT_EQUAL_STRING(old_parsed.dedup_key.c_str(), new_parsed.dedup_key.c_str());
+
+    peak_ram(parse_old, response(400, rejected_body()), old_parsed);
+    peak_ram(parse_new, response(400, rejected_body()), new_parsed);
+    TEST_ASSERT_EQUAL(400, new_parsed.status);
+    TEST_ASSERT_EQUAL_STRING("invalid event", new_parsed.pd_status.c_str());
+    TEST_ASSERT_EQUAL_STRING(old_parsed.pd_status.c_str(), new_parsed.pd_status.c_str());
+}
+
+void test_peak_ram_and_parse_time()
+{
+    const std::string cases[] = {response(202, accepted_body), response(400, rejected_body())};
+    const char *names[] = {"202 accepted", "400 invalid event"};
+    size_t new_peaks[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        parsed_response parsed;
+        size_t old_peak = peak_ram(parse_old, cases[i], parsed);
+        new_peaks[i] = peak_ram(parse_new, cases[i], parsed) + new_stack_bytes;
+        double old_us = micros_per_parse(parse_old, cases[i]);
+        double new_us = micros_per_parse(parse_new, cases[i]);
+        report("%s, %zu bytes: readHTTPAnswer + DynamicJsonDocument %zu bytes peak, %.1f us; readHTTPJson %zu bytes peak, %.1f us",
+               names[i], cases[i].length(), old_peak, old_us, new_peaks[i], new_us);
+
+        // The old path holds the whole response and a 1 KB document at once
+        TEST_ASSERT_GREATER_THAN(TEST_OLD_DOC_SIZE + cases[i].length() / 2, old_peak);
+        TEST_ASSERT_LESS_THAN(old_peak / 2, new_peaks[i]);
+    }
+
+    // Streaming: a longer body costs no more than a header line's worth
+    TEST_ASSERT_LESS_OR_EQUAL(new_peaks[0] + 128, new_peaks[1]);
+}
+
+void test_chunked_and_close_delimited_bodies()
+{
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> doc;
+    TEST_ASSERT_EQUAL(202, parse_checked(chunked_response(202, accepted_body, 7), false, doc));
+
+    std::string close_delimited = "HTTP/1.1 202 Accepted\r\nConnection: close\r\n\r\n" + accepted_body;
+    TEST_ASSERT_EQUAL(202, parse_checked(close_delimited, true, doc));
+}
+
+void test_oversized_bodies_are_refused()
+{
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> doc;
+    std::string padding(PAGER_DUTY_MAX_RESPONSE_SIZE, 'x');
+    std::string body = "{\"status\":\"success\",\"message\":\"" + padding + "\"}";
+    TEST_ASSERT_EQUAL(HTTP_JSON_TOO_LARGE, parse_checked(response(202, body), false, doc));
+    TEST_ASSERT_EQUAL(HTTP_JSON_TOO_LARGE, parse_checked(chunked_response(202, body, 100), false, doc));
+    TEST_ASSERT_EQUAL(HTTP_JSON_TOO_LARGE, parse_checked("HTTP/1.1 202 Accepted\r\n\r\n" + body, true, doc));
+}
+
+void test_malformed_and_truncated_bodies()
+{
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> doc;
+    TEST_ASSERT_EQUAL(HTTP_JSON_MALFORMED, parse_checked(response(202, "{\"status\":\"success\",}"), false, doc));
+    TEST_ASSERT_EQUAL(HTTP_JSON_MALFORMED, parse_checked(response(202, "<html>Bad gateway</html>"), false, doc));
+
+    // Content-Length promises more than arrives before the server hangs up
+    std::string truncated = response(202, accepted_body);
+    truncated.resize(truncated.length() - 20);
+    TEST_ASSERT_EQUAL(HTTP_JSON_MALFORMED, parse_checked(truncated, true, doc));
+
+    // A chunk size line that is not hex ends the body early
+    std::string bad_chunk = "HTTP/1.1 202 Accepted\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n" + accepted_body + "\r\n0\r\n\r\n";
+    TEST_ASSERT_EQUAL(HTTP_JSON_MALFORMED, parse_checked(bad_chunk, false, doc));
+
+    TEST_ASSERT_EQUAL(0, parse_checked("SSH-2.0-OpenSSH\r\n\r\n", true, doc));
+    TEST_ASSERT_EQUAL(0, parse_checked("", true, doc));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_both_paths_agree);
+    RUN_TEST(test_peak_ram_and_parse_time);
+    RUN_TEST(test_chunked_and_close_delimited_bodies);
+    RUN_TEST(test_oversized_bodies_are_refused);
+    RUN_TEST(test_malformed_and_truncated_bodies);
+    return UNITY_END();
+}
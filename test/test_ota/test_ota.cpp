@@ -0,0 +1,319 @@
+// Round trip of tools/ota_patch.py through OtaUpdater and OtaPatchApplier:
+// the tool uploads to an updater listening on loopback, the patch is
+// inflated with tinfl and applied against the "running" image in app0, and
+// app1 must end up byte for byte equal to the target and be the next boot.
+
+#include <ArduinoHost.h>
+#include <OtaUpdater.h>
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEST_SECRET "test ota secret"
+#define TEST_IMAGE_SIZE (320 * 1024)
+
+static const uint16_t port = 32330 + getpid() % 1000;
+static OtaUpdater updater(port, TEST_SECRET);
+static char work_dir[] = "/tmp/test_ota_XXXXXX";
+static std::vector<uint8_t> base_image;
+static std::vector<uint8_t> target_image;
+
+// Something shaped like firmware: runs of repeated code-like words, tables
+// and a share of incompressible bytes
+static std::vector<uint8_t> make_image(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> image;
+    image.reserve(size);
+    host_seed_random(seed);
+    while (image.size() < size)
+    {
+        uint32_t kind = esp_random() % 4;
+        size_t run = 64 + esp_random() % 512;
+        uint32_t word = esp_random();
+        for (size_t i = 0; i < run && image.size() < size; i++)
+        {
+            image.push_back(kind == 0 ? (uint8_t)esp_random() : (uint8_t)(word >> (8 * (i % 4))) + (kind == 2 ? i / 16 : 0));
+        }
+    }
+    return image;
+}
+
+static std::string path(const char *name)
+{
+    return std::string(work_dir) + "/" + name;
+}
+
+static void write_file(const std::string &file, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(file.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(data.size(), fwrite(data.data(), 1, data.size(), f));
+    fclose(f);
+}
+
+static std::vector<uint8_t> read_file(const std::string &file)
+{
+    std::vector<uint8_t> data;
+    FILE *f = fopen(file.c_str(), "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + length);
+    }
+    fclose(f);
+    return data;
+}
+
+static std::string ota_patch(const std::string &arguments)
+{
+    const char *python = getenv("PYTHON") != NULL ? getenv("PYTHON") : "python3";
+    return std::string(python) + " " PROJECT_DIR "/tools/ota_patch.py " + arguments + " 2>&1";
+}
+
+static int run(const std::string &command, std::string &output)
+{
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe == NULL)
+    {
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), pipe) != NULL)
+    {
+        output += line;
+    }
+    return pclose(pipe);
+}
+
+// Serves one upload while sender runs on another thread
+static ota_patch_status serve(std::function<void()> sender)
+{
+    std::thread thread(sender);
+    ota_patch_status status = OTA_PATCH_NONE;
+    unsigned long started = millis();
+    while (status == OTA_PATCH_NONE && millis() - started < 60 * 1000)
+    {
+        status = updater.handle();
+        delay(1);
+    }
+    thread.join();
+    return status;
+}
+
+static ota_patch_status upload(const std::string &arguments, const char *secret, std::string &output, int &exit_status)
+{
+    std::string command = ota_patch("--target " + path("target.bin") + " " + arguments +
+                                    " --secret '" + secret + "' --upload 127.0.0.1 --port " + std::to_string(port));
+    return serve([&]()
+                 { exit_status = run(command, output); });
+}
+
+static bool target_booted()
+{
+    const esp_partition_t *boot = esp_ota_get_boot_partition();
+    return boot == esp_ota_get_next_update_partition(NULL) &&
+           host_ota_image_size() == target_image.size() &&
+           memcmp(host_partition_data(boot), target_image.data(), target_image.size()) == 0;
+}
+
+static void check_round_trip(const char *name, const std::string &arguments)
+{
+    std::string output;
+    int exit_status = -1;
+    unsigned long started = millis();
+    ota_patch_status status = upload(arguments, TEST_SECRET, output, exit_status);
+    unsigned long elapsed = millis() - started;
+
+    TEST_MESSAGE(output.c_str());
+    TEST_ASSERT_EQUAL_INT_MESSAGE(OTA_PATCH_COMPLETE, status, ota_patch_status_to_string(status).c_str());
+    TEST_ASSERT_EQUAL_INT(0, exit_status);
+    TEST_ASSERT_TRUE(target_booted());
+
+    char summary[160];
+    const ota_patch_stats &stats = updater.last_stats();
+    snprintf(summary, sizeof(summary), "%s: %u payload bytes for a %u byte image (%.1f%%), %lu ms end to end",
+             name, stats.payload_bytes, stats.image_bytes, 100.0 * stats.payload_bytes / stats.image_bytes, elapsed);
+    TEST_MESSAGE(summary);
+}
+
+static void start_tag(mbedtls_md_context_t *context, const uint8_t *nonce, const std::vector<uint8_t> &patch)
+{
+    mbedtls_md_init(context);
+    mbedtls_md_setup(context, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    mbedtls_md_hmac_starts(context, (const uint8_t *)TEST_SECRET, strlen(TEST_SECRET));
+    mbedtls_md_hmac_update(context, nonce, OTA_NONCE_SIZE);
+    mbedtls_md_hmac_update(context, patch.data(), sizeof(ota_patch_header));
+}
+
+// The signed stream ota_patch.py would send for nonce
+static std::vector<uint8_t> sign(const std::vector<uint8_t> &patch, const uint8_t *nonce)
+{
+    mbedtls_md_context_t context;
+    uint8_t header_tag[OTA_TAG_SIZE];
+    uint8_t tag[OTA_TAG_SIZE];
+
+    start_tag(&context, nonce, patch);
+    mbedtls_md_hmac_finish(&context, header_tag);
+    mbedtls_md_free(&context);
+
+    start_tag(&context, nonce, patch);
+    mbedtls_md_hmac_update(&context, patch.data() + sizeof(ota_patch_header), patch.size() - sizeof(ota_patch_header));
+    mbedtls_md_hmac_finish(&context, tag);
+    mbedtls_md_free(&context);
+
+    std::vector<uint8_t> stream(patch.begin(), patch.begin() + sizeof(ota_patch_header));
+    stream.insert(stream.end(), header_tag, header_tag + OTA_TAG_SIZE);
+    stream.insert(stream.end(), patch.begin() + sizeof(ota_patch_header), patch.end());
+    stream.insert(stream.end(), tag, tag + OTA_TAG_SIZE);
+    return stream;
+}
+
+// Connects, takes the nonce and sends whatever stream makes of it. Runs on
+// the sender thread, so failures show up as an empty reply, not an assert.
+static void send_stream(std::function<std::vector<uint8_t>(const uint8_t *nonce)> stream, std::string &reply)
+{
+    WiFiClient client;
+    uint8_t nonce[OTA_NONCE_SIZE];
+    if (!client.connect(IPAddress(127, 0, 0, 1), port))
+    {
+        return;
+    }
+    client.setTimeout(10);
+    if (client.readBytes(nonce, sizeof(nonce)) == sizeof(nonce))
+    {
+        std::vector<uint8_t> data = stream(nonce);
+        client.write(data.data(), data.size());
+        reply = client.readStringUntil('\n').c_str();
+    }
+    client.stop();
+}
+
+static std::vector<uint8_t> build_patch(const std::string &arguments)
+{
+    std::string output;
+    TEST_ASSERT_EQUAL_INT(0, run(ota_patch("--target " + path("target.bin") + " " + arguments + " --output " + path("patch.bin")), output));
+    return read_file(path("patch.bin"));
+}
+
+void setUp()
+{
+    host_reset_ota();
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    memcpy(host_partition_data(running), base_image.data(), base_image.size());
+}
+
+void tearDown()
+{
+}
+
+void test_full_zlib_image()
+{
+    check_round_trip("full, zlib", "");
+}
+
+void test_delta_zlib_image()
+{
+    check_round_trip("delta, zlib", "--base " + path("base.bin"));
+}
+
+void test_delta_uncompressed_image()
+{
+    check_round_trip("delta", "--base " + path("base.bin") + " --no-compress");
+}
+
+void test_wrong_secret_is_refused_before_erasing()
+{
+    const esp_partition_t *spare = esp_ota_get_next_update_partition(NULL);
+    unsigned long erases = host_partition_counters(spare).erases;
+
+    std::string output;
+    int exit_status = 0;
+    ota_patch_status status = upload("", "not the secret", output, exit_status);
+
+    TEST_ASSERT_EQUAL_INT(OTA_PATCH_UNAUTHENTICATED, status);
+    TEST_ASSERT_NOT_EQUAL(0, exit_status);
+    TEST_ASSERT_EQUAL(esp_ota_get_running_partition(), esp_ota_get_boot_partition());
+    TEST_ASSERT_EQUAL(erases, host_partition_counters(spare).erases);
+}
+
+void test_tampered_payload_is_never_booted()
+{
+    // Uncompressed, so the change reaches flash and only the tag can catch it
+    std::vector<uint8_t> patch = build_patch("--no-compress");
+    std::string reply;
+    ota_patch_status status = serve([&]()
+                                    { send_stream([&](const uint8_t *nonce)
+                                                  {
+                                                      std::vector<uint8_t> stream = sign(patch, nonce);
+                                                      stream[sizeof(ota_patch_header) + OTA_TAG_SIZE + 1000] ^= 0x01;
+                                                      return stream; },
+                                                  reply); });
+
+    TEST_ASSERT_EQUAL_INT(OTA_PATCH_UNAUTHENTICATED, status);
+    TEST_ASSERT_EQUAL_STRING("ERR authentication failed", reply.c_str());
+    TEST_ASSERT_EQUAL(esp_ota_get_running_partition(), esp_ota_get_boot_partition());
+}
+
+void test_replayed_upload_is_refused()
+{
+    std::vector<uint8_t> patch = build_patch("");
+    std::vector<uint8_t> captured;
+    std::string reply;
+    ota_patch_status status = serve([&]()
+                                    { send_stream([&](const uint8_t *nonce)
+                                                  { return captured = sign(patch, nonce); },
+                                                  reply); });
+    TEST_ASSERT_EQUAL_INT(OTA_PATCH_COMPLETE, status);
+    TEST_ASSERT_TRUE(target_booted());
+
+    host_reset_ota();
+    status = serve([&]()
+                   { send_stream([&](const uint8_t *nonce)
+                                 { return captured; },
+                                 reply); });
+    TEST_ASSERT_EQUAL_INT(OTA_PATCH_UNAUTHENTICATED, status);
+    TEST_ASSERT_EQUAL(esp_ota_get_running_partition(), esp_ota_get_boot_partition());
+}
+
+int main(int argc, char **argv)
+{
+    if (mkdtemp(work_dir) == NULL)
+    {
+        return 1;
+    }
+
+    // The new build moves code around and changes a little of it, like a
+    // typical incremental firmware update
+    base_image = make_image(TEST_IMAGE_SIZE, 1);
+    target_image = base_image;
+    std::vector<uint8_t> inserted = make_image(3000, 2);
+    target_image.insert(target_image.begin() + TEST_IMAGE_SIZE / 3, inserted.begin(), inserted.end());
+    for (size_t i = TEST_IMAGE_SIZE / 2; i < TEST_IMAGE_SIZE / 2 + 200; i++)
+    {
+        target_image[i] ^= 0x5a;
+    }
+    write_file(path("base.bin"), base_image);
+    write_file(path("target.bin"), target_image);
+
+    updater.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_zlib_image);
+    RUN_TEST(test_delta_zlib_image);
+    RUN_TEST(test_delta_uncompressed_image);
+    RUN_TEST(test_wrong_secret_is_refused_before_erasing);
+    RUN_TEST(test_tampered_payload_is_never_booted);
+    RUN_TEST(test_replayed_upload_is_refused);
+    int failures = UNITY_END();
+
+    std::string output;
+    run("rm -rf " + std::string(work_dir), output);
+    return failures;
+}
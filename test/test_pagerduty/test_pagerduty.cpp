@@ -0,0 +1,311 @@
+// PagerDuty against a fake Events API on loopback: every opening is its own
+// incident, and actions held back while PagerDuty is unreachable go out
+// later in order, without a simulated or newer action displacing a real one,
+// even across a restart.
+
+#include <ArduinoHost.h>
+#include <PagerDuty.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <unity.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const uint16_t port = 33330 + getpid() % 1000;
+
+typedef struct
+{
+    std::string action;
+    std::string dedup_key;
+    std::string summary;
+} received_action;
+
+// Answers every enqueue with answer_status and records what was posted
+class FakeEventsApi
+{
+public:
+    std::atomic<int> answer_status;
+
+    FakeEventsApi() : answer_status(202), running(false) {}
+
+    void start()
+    {
+        this->server.begin(port);
+        this->running = true;
+        this->thread = std::thread([this]()
+                                   { this->serve(); });
+    }
+
+    void stop()
+    {
+        this->running = false;
+        this->thread.join();
+        this->server.end();
+    }
+
+    std::vector<received_action> take()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        std::vector<received_action> taken;
+        taken.swap(this->received);
+        return taken;
+    }
+
+private:
+    static std::string field(const std::string &body, const std::string &name)
+    {
+        std::string key = "\"" + name + "\":\"";
+        size_t start = body.find(key);
+        if (start == std::string::npos)
+        {
+            return "";
+        }
+        start += key.length();
+        return body.substr(start, body.find('"', start) - start);
+    }
+
+    void serve()
+    {
+        while (this->running)
+        {
+            WiFiClient client = this->server.accept();
+            if (!client)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            client.setTimeout(5);
+            size_t length = 0;
+            String line;
+            while ((line = client.readStringUntil('\n')).length() > 1)
+            {
+                if (line.startsWith("Content-Length:"))
+                {
+                    length = line.substring(15).toInt();
+                }
+            }
+            std::string body(length, '\0');
+            client.readBytes(&body[0], length);
+            std::string key = field(body, "dedup_key");
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->received.push_back({field(body, "event_action"), key, field(body, "summary")});
+            }
+
+            int status = this->answer_status;
+            std::string answer = status == 202 ? "{\"status\":\"success\",\"message\":\"Event processed\",\"dedup_key\":\"" + key + "\"}"
+                                               : "{\"status\":\"error\"}";
+            std::string response = "HTTP/1.1 " + std::to_string(status) + (status == 202 ? " Accepted" : " Internal Server Error") +
+                                   "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(answer.length()) +
+                                   "\r\nConnection: close\r\n\r\n" + answer;
+            client.write((const uint8_t *)response.data(), response.length());
+            client.stop();
+        }
+    }
+
+    WiFiServer server;
+    std::atomic<bool> running;
+    std::thread thread;
+    std::mutex mutex;
+    std::vector<received_action> received;
+};
+
+static FakeEventsApi events_api;
+static WiFiClientSecure client;
+
+// Sends everything held back, one action per call like the main loop
+static void drain(PagerDuty &pagerduty)
+{
+    unsigned long started = millis();
+    while (pagerduty.pending() && millis() - started < 10 * 1000)
+    {
+        pagerduty.send_pending();
+    }
+}
+
+void setUp()
+{
+    events_api.answer_status = 202;
+    events_api.take();
+}
+
+void tearDown()
+{
+}
+
+void test_every_opening_is_its_own_incident()
+{
+    PagerDuty pagerduty("routing", client);
+    std::shared_ptr<PagerDutyEvent> first = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    std::shared_ptr<PagerDutyEvent> second = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    TEST_ASSERT_TRUE(first->resolve());
+    TEST_ASSERT_TRUE(second->resolve());
+
+    std::vector<received_action> received = events_api.take();
+    TEST_ASSERT_EQUAL(4, received.size());
+    TEST_ASSERT_EQUAL_STRING("trigger", received[0].action.c_str());
+    TEST_ASSERT_EQUAL_STRING("trigger", received[1].action.c_str());
+    TEST_ASSERT_TRUE(received[0].dedup_key != received[1].dedup_key);
+    TEST_ASSERT_EQUAL_STRING("resolve", received[2].action.c_str());
+    TEST_ASSERT_EQUAL_STRING(received[0].dedup_key.c_str(), received[2].dedup_key.c_str());
+    TEST_ASSERT_EQUAL_STRING(received[1].dedup_key.c_str(), received[3].dedup_key.c_str());
+}
+
+void test_open_and_close_during_an_outage_still_pages()
+{
+    PagerDuty pagerduty("routing", client);
+    pagerduty.circuit_breaker().hold(true);
+    std::shared_ptr<PagerDutyEvent> event = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    event->resolve();
+    TEST_ASSERT_TRUE(pagerduty.pending());
+    TEST_ASSERT_EQUAL(0, events_api.take().size());
+
+    pagerduty.circuit_breaker().hold(false);
+    drain(pagerduty);
+
+    std::vector<received_action> received = events_api.take();
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("trigger", received[0].action.c_str());
+    TEST_ASSERT_EQUAL_STRING("resolve", received[1].action.c_str());
+    TEST_ASSERT_EQUAL_STRING(received[0].dedup_key.c_str(), received[1].dedup_key.c_str());
+}
+
+void test_a_failed_action_is_retried_in_order()
+{
+    PagerDuty pagerduty("routing", client);
+    events_api.answer_status = 500;
+    std::shared_ptr<PagerDutyEvent> event = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    // Queued behind the failed trigger rather than sent ahead of it
+    event->resolve();
+    TEST_ASSERT_EQUAL(1, events_api.take().size());
+
+    events_api.answer_status = 202;
+    drain(pagerduty);
+
+    std::vector<received_action> received = events_api.take();
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("trigger", received[0].action.c_str());
+    TEST_ASSERT_EQUAL_STRING("resolve", received[1].action.c_str());
+}
+
+void test_retries_wait_for_the_retry_delay()
+{
+    PagerDuty pagerduty("routing", client);
+    events_api.answer_status = 500;
+    pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    TEST_ASSERT_EQUAL(1, events_api.take().size());
+
+    // Still closed, but not retried on every loop
+    events_api.answer_status = 202;
+    TEST_ASSERT_EQUAL(BREAKER_CLOSED, pagerduty.circuit_breaker().state());
+    TEST_ASSERT_FALSE(pagerduty.send_pending());
+    TEST_ASSERT_EQUAL(0, events_api.take().size());
+
+    delay(BREAKER_RETRY_DELAY);
+    TEST_ASSERT_TRUE(pagerduty.send_pending());
+    TEST_ASSERT_EQUAL(1, events_api.take().size());
+}
+
+void test_simulated_actions_never_displace_real_ones()
+{
+    PagerDuty pagerduty("routing", client);
+    pagerduty.circuit_breaker().hold(true);
+    for (int i = 0; i < PAGER_DUTY_PENDING_CAPACITY / 2; i++)
+    {
+        pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+        pagerduty.create_event(CRITICAL, "Garage Door Opened (test)", "garage", true);
+    }
+    // Full: a real trigger takes a simulated one's place, a simulated one is dropped
+    pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    pagerduty.create_event(CRITICAL, "Garage Door Opened (test)", "garage", true);
+    TEST_ASSERT_EQUAL(2, pagerduty.dropped());
+
+    pagerduty.circuit_breaker().hold(false);
+    drain(pagerduty);
+
+    std::vector<received_action> received = events_api.take();
+    TEST_ASSERT_EQUAL(PAGER_DUTY_PENDING_CAPACITY, received.size());
+    int real = 0;
+    for (const received_action &action : received)
+    {
+        real += action.summary == "Garage Door Opened";
+    }
+    TEST_ASSERT_EQUAL(PAGER_DUTY_PENDING_CAPACITY / 2 + 1, real);
+}
+
+void test_newer_actions_never_displace_held_back_real_triggers()
+{
+    PagerDuty pagerduty("routing", client);
+    pagerduty.circuit_breaker().hold(true);
+    std::vector<String> summaries;
+    for (int i = 0; i < PAGER_DUTY_PENDING_CAPACITY + 3; i++)
+    {
+        summaries.push_back("Garage Door Opened " + String(i));
+        pagerduty.create_event(CRITICAL, summaries.back(), "garage");
+    }
+    TEST_ASSERT_EQUAL(3, pagerduty.dropped());
+
+    pagerduty.circuit_breaker().hold(false);
+    drain(pagerduty);
+
+    std::vector<received_action> received = events_api.take();
+    TEST_ASSERT_EQUAL(PAGER_DUTY_PENDING_CAPACITY, received.size());
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_STRING(summaries[i].c_str(), received[i].summary.c_str());
+    }
+}
+
+void test_held_back_actions_survive_a_restart()
+{
+    Preferences preferences;
+    preferences.begin("test", false);
+    {
+        PagerDuty pagerduty("routing", client);
+        pagerduty.begin(preferences, "pd_pending");
+        pagerduty.circuit_breaker().hold(true);
+        std::shared_ptr<PagerDutyEvent> event = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+        pagerduty.create_event(CRITICAL, "Garage Door Opened (test)", "garage", true);
+        event->resolve();
+        TEST_ASSERT_TRUE(pagerduty.checkpoint());
+    }
+
+    PagerDuty restarted("routing", client);
+    restarted.begin(preferences, "pd_pending");
+    TEST_ASSERT_FALSE(preferences.isKey("pd_pending"));
+    drain(restarted);
+
+    // The simulated trigger is not worth sending after a restart
+    std::vector<received_action> received = events_api.take();
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("trigger", received[0].action.c_str());
+    TEST_ASSERT_EQUAL_STRING("Garage Door Opened", received[0].summary.c_str());
+    TEST_ASSERT_EQUAL_STRING("resolve", received[1].action.c_str());
+    TEST_ASSERT_EQUAL_STRING(received[0].dedup_key.c_str(), received[1].dedup_key.c_str());
+    preferences.end();
+}
+
+int main(int argc, char **argv)
+{
+    host_set_host_address(PAGER_DUTY_HOST, IPAddress(127, 0, 0, 1));
+    host_redirect_port(PAGER_DUTY_PORT, port);
+    events_api.start();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_opening_is_its_own_incident);
+    RUN_TEST(test_open_and_close_during_an_outage_still_pages);
+    RUN_TEST(test_a_failed_action_is_retried_in_order);
+    RUN_TEST(test_retries_wait_for_the_retry_delay);
+    RUN_TEST(test_simulated_actions_never_displace_real_ones);
+    RUN_TEST(test_newer_actions_never_displace_held_back_real_triggers);
+    RUN_TEST(test_held_back_actions_survive_a_restart);
+    int failures = UNITY_END();
+
+    events_api.stop();
+    return failures;
+}
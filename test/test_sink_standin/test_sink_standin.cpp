@@ -0,0 +1,392 @@
+// PagerDuty, Webhook, readHTTPJson and TelegramPoller against
+// tools/sink_standin.py on loopback, with its faults switched on: dropped
+// connections, 500s, truncated and chunked answers. The stand-in logs every
+// request it took with --requests, which is what most checks read back.
+
+#include <ArduinoHost.h>
+#include <ArduinoJson.h>
+#include <PagerDuty.h>
+#include <TelegramPoller.h>
+#include <Webhook.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <unity.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_WEBHOOK_HOST "webhook.standin"
+#define TEST_WEBHOOK_PATH "/garage?door=open"
+#define TEST_TELEGRAM_HOST "api.telegram.org"
+#define TEST_TELEGRAM_PORT 443
+#define TEST_CHAT_ID "4242"
+#define TEST_LONG_POLL 1
+
+static const uint16_t port = 35330 + getpid() % 1000;
+static char requests_path[64];
+static pid_t standin = 0;
+static WiFiClientSecure client;
+
+typedef struct
+{
+    std::string sink;
+    std::string method;
+    std::string path;
+    std::string body;
+    // Empty when the stand-in answered normally
+    std::string fault;
+    // 0 when the connection was dropped instead
+    int status;
+} standin_request;
+
+static void stop_standin()
+{
+    if (standin > 0)
+    {
+        kill(standin, SIGTERM);
+        waitpid(standin, NULL, 0);
+        standin = 0;
+    }
+}
+
+// Runs the stand-in with arguments on top of plain HTTP on port, and waits
+// until it takes connections
+static void start_standin(const std::string &arguments)
+{
+    stop_standin();
+    remove(requests_path);
+    const char *python = getenv("PYTHON") != NULL ? getenv("PYTHON") : "python3";
+    // --duration so a crashed run does not leave it holding the port
+    std::string command = "exec " + std::string(python) + " " PROJECT_DIR "/tools/sink_standin.py --bind 127.0.0.1" +
+                          " --tls-port 0 --http-port " + std::to_string(port) + " --requests " + std::string(requests_path) +
+                          " --duration 60 " + arguments + " > /dev/null";
+    standin = fork();
+    if (standin == 0)
+    {
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char *)NULL);
+        _exit(127);
+    }
+    TEST_ASSERT_GREATER_THAN(0, standin);
+
+    WiFiClient probe;
+    unsigned long started = millis();
+    while (!probe.connect(IPAddress(127, 0, 0, 1), port) && millis() - started < 10 * 1000)
+    {
+        delay(50);
+    }
+    TEST_ASSERT_TRUE_MESSAGE(probe.connected(), "sink_standin.py did not start");
+    probe.stop();
+}
+
+// What reached the stand-in for sink so far, in order
+static std::vector<standin_request> requests(const char *sink)
+{
+    std::vector<standin_request> found;
+    std::ifstream log(requests_path);
+    std::string line;
+    while (std::getline(log, line))
+    {
+        DynamicJsonDocument entry(4096);
+        TEST_ASSERT_FALSE(deserializeJson(entry, line.c_str()));
+        if (strcmp(entry["sink"].as<const char *>(), sink) != 0)
+        {
+            continue;
+        }
+        standin_request request;
+        request.sink = sink;
+        request.method = entry["method"].as<const char *>();
+        request.path = entry["path"].as<const char *>();
+        request.body = entry["body"].as<const char *>();
+        request.fault = entry["fault"].isNull() ? "" : entry["fault"].as<const char *>();
+        request.status = entry["status"].isNull() ? 0 : entry["status"].as<int>();
+        found.push_back(request);
+    }
+    return found;
+}
+
+// The Events API action and dedup key a PagerDuty request carried
+static std::pair<std::string, std::string> pagerduty_action(const standin_request &request)
+{
+    DynamicJsonDocument event(2048);
+    TEST_ASSERT_FALSE(deserializeJson(event, request.body.c_str()));
+    return std::make_pair(std::string(event["event_action"].as<const char *>()),
+                          std::string(event["dedup_key"].as<const char *>()));
+}
+
+// Whether the device got an answer it could use
+static bool answered(const standin_request &request)
+{
+    return request.status == 202 && (request.fault.empty() || request.fault == "chunked");
+}
+
+// Sends everything held back, skipping the retry delays rather than
+// waiting them out
+static void drain(PagerDuty &pagerduty)
+{
+    for (int tries = 0; pagerduty.pending() && tries < 1000; tries++)
+    {
+        if (!pagerduty.send_pending())
+        {
+            host_advance_clock(1000);
+        }
+    }
+    TEST_ASSERT_FALSE(pagerduty.pending());
+}
+
+static trigger_webhook_status drain(Webhook &webhook)
+{
+    String body;
+    trigger_webhook_status status = CIRCUIT_OPEN;
+    for (int tries = 0; webhook.pending() && tries < 1000; tries++)
+    {
+        status = webhook.send_pending(body);
+        if (status != SUCCESS)
+        {
+            host_advance_clock(1000);
+        }
+    }
+    return status;
+}
+
+// Posts an Events API trigger by hand and reads the answer like PagerDuty
+static int post_event(const char *dedup_key, JsonDocument &response)
+{
+    WiFiClient raw;
+    TEST_ASSERT_TRUE(connectHTTPClient(&raw, "127.0.0.1", port));
+    String body = String("{\"routing_key\":\"routing\",\"event_action\":\"trigger\",\"dedup_key\":\"") + dedup_key + "\"}";
+    raw.print(String("POST /v2/enqueue HTTP/1.1\r\nHost: " PAGER_DUTY_HOST "\r\nContent-Type: application/json\r\n") +
+              "Content-Length: " + String((int)body.length()) + "\r\n\r\n" + body);
+
+    StaticJsonDocument<64> filter;
+    filter["status"] = true;
+    filter["dedup_key"] = true;
+    int status = readHTTPJson(&raw, response, filter, PAGER_DUTY_MAX_RESPONSE_SIZE, 2 * 1000);
+    raw.stop();
+    return status;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    stop_standin();
+}
+
+void test_pagerduty_trigger_and_resolve()
+{
+    start_standin("");
+    PagerDuty pagerduty("routing", client);
+    std::shared_ptr<PagerDutyEvent> event = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+    TEST_ASSERT_TRUE(event->resolve());
+    TEST_ASSERT_FALSE(pagerduty.pending());
+
+    std::vector<standin_request> received = requests("pagerduty");
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("POST", received[0].method.c_str());
+    TEST_ASSERT_EQUAL_STRING("/v2/enqueue", received[0].path.c_str());
+    TEST_ASSERT_EQUAL(202, received[1].status);
+    TEST_ASSERT_EQUAL_STRING("trigger", pagerduty_action(received[0]).first.c_str());
+    TEST_ASSERT_EQUAL_STRING("resolve", pagerduty_action(received[1]).first.c_str());
+    TEST_ASSERT_EQUAL_STRING(pagerduty_action(received[0]).second.c_str(), pagerduty_action(received[1]).second.c_str());
+}
+
+void test_pagerduty_rides_out_faults()
+{
+    // Two answers in three are faulty, one in three unusable; the breaker
+    // opens along the way
+    start_standin("--seed 38 --faults-for pagerduty --drop 0.1 --error 0.15 --truncate 0.1 --chunked 0.3");
+    PagerDuty pagerduty("routing", client);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 10; i++)
+    {
+        std::shared_ptr<PagerDutyEvent> event = pagerduty.create_event(CRITICAL, "Garage Door Opened", "garage");
+        drain(pagerduty);
+        event->resolve();
+        drain(pagerduty);
+    }
+
+    std::vector<standin_request> received = requests("pagerduty");
+    std::vector<std::pair<std::string, std::string>> actions;
+    int faults = 0;
+    int chunked = 0;
+    for (const standin_request &request : received)
+    {
+        actions.push_back(pagerduty_action(request));
+        faults += !request.fault.empty();
+        chunked += request.fault == "chunked";
+        if (actions.back().first == "trigger" && (keys.empty() || keys.back() != actions.back().second))
+        {
+            keys.push_back(actions.back().second);
+        }
+    }
+    TEST_ASSERT_EQUAL(10, keys.size());
+    TEST_ASSERT_GREATER_THAN(5, faults);
+    TEST_ASSERT_GREATER_THAN(0, chunked);
+
+    for (const std::string &key : keys)
+    {
+        // The resolve goes out only once a trigger got through
+        int triggered = -1;
+        int resolved = -1;
+        for (size_t i = 0; i < received.size(); i++)
+        {
+            if (actions[i].second == key && answered(received[i]))
+            {
+                if (actions[i].first == "trigger" && triggered < 0)
+                {
+                    triggered = i;
+                }
+                if (actions[i].first == "resolve" && resolved < 0)
+                {
+                    resolved = i;
+                }
+            }
+        }
+        TEST_ASSERT_GREATER_OR_EQUAL(0, triggered);
+        TEST_ASSERT_GREATER_THAN(triggered, resolved);
+    }
+
+    // An answered action, chunked or not, is never sent again
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        for (size_t j = i + 1; answered(received[i]) && j < received.size(); j++)
+        {
+            TEST_ASSERT_FALSE(actions[i] == actions[j]);
+        }
+    }
+}
+
+void test_webhook_success_and_retry()
+{
+    start_standin("");
+    Webhook webhook(false, TEST_WEBHOOK_HOST, port, TEST_WEBHOOK_PATH);
+    String body;
+    TEST_ASSERT_EQUAL(SUCCESS, webhook.trigger_webhook(body));
+    TEST_ASSERT_EQUAL_STRING("OK", body.c_str());
+    // Kept alive for the next one
+    TEST_ASSERT_EQUAL(SUCCESS, webhook.trigger_webhook(body));
+    std::vector<standin_request> received = requests("webhook");
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("GET", received[0].method.c_str());
+    TEST_ASSERT_EQUAL_STRING(TEST_WEBHOOK_PATH, received[0].path.c_str());
+
+    // A 500 is held back and sent again once the endpoint recovers
+    start_standin("--faults-for webhook --error 1");
+    TEST_ASSERT_EQUAL(BAD_STATUS, webhook.trigger_webhook(body));
+    TEST_ASSERT_TRUE(webhook.pending());
+    start_standin("");
+    TEST_ASSERT_EQUAL(SUCCESS, drain(webhook));
+    TEST_ASSERT_FALSE(webhook.pending());
+
+    // So is a trigger while the endpoint is down
+    stop_standin();
+    TEST_ASSERT_EQUAL(UNABLE_CONNECT, webhook.trigger_webhook(body));
+    TEST_ASSERT_TRUE(webhook.pending());
+    start_standin("");
+    TEST_ASSERT_EQUAL(SUCCESS, drain(webhook));
+    TEST_ASSERT_EQUAL(1, requests("webhook").size());
+}
+
+void test_webhook_dropped_connection()
+{
+    start_standin("--faults-for webhook --drop 1");
+    Webhook webhook(false, TEST_WEBHOOK_HOST, port, TEST_WEBHOOK_PATH);
+    String body;
+    // Only noticed once the breaker's request timeout runs out, as on the device
+    TEST_ASSERT_EQUAL(NO_RESPONSE, webhook.trigger_webhook(body));
+    TEST_ASSERT_TRUE(webhook.pending());
+    start_standin("");
+    TEST_ASSERT_EQUAL(SUCCESS, drain(webhook));
+}
+
+void test_read_http_json_from_a_slow_chunked_answer()
+{
+    // 200 bytes/s in chunks of up to 64, so reads wait across chunk boundaries
+    start_standin("--seed 38 --chunked 1 --slow 200");
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> response;
+    TEST_ASSERT_EQUAL(202, post_event("slow-chunked", response));
+    TEST_ASSERT_EQUAL_STRING("success", response["status"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("slow-chunked", response["dedup_key"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("chunked", requests("pagerduty")[0].fault.c_str());
+}
+
+void test_read_http_json_from_a_truncated_answer()
+{
+    start_standin("--truncate 1");
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> response;
+    TEST_ASSERT_EQUAL(HTTP_JSON_MALFORMED, post_event("truncated", response));
+}
+
+void test_read_http_json_from_an_error()
+{
+    start_standin("--error 1");
+    StaticJsonDocument<PAGER_DUTY_RESPONSE_DOC_SIZE> response;
+    TEST_ASSERT_EQUAL(500, post_event("error", response));
+}
+
+// Last: the poller task keeps running until the process exits
+void test_telegram_poller_receives_commands()
+{
+    start_standin("--chat-id " TEST_CHAT_ID " --command /status --command \"/history 2\" --long-poll " +
+                  std::to_string(TEST_LONG_POLL) + " --seed 38 --faults-for telegram --chunked 1");
+    static TelegramPoller poller("123:token", TEST_TELEGRAM_HOST, TEST_TELEGRAM_PORT, TEST_LONG_POLL);
+    poller.begin(0, 8192, 1, 0);
+
+    std::vector<telegram_command> commands;
+    unsigned long started = millis();
+    while (commands.size() < 2 && millis() - started < 10 * 1000)
+    {
+        telegram_command command;
+        if (poller.receive(command))
+        {
+            commands.push_back(command);
+        }
+        delay(10);
+    }
+    TEST_ASSERT_EQUAL(2, commands.size());
+    TEST_ASSERT_EQUAL_STRING("/status", commands[0].text);
+    TEST_ASSERT_EQUAL_STRING("/history 2", commands[1].text);
+    TEST_ASSERT_EQUAL_STRING(TEST_CHAT_ID, commands[0].chat_id);
+    TEST_ASSERT_EQUAL_STRING("Stand-in", commands[0].from_name);
+    TEST_ASSERT_TRUE(commands[0].update_id < commands[1].update_id);
+
+    // Acknowledged: the next polls ask past them and get nothing new
+    delay(3 * TEST_LONG_POLL * 1000);
+    telegram_command command;
+    TEST_ASSERT_FALSE(poller.receive(command));
+    TEST_ASSERT_EQUAL(2, poller.stats().updates);
+    TEST_ASSERT_EQUAL(0, poller.stats().errors);
+    std::vector<standin_request> received = requests("telegram");
+    TEST_ASSERT_GREATER_THAN(2, received.size());
+    std::string offset = "offset=" + std::to_string(commands[1].update_id + 1) + "&";
+    TEST_ASSERT_TRUE(received.back().path.find(offset) != std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+    snprintf(requests_path, sizeof(requests_path), "/tmp/test_sink_standin_%d.jsonl", (int)getpid());
+    // The sinks' own hosts and ports, onto the stand-in
+    host_set_host_address(PAGER_DUTY_HOST, IPAddress(127, 0, 0, 1));
+    host_set_host_address(TEST_TELEGRAM_HOST, IPAddress(127, 0, 0, 1));
+    host_set_host_address(TEST_WEBHOOK_HOST, IPAddress(127, 0, 0, 1));
+    host_redirect_port(PAGER_DUTY_PORT, port);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pagerduty_trigger_and_resolve);
+    RUN_TEST(test_pagerduty_rides_out_faults);
+    RUN_TEST(test_webhook_success_and_retry);
+    RUN_TEST(test_webhook_dropped_connection);
+    RUN_TEST(test_read_http_json_from_a_slow_chunked_answer);
+    RUN_TEST(test_read_http_json_from_a_truncated_answer);
+    RUN_TEST(test_read_http_json_from_an_error);
+    RUN_TEST(test_telegram_poller_receives_commands);
+    int failures = UNITY_END();
+
+    remove(requests_path);
+    host_exit(failures);
+}
@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+"""Estimates average current and alert latency for the low-power settings.
+
+Replays a day of the alerter's activity on a virtual clock. The activity is
+beacon wakeups, loop wakes, Telegram long polls, fleet heartbeats, DNS
+refreshes and door events. Each activity is charged at ESP32 datasheet-level
+currents, and the time spent in each radio/CPU state is recorded. Door edges
+are placed at random phases against the beacon schedule to measure how long an
+alert takes to reach the sinks. Every round trip whose answer misses the
+radio's post-transmit awake window waits for the next listen interval.
+
+  tools/energy_model.py                      # compare the built-in presets
+  tools/energy_model.py --preset low-power --listen-interval 10 --tx-dbm 8.5
+
+Every preset setting can be overridden from the command line. The currents
+are typical figures, not measurements; use --currents to load your own from
+a JSON file with the same keys as CURRENTS_MA.
+"""
+
+import argparse
+import heapq
+import json
+import random
+
+# Typical ESP32 currents (mA). "cpu" is with the radio asleep, "rx" includes an
+# 80 MHz CPU.
+CURRENTS_MA = {
+    "light_sleep": 0.8,
+    "cpu_idle_dfs": 12.0,
+    "cpu": {"80": 25.0, "160": 35.0, "240": 50.0},
+    "rx": 100.0,
+    "tx": {"8.5": 160.0, "11": 170.0, "15": 190.0, "19.5": 240.0},
+}
+
+PRESETS = {
+    # What the firmware does without LOW_POWER_ENABLED
+    "always-on": dict(power_save="none", listen_interval=1, tx_dbm=19.5, cpu_mhz=240, power_management=False,
+                      light_sleep=False, door_interrupt=False, idle_interval=0),
+    "modem-sleep": dict(power_save="min", listen_interval=1, tx_dbm=19.5, cpu_mhz=80, power_management=True,
+                        light_sleep=False, door_interrupt=True, idle_interval=1000),
+    # The LOW_POWER_* defaults in src/config.h
+    "low-power": dict(power_save="max", listen_interval=3, tx_dbm=11, cpu_mhz=240, power_management=True,
+                      light_sleep=True, door_interrupt=True, idle_interval=1000),
+    "low-power-li10": dict(power_save="max", listen_interval=10, tx_dbm=11, cpu_mhz=240, power_management=True,
+                           light_sleep=True, door_interrupt=True, idle_interval=1000),
+}
+
+STATES = ("sleep", "cpu", "rx", "tx")
+
+
+class VirtualClock:
+    """Event queue over simulated milliseconds."""
+
+    def __init__(self):
+        self.now = 0.0
+        self.queue = []
+        self.sequence = 0
+
+    def at(self, when, action):
+        heapq.heappush(self.queue, (when, self.sequence, action))
+        self.sequence += 1
+
+    def run(self, until):
+        while self.queue and self.queue[0][0] <= until:
+            self.now, _, action = heapq.heappop(self.queue)
+            action()
+        self.now = until
+
+
+class Model:
+    def __init__(self, config, currents, args):
+        self.config = config
+        self.currents = currents
+        self.args = args
+        self.clock = VirtualClock()
+        self.charge = {state: 0.0 for state in STATES}
+        self.busy = {state: 0.0 for state in STATES}
+
+    def floor_ma(self):
+        config = self.config
+        if config["power_save"] == "none":
+            # Radio always listening, loop spinning
+            return self.currents["rx"] + self.cpu_ma() - self.currents["cpu"]["80"]
+        if config["light_sleep"]:
+            return self.currents["light_sleep"]
+        if config["power_management"]:
+            return self.currents["cpu_idle_dfs"]
+        return self.cpu_ma()
+
+    def cpu_ma(self):
+        return self.currents["cpu"][str(self.config["cpu_mhz"])]
+
+    def tx_ma(self):
+        return self.currents["tx"][("%g" % self.config["tx_dbm"])]
+
+    def listen_period(self):
+        config = self.config
+        if config["power_save"] == "none":
+            return 0
+        if config["power_save"] == "min":
+            return self.args.dtim * self.args.beacon_ms
+        return config["listen_interval"] * self.args.beacon_ms
+
+    def cpu_time(self, ms_at_240):
+        return ms_at_240 * 240 / self.config["cpu_mhz"]
+
+    def spend(self, state, duration, current):
+        # Charged on top of the floor current, which covers the whole day
+        self.busy[state] += duration
+        self.charge[state] += (current - self.floor_ma()) * duration
+
+    def exchange(self, round_trips, cpu_ms_at_240):
+        cpu = self.cpu_time(cpu_ms_at_240)
+        self.spend("cpu", cpu, self.cpu_ma())
+        self.spend("tx", round_trips * self.args.tx_ms, self.tx_ma())
+        if self.config["power_save"] != "none":
+            self.spend("rx", round_trips * (self.args.awake_after_tx + self.args.beacon_rx_ms), self.currents["rx"])
+
+    def every(self, interval, action):
+        def tick():
+            action()
+            self.clock.at(self.clock.now + interval, tick)
+        self.clock.at(random.uniform(0, interval), tick)
+
+    def simulate(self, duration_ms):
+        args = self.args
+        period = self.listen_period()
+        if period:
+            self.every(period, lambda: self.spend("rx", args.beacon_rx_ms, self.currents["rx"]))
+        if self.config["idle_interval"]:
+            wake = min(self.config["idle_interval"], args.door_check)
+            self.every(wake, lambda: self.spend("cpu", self.cpu_time(args.loop_ms), self.cpu_ma()))
+        self.every(args.long_poll * 1000, lambda: self.exchange(1, args.record_cpu_ms))
+        if args.heartbeat:
+            self.every(args.heartbeat * 1000, lambda: self.exchange(0.5, 0.2))
+        self.every(args.dns_ttl * 1000, lambda: self.exchange(args.sinks, 0.2))
+
+        edges = int(args.opens_per_day * 2 * duration_ms / 86400000)
+        for _ in range(edges):
+            self.clock.at(random.uniform(0, duration_ms),
+                          lambda: self.exchange(args.sinks * args.round_trips, args.sinks * args.handshake_cpu_ms))
+
+        self.clock.run(duration_ms)
+        floor = self.floor_ma() * duration_ms
+        average_ma = (floor + sum(self.charge.values())) / duration_ms
+        busy = sum(self.busy.values())
+        residency = {state: self.busy[state] / duration_ms for state in STATES if state != "sleep"}
+        residency["sleep" if self.config["power_save"] != "none" else "listen"] = \
+            max(duration_ms - busy, 0) / duration_ms
+        return average_ma, residency
+
+    def alert_latency(self, edge_at, beacon_phase):
+        """Time from a door edge to the last sink's answer, on the virtual clock."""
+        args = self.args
+        config = self.config
+        period = self.listen_period()
+
+        if config["door_interrupt"]:
+            now = edge_at + (args.light_sleep_wake_ms if config["light_sleep"] else 0)
+        else:
+            # Noticed at the next poll
+            now = edge_at + random.uniform(0, args.door_check)
+
+        for _ in range(args.sinks):
+            now += self.cpu_time(args.handshake_cpu_ms)
+            for _ in range(args.round_trips):
+                answered = now + args.tx_ms + args.rtt_ms
+                if period and args.rtt_ms > args.awake_after_tx:
+                    # Buffered at the access point until the station next listens
+                    listens = max((answered - beacon_phase) // period + 1, 0)
+                    answered = beacon_phase + listens * period + args.beacon_rx_ms
+                now = answered
+        return now - edge_at
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(int(len(ordered) * p / 100), len(ordered) - 1)]
+
+
+def evaluate(name, config, currents, args):
+    random.seed(args.seed)
+    model = Model(config, currents, args)
+    average_ma, residency = model.simulate(args.days * 86400000)
+
+    period = model.listen_period()
+    latencies = [model.alert_latency(random.uniform(0, 10000), random.uniform(0, period or 1))
+                 for _ in range(args.samples)]
+    per_trip = args.tx_ms + args.rtt_ms + (period + args.beacon_rx_ms if period and args.rtt_ms > args.awake_after_tx else 0)
+    wake = args.light_sleep_wake_ms if config["door_interrupt"] else args.door_check
+    bound = wake + args.sinks * (model.cpu_time(args.handshake_cpu_ms) + args.round_trips * per_trip)
+
+    return {
+        "name": name,
+        "config": config,
+        "average_ma": round(average_ma, 2),
+        "battery_days": round(args.battery_mah / average_ma / 24, 1),
+        "residency": {state: round(share * 100, 2) for state, share in residency.items()},
+        "alert_latency_ms": {"p50": round(percentile(latencies, 50)), "p99": round(percentile(latencies, 99)),
+                             "max": round(max(latencies)), "bound": round(bound)},
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--preset", choices=sorted(PRESETS), action="append", help="default: all presets")
+    parser.add_argument("--power-save", choices=("none", "min", "max"))
+    parser.add_argument("--listen-interval", type=int, help="LOW_POWER_LISTEN_INTERVAL (beacons)")
+    parser.add_argument("--tx-dbm", type=float, help="LOW_POWER_TX_POWER")
+    parser.add_argument("--cpu-mhz", type=int, choices=(80, 160, 240), help="LOW_POWER_CPU_MHZ")
+    parser.add_argument("--light-sleep", type=lambda v: v.lower() in ("1", "yes", "on", "true"))
+    parser.add_argument("--idle-interval", type=int, help="LOW_POWER_IDLE_INTERVAL (ms)")
+    parser.add_argument("--currents", help="JSON file overriding CURRENTS_MA")
+
+    network = parser.add_argument_group("environment")
+    network.add_argument("--beacon-ms", type=float, default=102.4, help="access point beacon interval")
+    network.add_argument("--dtim", type=int, default=1, help="access point DTIM period")
+    network.add_argument("--rtt-ms", type=float, default=60, help="round trip to the sinks")
+    network.add_argument("--awake-after-tx", type=float, default=20,
+                         help="how long the radio keeps listening after transmitting (ms)")
+    network.add_argument("--opens-per-day", type=float, default=10)
+    network.add_argument("--sinks", type=int, default=2, help="sinks alerted one after another")
+    network.add_argument("--round-trips", type=int, default=4, help="per alert, including the TLS handshake")
+    network.add_argument("--handshake-cpu-ms", type=float, default=250, help="TLS handshake CPU time at 240 MHz")
+
+    device = parser.add_argument_group("device (mirrors src/config.h)")
+    device.add_argument("--door-check", type=float, default=2000, help="DOOR_CHECK_INTERVAL (ms)")
+    device.add_argument("--long-poll", type=float, default=25, help="TG_LONG_POLL_TIMEOUT (s)")
+    device.add_argument("--heartbeat", type=float, default=0, help="FLEET_HEARTBEAT_INTERVAL (s), 0 without a fleet")
+    device.add_argument("--dns-ttl", type=float, default=300, help="typical sink DNS TTL (s)")
+    device.add_argument("--loop-ms", type=float, default=0.3, help="loop pass CPU time at 240 MHz")
+    device.add_argument("--record-cpu-ms", type=float, default=2, help="TLS record CPU time at 240 MHz")
+    device.add_argument("--tx-ms", type=float, default=1.0, help="airtime per transmitted request")
+    device.add_argument("--beacon-rx-ms", type=float, default=2.5, help="radio on time per beacon wake")
+    device.add_argument("--light-sleep-wake-ms", type=float, default=1.0)
+
+    parser.add_argument("--battery-mah", type=float, default=2500)
+    parser.add_argument("--days", type=float, default=1, help="simulated time")
+    parser.add_argument("--samples", type=int, default=2000, help="door edges sampled for alert latency")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    currents = json.loads(json.dumps(CURRENTS_MA))
+    if args.currents:
+        with open(args.currents) as f:
+            currents.update(json.load(f))
+
+    results = []
+    for name in args.preset or sorted(PRESETS, key=list(PRESETS).index):
+        config = dict(PRESETS[name])
+        for key in ("power_save", "listen_interval", "tx_dbm", "cpu_mhz", "light_sleep", "idle_interval"):
+            if getattr(args, key) is not None:
+                config[key] = getattr(args, key)
+        if config["power_save"] == "max" and config["listen_interval"] % args.dtim:
+            print("warning: %s listen interval %d is not a multiple of DTIM %d" % (name, config["listen_interval"], args.dtim))
+        results.append(evaluate(name, config, currents, args))
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+        return
+
+    print("%-15s %9s %9s  %-36s %s" % ("config", "avg mA", "battery", "residency %", "alert latency ms p50/p99/max (bound)"))
+    for result in results:
+        residency = " ".join("%s %.1f" % item for item in sorted(result["residency"].items(), key=lambda i: -i[1]))
+        latency = result["alert_latency_ms"]
+        print("%-15s %9.2f %8.1fd  %-36s %d/%d/%d (%d)" % (
+            result["name"], result["average_ma"], result["battery_days"], residency,
+            latency["p50"], latency["p99"], latency["max"], latency["bound"]))
+
+
+if __name__ == "__main__":
+    main()
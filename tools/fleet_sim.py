@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+"""Simulates a fleet of alerters speaking the lib/Fleet multicast protocol.
+
+Runs several nodes in one process over loopback multicast so the election and
+heartbeat behaviour can be checked without hardware, e.g.
+
+  tools/fleet_sim.py --nodes 12 --events 20
+
+fires door events that every node in the zone sees (with a random sensing
+skew), then reports how many nodes alerted for each event and the traffic
+the fleet generated. Pass --interface with the LAN address of this host to
+run the simulated nodes next to real devices, or --listen to only print the
+fleet's traffic. --replay adds an eavesdropper that sends every datagram it
+hears a second time, to check that the nodes drop them.
+
+This is a model of the protocol written against lib/Fleet, not the device
+code itself; keep the two in step by hand.
+"""
+
+import argparse
+import hashlib
+import hmac
+import random
+import socket
+import struct
+import threading
+import time
+import zlib
+
+MAGIC = b"GDFL"
+VERSION = 2
+HEARTBEAT = 1
+CLAIM = 2
+ALERT_OPENED = 1
+ALERT_CLOSED = 2
+
+HEADER = struct.Struct("<4sBBHIIIII")
+DIGEST = struct.Struct("<IIHBB24s16s")
+CLAIM_BODY = struct.Struct("<16sB3x")
+
+# Mirrors lib/Fleet/Fleet.h
+TAG_SIZE = 16
+MAX_CLOCK_SKEW = 30
+MAX_PACKETS_PER_SECOND = 4
+NODE_TIMEOUT_FACTOR = 3
+CLAIM_REPEATS = 2
+
+
+def now_ms():
+    return int(time.monotonic() * 1000)
+
+
+def sign(secret, data):
+    return hmac.new(secret, data, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+def authentic(secret, data):
+    return hmac.compare_digest(sign(secret, data[:-TAG_SIZE]), data[-TAG_SIZE:])
+
+
+class Node:
+    def __init__(self, args, index, zone):
+        self.args = args
+        self.name = "%s-%d" % (args.name, index)
+        self.zone = zone
+        self.node_id = random.getrandbits(32) | 1
+        self.group = zlib.crc32(args.group.encode())
+        self.secret = args.secret.encode()
+        self.boot = random.getrandbits(32)
+        self.sequence = 0
+        self.started = now_ms()
+        self.door_open = False
+        self.open_events = 0
+        self.nodes = {}
+        self.claims = []
+        self.lock = threading.Lock()
+        self.sent = 0
+        self.bytes_sent = 0
+        self.received = 0
+        self.rejected = 0
+        self.replayed = 0
+        self.peers = {}
+        self.alerts = 0
+        self.running = True
+
+        self.sock = open_socket(args)
+        self.next_heartbeat = 0
+        threading.Thread(target=self.receive_loop, daemon=True).start()
+
+    def heartbeat_interval(self):
+        with self.lock:
+            fleet_size = len(self.nodes) + 1
+        return max(self.args.heartbeat, fleet_size * 1000 // MAX_PACKETS_PER_SECOND)
+
+    def send(self, packet_type, body):
+        header = HEADER.pack(MAGIC, VERSION, packet_type, 0, self.group, self.node_id, self.boot, self.sequence,
+                             int(time.time()))
+        self.sequence = (self.sequence + 1) & 0xFFFFFFFF
+        packet = header + body
+        packet += sign(self.secret, packet)
+        self.sock.sendto(packet, (self.args.address, self.args.port))
+        self.sent += 1
+        self.bytes_sent += len(packet)
+
+    def fresh(self, node_id, boot, sequence, timestamp):
+        if abs(timestamp - int(time.time())) > MAX_CLOCK_SKEW:
+            return False
+        peer = self.peers.get(node_id)
+        if peer is not None:
+            last_boot, last_sequence, last_timestamp = peer
+            # Wrap-safe, like the device's millis() comparisons
+            if boot == last_boot and not 0 < (sequence - last_sequence) & 0xFFFFFFFF < 0x80000000:
+                return False
+            if boot != last_boot and timestamp < last_timestamp:
+                return False
+        self.peers[node_id] = (boot, sequence, timestamp)
+        return True
+
+    def send_heartbeat(self):
+        interval = self.heartbeat_interval()
+        body = DIGEST.pack((now_ms() - self.started) // 1000, self.open_events, interval // 1000,
+                           int(self.door_open), 0, self.name.encode()[:23], self.zone.encode()[:15])
+        self.send(HEARTBEAT, body)
+        self.next_heartbeat = now_ms() + interval - random.randint(0, interval // 10)
+
+    def send_claim(self, alert):
+        self.send(CLAIM, CLAIM_BODY.pack(self.zone.encode()[:15], alert))
+
+    def receive_loop(self):
+        while self.running:
+            try:
+                data, address = self.sock.recvfrom(512)
+            except socket.timeout:
+                continue
+            except OSError:
+                return
+            if len(data) < HEADER.size + TAG_SIZE:
+                continue
+            magic, version, packet_type, _, group, node_id, boot, sequence, timestamp = HEADER.unpack_from(data)
+            if magic != MAGIC or version != VERSION or group != self.group or node_id == self.node_id:
+                continue
+            if not authentic(self.secret, data):
+                self.rejected += 1
+                continue
+            if not self.fresh(node_id, boot, sequence, timestamp):
+                self.replayed += 1
+                continue
+            self.received += 1
+            body = data[HEADER.size:-TAG_SIZE]
+            with self.lock:
+                if packet_type == HEARTBEAT and len(body) == DIGEST.size:
+                    self.nodes[node_id] = (now_ms(), DIGEST.unpack(body), address[0])
+                elif packet_type == CLAIM and len(body) == CLAIM_BODY.size:
+                    zone, alert = CLAIM_BODY.unpack(body)
+                    if zone.rstrip(b"\0").decode() == self.zone:
+                        self.claims = self.claims[-15:] + [(node_id, alert, now_ms())]
+
+    def tick(self):
+        with self.lock:
+            for node_id, (last_seen, digest, _) in list(self.nodes.items()):
+                if now_ms() - last_seen > NODE_TIMEOUT_FACTOR * max(digest[2], 1) * 1000:
+                    del self.nodes[node_id]
+        if now_ms() >= self.next_heartbeat:
+            self.send_heartbeat()
+
+    def zone_has_peers(self):
+        with self.lock:
+            return any(digest[6].rstrip(b"\0").decode() == self.zone for _, digest, _ in self.nodes.values())
+
+    def elect(self, alert):
+        started = now_ms()
+        with self.lock:
+            if any(a == alert and started - received < self.args.claim_ttl for _, a, received in self.claims):
+                return False
+
+        self.send_claim(alert)
+        if not self.zone_has_peers():
+            return True
+
+        repeats = 1
+        while now_ms() - started < self.args.window:
+            if repeats < CLAIM_REPEATS and now_ms() - started >= self.args.window * repeats // CLAIM_REPEATS:
+                self.send_claim(alert)
+                repeats += 1
+            time.sleep(0.01)
+
+        with self.lock:
+            return not any(a == alert and 0 <= received - started < self.args.window and node_id < self.node_id
+                           for node_id, a, received in self.claims)
+
+    def door_event(self, opened, results):
+        self.door_open = opened
+        if opened:
+            self.open_events += 1
+        if self.elect(ALERT_OPENED if opened else ALERT_CLOSED):
+            self.alerts += 1
+            results.append(self.name)
+
+    def close(self):
+        self.running = False
+        self.sock.close()
+
+
+def open_socket(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.bind(("", args.port))
+    interface = socket.inet_aton(args.interface)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, socket.inet_aton(args.address) + interface)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, interface)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+    sock.settimeout(0.2)
+    return sock
+
+
+def listen(args):
+    sock = open_socket(args)
+    while True:
+        try:
+            data, address = sock.recvfrom(512)
+        except socket.timeout:
+            continue
+        if len(data) < HEADER.size + TAG_SIZE or data[:4] != MAGIC:
+            continue
+        _, _, packet_type, _, _, node_id, _, sequence, _ = HEADER.unpack_from(data)
+        if not authentic(args.secret.encode(), data):
+            print("%s %08x #%d bad signature" % (address[0], node_id, sequence))
+            continue
+        body = data[HEADER.size:-TAG_SIZE]
+        if packet_type == HEARTBEAT and len(body) == DIGEST.size:
+            uptime, opens, interval, door_open, _, name, zone = DIGEST.unpack(body)
+            print("%s %08x #%d heartbeat %s (%s) %s, %d opens, up %ds, every %ds" % (
+                address[0], node_id, sequence, name.rstrip(b"\0").decode(), zone.rstrip(b"\0").decode(),
+                "OPEN" if door_open else "CLOSED", opens, uptime, interval))
+        elif packet_type == CLAIM and len(body) == CLAIM_BODY.size:
+            zone, alert = CLAIM_BODY.unpack(body)
+            print("%s %08x #%d claim %s in %s" % (address[0], node_id, sequence,
+                                                  "opened" if alert == ALERT_OPENED else "closed",
+                                                  zone.rstrip(b"\0").decode()))
+
+
+def replay(args, stop):
+    """Sends every datagram it hears once more, a second later"""
+    sock = open_socket(args)
+    pending = []
+    seen = set()
+    while not stop.is_set():
+        try:
+            data, _ = sock.recvfrom(512)
+            if data[:4] == MAGIC and data not in seen:
+                seen.add(data)
+                pending.append((time.monotonic() + 1, data))
+        except socket.timeout:
+            pass
+        while pending and pending[0][0] <= time.monotonic():
+            sock.sendto(pending.pop(0)[1], (args.address, args.port))
+    sock.close()
+
+
+def run_for(nodes, seconds):
+    deadline = time.monotonic() + seconds
+    while time.monotonic() < deadline:
+        for node in nodes:
+            node.tick()
+        time.sleep(0.05)
+
+
+def simulate(args):
+    zones = [args.zone] + ["zone-%d" % i for i in range(1, args.zones)]
+    nodes = [Node(args, i, zones[i % len(zones)]) for i in range(args.nodes)]
+    watching = [node for node in nodes if node.zone == args.zone]
+    print("%d nodes, %d watching %s; settling for %.1fs" % (len(nodes), len(watching), args.zone, args.settle))
+    stop_replay = threading.Event()
+    if args.replay:
+        threading.Thread(target=replay, args=(args, stop_replay), daemon=True).start()
+    run_for(nodes, args.settle)
+
+    duplicates = missed = 0
+    opened = False
+    for event in range(args.events):
+        opened = not opened
+        results = []
+        threads = []
+        # Each node notices the transition on its own polling schedule
+        for node in watching:
+            delay = random.uniform(0, args.skew)
+            thread = threading.Timer(delay, node.door_event, (opened, results))
+            thread.start()
+            threads.append(thread)
+        for thread in threads:
+            thread.join()
+        # Claims must age out before the next event of the same kind
+        run_for(nodes, max(args.gap, args.claim_ttl / 1000))
+
+        duplicates += max(len(results) - 1, 0)
+        missed += 1 if not results else 0
+        print("event %d (%s): alerted by %s" % (event + 1, "opened" if opened else "closed",
+                                                ", ".join(results) or "nobody"))
+
+    elapsed = (now_ms() - min(node.started for node in nodes)) / 1000
+    sent = sum(node.sent for node in nodes)
+    sent_bytes = sum(node.bytes_sent for node in nodes)
+    print("\n%d events: %d duplicate alerts, %d missed" % (args.events, duplicates, missed))
+    print("fleet traffic: %.2f packets/s, %.0f bytes/s over %.0fs" % (sent / elapsed, sent_bytes / elapsed, elapsed))
+    print("heartbeat interval with %d nodes: %.1fs" % (len(nodes), nodes[0].heartbeat_interval() / 1000))
+    print("dropped: %d bad signatures, %d stale or replayed" % (sum(node.rejected for node in nodes),
+                                                                sum(node.replayed for node in nodes)))
+    stop_replay.set()
+    for node in nodes:
+        node.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--group", default="home", help="FLEET_GROUP")
+    parser.add_argument("--secret", default="...", help="FLEET_SECRET")
+    parser.add_argument("--zone", default="garage", help="zone the simulated door events happen in")
+    parser.add_argument("--zones", type=int, default=1, help="spread nodes over this many zones")
+    parser.add_argument("--name", default="sim")
+    parser.add_argument("--address", default="239.255.42.99", help="FLEET_MULTICAST_ADDRESS")
+    parser.add_argument("--port", type=int, default=4242, help="FLEET_PORT")
+    parser.add_argument("--interface", default="127.0.0.1", help="local address to send and join on")
+    parser.add_argument("--nodes", type=int, default=5)
+    parser.add_argument("--events", type=int, default=10)
+    parser.add_argument("--heartbeat", type=int, default=10000, help="FLEET_HEARTBEAT_INTERVAL (ms)")
+    parser.add_argument("--window", type=int, default=300, help="FLEET_ELECTION_WINDOW (ms)")
+    parser.add_argument("--claim-ttl", type=int, default=6000, help="FLEET_CLAIM_TTL (ms)")
+    parser.add_argument("--skew", type=float, default=2.0, help="max delay between nodes noticing an event (s)")
+    parser.add_argument("--gap", type=float, default=1.0, help="pause between events (s)")
+    parser.add_argument("--settle", type=float, default=3.0, help="time for heartbeats to spread (s)")
+    parser.add_argument("--listen", action="store_true", help="only print fleet traffic")
+    parser.add_argument("--replay", action="store_true", help="replay every datagram to check they are dropped")
+    args = parser.parse_args()
+
+    if args.listen:
+        listen(args)
+    else:
+        simulate(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,116 @@
+"""Builds certs/x509_crt_bundle.bin from the PEM files in certs/.
+
+certs/loadtest/ holds the throwaway CA of tools/sink_standin.py; it is only
+added when LOAD_TEST_ENABLED is defined in src/config.h (or the build flags),
+so a production build never trusts it.
+
+Runs as a PlatformIO pre-build script (see platformio.ini) and can also be
+run by hand. The output uses the ESP-IDF certificate bundle layout consumed
+by WiFiClientSecure::setCACertBundle():
+
+  uint16 certificate count (big-endian)
+  per certificate, sorted by subject so the device can binary search:
+    uint16 subject length, uint16 public key length (big-endian)
+    subject Name (DER), SubjectPublicKeyInfo (DER)
+
+Only the subject and key of each CA are kept, so the bundle is a fraction of
+the size of the PEM text and nothing has to be parsed at connect time.
+
+To add a sink, drop its root (or issuing) CA into certs/, e.g. from
+  openssl s_client -showcerts -connect events.pagerduty.com:443 </dev/null
+"""
+
+import base64
+import glob
+import os
+import re
+import struct
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+CERTS_DIR = os.path.join(PROJECT_DIR, "certs")
+LOAD_TEST_CERTS_DIR = os.path.join(CERTS_DIR, "loadtest")
+CONFIG_PATH = os.path.join(PROJECT_DIR, "src", "config.h")
+BUNDLE_PATH = os.path.join(CERTS_DIR, "x509_crt_bundle.bin")
+
+PEM_RE = re.compile(r"-----BEGIN CERTIFICATE-----(.+?)-----END CERTIFICATE-----", re.S)
+
+
+def read_tlv(data, offset):
+    """Returns (tag, start of element, start of value, end of element)."""
+    tag = data[offset]
+    length = data[offset + 1]
+    value = offset + 2
+    if length & 0x80:
+        count = length & 0x7F
+        length = int.from_bytes(data[value:value + count], "big")
+        value += count
+    return tag, offset, value, value + length
+
+
+def subject_and_key(der):
+    _, _, cert_value, _ = read_tlv(der, 0)
+    _, _, tbs_value, tbs_end = read_tlv(der, cert_value)
+
+    fields = []
+    offset = tbs_value
+    while offset < tbs_end:
+        tag, start, _, end = read_tlv(der, offset)
+        if tag != 0xA0:  # skip the optional explicit version
+            fields.append((start, end))
+        offset = end
+
+    # serialNumber, signature, issuer, validity, subject, subjectPublicKeyInfo
+    subject = der[fields[4][0]:fields[4][1]]
+    public_key = der[fields[5][0]:fields[5][1]]
+    return subject, public_key
+
+
+def load_test_enabled():
+    try:
+        defines = env.get("CPPDEFINES", [])  # noqa: F821
+    except NameError:
+        defines = []
+    if any((define[0] if isinstance(define, (list, tuple)) else define) == "LOAD_TEST_ENABLED" for define in defines):
+        return True
+    with open(CONFIG_PATH) as f:
+        return re.search(r"^\s*#define\s+LOAD_TEST_ENABLED\b", f.read(), re.M) is not None
+
+
+def build_bundle(paths):
+    entries = []
+    for path in paths:
+        with open(path) as f:
+            for match in PEM_RE.finditer(f.read()):
+                entries.append(subject_and_key(base64.b64decode(match.group(1))))
+
+    entries.sort(key=lambda entry: entry[0])
+    bundle = struct.pack(">H", len(entries))
+    for subject, public_key in entries:
+        bundle += struct.pack(">HH", len(subject), len(public_key))
+        bundle += subject + public_key
+    return bundle
+
+
+def main():
+    paths = sorted(glob.glob(os.path.join(CERTS_DIR, "*.pem")))
+    if load_test_enabled():
+        paths += sorted(glob.glob(os.path.join(LOAD_TEST_CERTS_DIR, "*.pem")))
+        print("CA bundle: LOAD_TEST_ENABLED, trusting certs/loadtest/")
+    bundle = build_bundle(paths)
+
+    existing = None
+    if os.path.exists(BUNDLE_PATH):
+        with open(BUNDLE_PATH, "rb") as f:
+            existing = f.read()
+    if bundle != existing:
+        with open(BUNDLE_PATH, "wb") as f:
+            f.write(bundle)
+    print("CA bundle: %d certificates from %d files, %d bytes" % (struct.unpack(">H", bundle[:2])[0], len(paths), len(bundle)))
+
+
+main()
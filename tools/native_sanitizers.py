@@ -0,0 +1,9 @@
+"""Links [env:native_asan] against the sanitizer runtimes.
+
+PlatformIO hands build_flags to the compiler only, so the -fsanitize flag in
+platformio.ini is repeated here for the linker; keep the two in step.
+"""
+
+Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+
+env.Append(LINKFLAGS=["-fsanitize=address,undefined"])  # noqa: F821
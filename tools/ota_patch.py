@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""Build and upload compressed / delta OTA images for the garage-door-alerter.
+
+Examples:
+
+  # zlib compressed full image
+  ./tools/ota_patch.py --target .pio/build/esp32dev/firmware.bin --secret ... --upload garage-door-alerter.local
+
+  # delta against the firmware the device is currently running
+  ./tools/ota_patch.py --base previous/firmware.bin --target .pio/build/esp32dev/firmware.bin \
+      --output firmware.patch --secret ... --upload garage-door-alerter.local
+
+The secret is OTA_SECRET from src/config.h; it can also be passed in the
+OTA_SECRET environment variable. --output writes the unsigned header and
+payload, since uploads are signed against a nonce the device picks for each
+connection. The stream format is documented in lib/OtaUpdater/OtaUpdater.h.
+"""
+
+import argparse
+import hashlib
+import hmac
+import os
+import socket
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"GDOT"
+VERSION = 2
+HEADER_FORMAT = "<4sBBHIII32s32s"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+NONCE_SIZE = 16
+
+ENCODING_ZLIB = 0x01
+ENCODING_DELTA = 0x02
+
+OP_COPY = 0x01
+OP_DATA = 0x02
+
+DEFAULT_PORT = 3233
+
+# Matches shorter than this cost more as a COPY op than as literal data
+BLOCK = 32
+# Index every Nth offset of the base image; lower finds more matches but
+# uses more host memory.
+INDEX_STEP = 4
+
+
+def build_delta(base, target):
+    index = {}
+    for offset in range(0, len(base) - BLOCK + 1, INDEX_STEP):
+        index.setdefault(base[offset:offset + BLOCK], offset)
+
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        if literal:
+            ops.extend(struct.pack("<BI", OP_DATA, len(literal)))
+            ops.extend(literal)
+            literal.clear()
+
+    i = 0
+    # Code usually moves by a constant shift, so try the previous match's
+    # displacement before the index.
+    shift = 0
+    while i < len(target):
+        window = target[i:i + BLOCK]
+        source = None
+        if len(window) == BLOCK:
+            predicted = i + shift
+            if 0 <= predicted <= len(base) - BLOCK and base[predicted:predicted + BLOCK] == window:
+                source = predicted
+            else:
+                source = index.get(window)
+
+        if source is None:
+            literal.append(target[i])
+            i += 1
+            continue
+
+        # Extend the match backwards into pending literal bytes, then forwards
+        while literal and source > 0 and base[source - 1] == literal[-1]:
+            literal.pop()
+            source -= 1
+            i -= 1
+        length = 0
+        while i + length < len(target) and source + length < len(base) and target[i + length] == base[source + length]:
+            length += 1
+
+        flush_literal()
+        ops.extend(struct.pack("<BII", OP_COPY, source, length))
+        shift = source - i
+        i += length
+
+    flush_literal()
+    return bytes(ops)
+
+
+def build_patch(target, base=None, compress=True):
+    encoding = 0
+    source_size = 0
+    source_sha = bytes(32)
+    payload = target
+
+    if base is not None:
+        encoding |= ENCODING_DELTA
+        source_size = len(base)
+        source_sha = hashlib.sha256(base).digest()
+        payload = build_delta(base, target)
+
+    if compress:
+        encoding |= ENCODING_ZLIB
+        payload = zlib.compress(payload, 9)
+
+    header = struct.pack(HEADER_FORMAT,
+                         MAGIC, VERSION, encoding, 0,
+                         len(payload), len(target), source_size,
+                         source_sha, hashlib.sha256(target).digest())
+    return header + payload
+
+
+def recv_exactly(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("device closed the connection")
+        data += chunk
+    return data
+
+
+def sign(patch, nonce, secret):
+    """Returns the stream to send for nonce: header, header tag, payload, tag."""
+    header, payload = patch[:HEADER_SIZE], patch[HEADER_SIZE:]
+    tag = hmac.new(secret, nonce + header, hashlib.sha256)
+    header_tag = tag.copy().digest()
+    tag.update(payload)
+    return header + header_tag + payload + tag.digest()
+
+
+def upload(host, port, patch, secret):
+    started = time.monotonic()
+    with socket.create_connection((host, port), timeout=60) as sock:
+        nonce = recv_exactly(sock, NONCE_SIZE)
+        sock.sendall(sign(patch, nonce, secret))
+        sock.shutdown(socket.SHUT_WR)
+        reply = b""
+        while not reply.endswith(b"\n"):
+            chunk = sock.recv(256)
+            if not chunk:
+                break
+            reply += chunk
+    return reply.decode(errors="replace").strip(), time.monotonic() - started
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--target", required=True, help="new firmware.bin")
+    parser.add_argument("--base", help="firmware.bin currently running on the device (enables delta)")
+    parser.add_argument("--no-compress", action="store_true", help="send the payload uncompressed")
+    parser.add_argument("--output", help="write the patch to this file")
+    parser.add_argument("--upload", metavar="HOST", help="send the patch to the device")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT)
+    parser.add_argument("--secret", default=os.environ.get("OTA_SECRET"), help="OTA_SECRET from src/config.h")
+    args = parser.parse_args()
+    if args.upload and not args.secret:
+        parser.error("--upload needs --secret or OTA_SECRET")
+
+    with open(args.target, "rb") as f:
+        target = f.read()
+    base = None
+    if args.base:
+        with open(args.base, "rb") as f:
+            base = f.read()
+
+    started = time.monotonic()
+    patch = build_patch(target, base, not args.no_compress)
+    elapsed = time.monotonic() - started
+    print("image: %d bytes, patch: %d bytes (%.1f%%), built in %.2fs"
+          % (len(target), len(patch), 100.0 * len(patch) / len(target), elapsed))
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(patch)
+
+    if args.upload:
+        reply, elapsed = upload(args.upload, args.port, patch, args.secret.encode())
+        print("device: %s, %.2fs, %.1f KiB/s of image applied"
+              % (reply, elapsed, len(target) / 1024.0 / elapsed))
+        if reply != "OK":
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+"""Local stand-in for every sink the alerter talks to, with fault injection.
+
+Answers the PagerDuty Events API (/v2/enqueue), the Telegram Bot API
+(/bot<token>/getUpdates, /bot<token>/sendMessage) and the webhook (any other
+path), so the real firmware can be load tested on the bench:
+
+  1. tools/sink_standin.py --make-certs --webhook-host example.com
+     creates a throwaway CA and a server certificate for the sink host names,
+     and installs the CA as certs/loadtest/sink_standin_ca.pem.
+     tools/gen_ca_bundle.py only bundles certs/loadtest/ into builds with
+     LOAD_TEST_ENABLED, so the throwaway CA is never trusted in production.
+  2. Enable LOAD_TEST_ENABLED in src/config.h with SINK_STANDIN_ADDRESS set to
+     this machine, build and flash. The device's DNS cache then sends every
+     sink to the stand-in.
+  3. sudo tools/sink_standin.py --chat-id <TG_OWNER_CHAT_ID> --command "/burst 50" \\
+         --latency 200 --jitter 100 --drop 0.05 --results results.jsonl
+     (ports 443/80 need root or CAP_NET_BIND_SERVICE).
+
+The stand-in delivers the command through getUpdates, injects the requested
+faults, and waits for the device's /burst report. It then prints the
+device-side alert latency percentiles next to what it saw itself. With
+--results, one JSON line per run is appended so numbers can be compared from
+build to build.
+
+The native test suites run it on loopback with --tls-port 0, which answers
+every sink over plain HTTP on --http-port and needs no certificates, and
+with --requests to see what reached it.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import random
+import re
+import shutil
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CERTS_DIR = os.path.join(PROJECT_DIR, "certs")
+LOAD_TEST_CERTS_DIR = os.path.join(CERTS_DIR, "loadtest")
+SINKS = ("pagerduty", "telegram", "webhook")
+FAULTS = ("drop", "truncate", "chunked", "error")
+
+REPORT_RE = re.compile(
+    r"Burst: (?P<events>\d+) events \((?P<alerts>\d+) alerts\) in (?P<seconds>[\d.]+)s, (?P<rate>[\d.]+) alerts/s"
+    r".*?Alert latency: p50 (?P<p50>\d+)ms, p95 (?P<p95>\d+)ms, p99 (?P<p99>\d+)ms, max (?P<max>\d+)ms", re.S)
+
+
+def dumps(value):
+    # Compact like the real APIs, so the device's parsers see what they will in
+    # production
+    return json.dumps(value, separators=(",", ":")).encode()
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    ordered = sorted(values)
+    return round(ordered[max(int(len(ordered) * p / 100 + 0.999999) - 1, 0)], 1)
+
+
+class Recorder:
+    """Per-sink request counts, injected faults and handling times."""
+
+    def __init__(self, requests_path=None):
+        self.lock = threading.Lock()
+        self.requests = open(requests_path, "a") if requests_path else None
+        self.started = time.monotonic()
+        self.sinks = {sink: {"requests": 0, "faults": {f: 0 for f in FAULTS}, "handling_ms": []} for sink in SINKS}
+        self.messages = []
+        self.report = None
+        self.report_received = threading.Event()
+
+    def record(self, sink, fault, handling_ms):
+        with self.lock:
+            entry = self.sinks[sink]
+            entry["requests"] += 1
+            if fault:
+                entry["faults"][fault] += 1
+            entry["handling_ms"].append(handling_ms)
+
+    def request(self, entry):
+        """Appends one request, as a JSON line, to the --requests file."""
+        if not self.requests:
+            return
+        with self.lock:
+            self.requests.write(json.dumps(entry) + "\n")
+            self.requests.flush()
+
+    def message(self, text):
+        with self.lock:
+            self.messages.append(text)
+        match = REPORT_RE.search(text)
+        if match:
+            self.report = {key: float(value) for key, value in match.groupdict().items()}
+            self.report["text"] = text
+            self.report_received.set()
+
+    def summary(self):
+        elapsed = time.monotonic() - self.started
+        sinks = {}
+        with self.lock:
+            for sink, entry in self.sinks.items():
+                handling = entry["handling_ms"]
+                sinks[sink] = {
+                    "requests": entry["requests"],
+                    "requests_per_second": round(entry["requests"] / elapsed, 3),
+                    "faults": dict(entry["faults"]),
+                    "handling_ms": {"p%d" % p: percentile(handling, p) for p in (50, 95, 99)},
+                }
+        return {"elapsed_s": round(elapsed, 1), "sinks": sinks, "device": self.report}
+
+
+class StandinServer(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, address, args, recorder, tls_context=None):
+        super().__init__(address, Handler)
+        self.args = args
+        self.recorder = recorder
+        self.updates = []
+        self.update_id = 1000
+        self.updates_changed = threading.Condition()
+        if tls_context:
+            self.socket = tls_context.wrap_socket(self.socket, server_side=True)
+
+    def queue_command(self, text):
+        with self.updates_changed:
+            self.update_id += 1
+            self.updates.append({
+                "update_id": self.update_id,
+                "message": {"message_id": self.update_id, "date": int(time.time()), "text": text,
+                            "chat": {"id": int(self.args.chat_id), "type": "private"},
+                            "from": {"id": int(self.args.chat_id), "first_name": "Stand-in"}},
+            })
+            self.updates_changed.notify_all()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        if self.server.args.verbose:
+            sys.stderr.write("%s %s\n" % (self.address_string(), format % args))
+
+    def do_GET(self):
+        self.route()
+
+    def do_POST(self):
+        self.route()
+
+    def route(self):
+        started = time.monotonic()
+        url = urlparse(self.path)
+        length = int(self.headers.get("Content-Length") or 0)
+        body = self.rfile.read(length) if length else b""
+
+        if url.path == "/v2/enqueue":
+            sink = "pagerduty"
+            status, payload = self.pagerduty(body)
+        elif url.path.startswith("/bot"):
+            sink = "telegram"
+            status, payload = self.telegram(url, body)
+        else:
+            sink = "webhook"
+            status, payload = 200, b"OK"
+
+        fault = self.pick_fault(sink)
+        # Logged before answering, so whatever the device has seen is logged
+        self.server.recorder.request({
+            "sink": sink, "method": self.command, "path": self.path, "body": body.decode("utf-8", "replace"),
+            "fault": fault, "status": None if fault == "drop" else 500 if fault == "error" else status})
+        self.respond(sink, status, payload, fault)
+        self.server.recorder.record(sink, fault, (time.monotonic() - started) * 1000)
+
+    def pagerduty(self, body):
+        try:
+            event = json.loads(body or b"{}")
+        except ValueError:
+            return 400, dumps({"status": "invalid event", "message": "Event object is invalid"})
+        dedup_key = event.get("dedup_key") or uuid.uuid4().hex
+        return 202, dumps({"status": "success", "message": "Event processed", "dedup_key": dedup_key})
+
+    def telegram(self, url, body):
+        method = url.path.rsplit("/", 1)[-1]
+        query = {key: values[0] for key, values in parse_qs(url.query).items()}
+
+        if method == "getUpdates":
+            offset = int(query.get("offset", 0))
+            timeout = min(int(query.get("timeout", 0)), self.server.args.long_poll)
+            deadline = time.monotonic() + timeout
+            with self.server.updates_changed:
+                while True:
+                    pending = [u for u in self.server.updates if u["update_id"] >= offset]
+                    remaining = deadline - time.monotonic()
+                    if pending or remaining <= 0:
+                        break
+                    self.server.updates_changed.wait(remaining)
+            return 200, dumps({"ok": True, "result": pending})
+
+        if method == "sendMessage":
+            try:
+                message = json.loads(body) if body else query
+            except ValueError:
+                message = query
+            text = str(message.get("text", ""))
+            self.server.recorder.message(text)
+            if self.server.args.verbose:
+                print("telegram -> %s: %s" % (message.get("chat_id"), text.replace("\n", " | ")))
+            return 200, dumps({"ok": True, "result": {
+                "message_id": random.randint(1, 1 << 30), "date": int(time.time()),
+                "chat": {"id": message.get("chat_id")}, "text": text}})
+
+        return 200, dumps({"ok": True, "result": True})
+
+    def pick_fault(self, sink):
+        args = self.server.args
+        if args.faults_for and sink not in args.faults_for:
+            return None
+        roll = random.random()
+        for fault in FAULTS:
+            probability = getattr(args, fault)
+            if roll < probability:
+                return fault
+            roll -= probability
+        return None
+
+    def respond(self, sink, status, payload, fault):
+        args = self.server.args
+        applies = not args.faults_for or sink in args.faults_for
+        if applies and (args.latency or args.jitter):
+            time.sleep((args.latency + random.uniform(0, args.jitter)) / 1000)
+
+        if fault == "drop":
+            self.close_connection = True
+            self.connection.close()
+            return
+        if fault == "error":
+            status, payload = 500, b'{"error":"injected by sink_standin"}'
+
+        content_type = "text/plain" if sink == "webhook" else "application/json"
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        if fault == "chunked":
+            # Random chunk sizes, the odd chunk extension and a trailer, so
+            # chunk boundaries land anywhere in the JSON
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            start = 0
+            while start < len(payload):
+                chunk = payload[start:start + random.randint(1, 64)]
+                extension = b";standin=1" if random.random() < 0.2 else b""
+                self.write_slowly(b"%x%s\r\n" % (len(chunk), extension) + chunk + b"\r\n")
+                start += len(chunk)
+            self.write_slowly(b"0\r\nX-Standin-Fault: chunked\r\n\r\n")
+            return
+
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        if fault == "truncate":
+            self.write_slowly(payload[:len(payload) // 2])
+            self.close_connection = True
+            self.wfile.flush()
+            self.connection.close()
+            return
+        self.write_slowly(payload)
+
+    def write_slowly(self, data):
+        rate = self.server.args.slow
+        if not rate:
+            self.wfile.write(data)
+            return
+        step = max(rate // 10, 1)
+        for start in range(0, len(data), step):
+            self.wfile.write(data[start:start + step])
+            self.wfile.flush()
+            time.sleep(step / rate)
+
+
+def make_certs(args):
+    names = ["events.pagerduty.com", "api.telegram.org"] + ([args.webhook_host] if args.webhook_host else [])
+    directory = args.cert_dir
+    os.makedirs(directory, exist_ok=True)
+    ca_key, ca_pem = os.path.join(directory, "ca.key"), os.path.join(directory, "ca.pem")
+    key, csr, pem = (os.path.join(directory, name) for name in ("server.key", "server.csr", "server.pem"))
+
+    def openssl(*command):
+        subprocess.run(("openssl",) + command, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    openssl("req", "-x509", "-newkey", "rsa:2048", "-nodes", "-keyout", ca_key, "-out", ca_pem,
+            "-days", "825", "-subj", "/CN=garage-door-alerter sink stand-in CA")
+    openssl("req", "-newkey", "rsa:2048", "-nodes", "-keyout", key, "-out", csr, "-subj", "/CN=sink-standin")
+    with tempfile.NamedTemporaryFile("w", suffix=".ext", delete=False) as ext:
+        ext.write("subjectAltName=" + ",".join("DNS:" + name for name in names) + "\n")
+    try:
+        openssl("x509", "-req", "-in", csr, "-CA", ca_pem, "-CAkey", ca_key, "-CAcreateserial",
+                "-out", pem, "-days", "825", "-extfile", ext.name)
+    finally:
+        os.unlink(ext.name)
+
+    os.makedirs(LOAD_TEST_CERTS_DIR, exist_ok=True)
+    shutil.copy(ca_pem, os.path.join(LOAD_TEST_CERTS_DIR, "sink_standin_ca.pem"))
+    print("Server certificate for %s in %s" % (", ".join(names), directory))
+    print("CA installed as certs/loadtest/sink_standin_ca.pem; rebuild with LOAD_TEST_ENABLED to trust it")
+
+
+def serve(server):
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--tls-port", type=int, default=443,
+                        help="PagerDuty and Telegram (and SSL webhooks); 0 to answer them on --http-port instead")
+    parser.add_argument("--http-port", type=int, default=80, help="plain webhooks; 0 to disable")
+    parser.add_argument("--cert-dir", default=os.path.join(CERTS_DIR, "standin"))
+    parser.add_argument("--make-certs", action="store_true", help="create the CA and server certificate, then exit")
+    parser.add_argument("--webhook-host", help="WEBHOOK_HOSTNAME, added to the server certificate")
+    parser.add_argument("--chat-id", default="0", help="TG_OWNER_CHAT_ID of the device")
+    parser.add_argument("--command", action="append", default=[], help="Telegram command to send the device")
+    parser.add_argument("--long-poll", type=int, default=25, help="cap on getUpdates long polls (s)")
+    parser.add_argument("--duration", type=float, help="stop after this many seconds")
+    parser.add_argument("--report-timeout", type=float, default=600, help="give up waiting for a /burst report (s)")
+    parser.add_argument("--results", help="append a JSON line with this run's results")
+    parser.add_argument("--requests", help="append a JSON line for every request received")
+    parser.add_argument("--seed", type=int, help="seed the fault injection, to repeat a run")
+    parser.add_argument("--verbose", action="store_true")
+
+    faults = parser.add_argument_group("fault injection")
+    faults.add_argument("--latency", type=float, default=0, help="added to every response (ms)")
+    faults.add_argument("--jitter", type=float, default=0, help="random extra latency up to this (ms)")
+    faults.add_argument("--drop", type=float, default=0, help="probability of closing without answering")
+    faults.add_argument("--truncate", type=float, default=0, help="probability of cutting the body short")
+    faults.add_argument("--chunked", type=float, default=0, help="probability of a chunked response")
+    faults.add_argument("--error", type=float, default=0, help="probability of an HTTP 500")
+    faults.add_argument("--slow", type=int, default=0, help="drip response bodies at this many bytes/s")
+    faults.add_argument("--faults-for", type=lambda value: value.split(","), default=None,
+                        help="comma separated sinks to inject faults into (default: all)")
+    args = parser.parse_args()
+
+    if args.make_certs:
+        make_certs(args)
+        return
+    if not args.tls_port and not args.http_port:
+        parser.error("--tls-port and --http-port cannot both be 0")
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    recorder = Recorder(args.requests)
+    # Telegram commands are handed out by whichever server answers the API
+    api_server = None
+    if args.tls_port:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(os.path.join(args.cert_dir, "server.pem"), os.path.join(args.cert_dir, "server.key"))
+        api_server = StandinServer((args.bind, args.tls_port), args, recorder, context)
+        serve(api_server)
+    if args.http_port:
+        http_server = StandinServer((args.bind, args.http_port), args, recorder)
+        serve(http_server)
+        api_server = api_server or http_server
+    print("Stand-in listening on %s (TLS %s, HTTP %s)" % (args.bind, args.tls_port or "off", args.http_port or "off"),
+          flush=True)
+
+    for command in args.command:
+        api_server.queue_command(command)
+
+    try:
+        if any(command.startswith("/burst") for command in args.command):
+            if not recorder.report_received.wait(args.report_timeout):
+                print("No /burst report received within %ds" % args.report_timeout)
+            # Let the report's own sendMessage get its answer
+            time.sleep(1)
+        else:
+            time.sleep(args.duration if args.duration else 1e9)
+    except KeyboardInterrupt:
+        pass
+
+    summary = recorder.summary()
+    for sink, entry in summary["sinks"].items():
+        handling = entry["handling_ms"]
+        injected = ", ".join("%d %s" % (count, fault) for fault, count in entry["faults"].items() if count) or "none"
+        print("%-9s %5d requests (%.2f/s), handling p50 %s p95 %s p99 %s ms, faults: %s" % (
+            sink, entry["requests"], entry["requests_per_second"],
+            *("%.0f" % handling[p] if handling[p] is not None else "-" for p in ("p50", "p95", "p99")), injected))
+    if summary["device"]:
+        device = summary["device"]
+        print("device    %d alerts in %.1fs (%.2f/s), alert latency p50 %d p95 %d p99 %d max %d ms" % (
+            device["alerts"], device["seconds"], device["rate"], device["p50"], device["p95"], device["p99"], device["max"]))
+
+    if args.results:
+        summary["timestamp"] = datetime.datetime.now().isoformat(timespec="seconds")
+        summary["faults"] = {name: getattr(args, name) for name in FAULTS + ("latency", "jitter", "slow")}
+        try:
+            summary["revision"] = subprocess.run(["git", "-C", PROJECT_DIR, "describe", "--always", "--dirty"],
+                                                 capture_output=True, text=True).stdout.strip()
+        except OSError:
+            pass
+        with open(args.results, "a") as f:
+            f.write(json.dumps(summary) + "\n")
+
+
+if __name__ == "__main__":
+    main()